@@ -31,9 +31,51 @@
 #ifndef QUATER_H
 #define QUATER_H
 
+#include <array>
 #include <cmath>
 #include <type_traits>
 #include <complex>
+#include <istream>
+#include <ostream>
+#include "QuaternionInstrumentation.h"
+
+namespace quaternion_contract {
+
+    /**
+     * Pass x through an empty asm statement that pins it to a register, so
+     * the product it holds is rounded on its own. Only float and double can
+     * be contracted, and only on targets with FMA: elsewhere this is free.
+     * QuaternionSimd.h adds the SIMD vector overloads.
+     */
+    template<typename T>
+    inline T opaque(T x) noexcept {
+#if defined(__GNUC__) && defined(__FMA__)
+        if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+            asm("" : "+v"(x));
+        }
+#endif
+        return x;
+    }
+
+    /**
+     * Keeps the compiler from fusing the product x with the sum that follows
+     * into an FMA. GCC contracts across expressions by default as soon as
+     * the target has FMA (-march=native), which would make the operators
+     * round differently from their SIMD versions depending on the consumer
+     * flags. __builtin_assoc_barrier is not enough: it is lost when the
+     * scalar code is SLP vectorized. Nothing to do in constant evaluation.
+     */
+    template<typename T>
+    constexpr T no_contract(T x) noexcept {
+        if (__builtin_is_constant_evaluated()) {
+            return x;
+        }
+        return opaque(x);
+    }
+
+}
+
+#define QUATERNION_NO_CONTRACT(x) quaternion_contract::no_contract(x)
 
 template<typename T = double>
 class Quaternion {
@@ -49,73 +91,75 @@ public:
     /**
      * Default constuctor
      */
-    Quaternion(const T& n = static_cast<T>(0), const T& ni = static_cast<T>(0), const T& nj = static_cast<T>(0), const T& nk = static_cast<T>(0))
+    constexpr Quaternion(const T& n = static_cast<T>(0), const T& ni = static_cast<T>(0), const T& nj = static_cast<T>(0), const T& nk = static_cast<T>(0)) noexcept
         : n(n), ni(ni), nj(nj), nk(nk) {}
 
     /**
      * Specialized constructor for std::complex
      */
-    Quaternion(const std::complex<T>& complex_a, const std::complex<T>& complex_b = std::complex<T>(static_cast<T>(0), static_cast<T>(0)))
+    constexpr Quaternion(const std::complex<T>& complex_a, const std::complex<T>& complex_b = std::complex<T>(static_cast<T>(0), static_cast<T>(0))) noexcept
         : n(complex_a.real()), ni(complex_a.imag()), nj(complex_b.real()), nk(complex_b.imag()) {}
     
     /**
      * Copy constructor 
      */
     template<typename U>
-    Quaternion(const Quaternion<U>& rhs)
+    constexpr Quaternion(const Quaternion<U>& rhs) noexcept
         : n(rhs.a()), ni(rhs.b()), nj(rhs.c()), nk(rhs.d()) {}
     
     /**
      * Default copy assignment operator
      */
     template<typename U>
-    Quaternion<T>& operator=(const Quaternion<U>& rhs) {
+    constexpr Quaternion<T>& operator=(const Quaternion<U>& rhs) noexcept {
         this->n = rhs.a();
         this->ni = rhs.b();
         this->nj = rhs.c();
         this->nk = rhs.d();
+        return *this;
     }
     
     /**
      * Specialized copy assignment operator for std::complex
      */
     template<typename U>
-    Quaternion<T>& operator=(const std::complex<U> rhs) {
+    constexpr Quaternion<T>& operator=(const std::complex<U> rhs) noexcept {
         this->n = rhs.real();
         this->ni = rhs.imag();
         this->nj = static_cast<T>(0);
         this->nk = static_cast<T>(0);
+        return *this;
     }
     
-    T a() const {
+    constexpr T a() const noexcept {
         return this->n;
     }
     
-    T b() const {
+    constexpr T b() const noexcept {
         return this->ni;
     }
     
-    T c() const {
+    constexpr T c() const noexcept {
         return this->nj;
     }
     
-    T d() const {
+    constexpr T d() const noexcept {
         return this->nk;
     }
     
-    std::complex<T> complex_a() const {
+    constexpr std::complex<T> complex_a() const noexcept {
         return {this->n, this->ni};
     }
     
-    std::complex<T> complex_b() const {
+    constexpr std::complex<T> complex_b() const noexcept {
         return {this->nj, this->nk};
     }
     
-    T real() const {
+    constexpr T real() const noexcept {
         return this->n;
     }
     
-    Quaternion<T> unreal() const {
+    constexpr Quaternion<T> unreal() const noexcept {
         return {static_cast<T>(0), this->ni, this->nj, this->nk};
     }
        
@@ -127,28 +171,28 @@ namespace std {
      * Norm of quaternion
      */
     template<typename T>
-    T norm(const Quaternion<T>& quat) {
-        return (quat.a() * quat.a()) + (quat.b() * quat.b()) + (quat.c() * quat.c()) + (quat.d() * quat.d());
+    constexpr T norm(const Quaternion<T>& quat) noexcept {
+        return QUATERNION_NO_CONTRACT(quat.a() * quat.a()) + QUATERNION_NO_CONTRACT(quat.b() * quat.b()) + QUATERNION_NO_CONTRACT(quat.c() * quat.c()) + QUATERNION_NO_CONTRACT(quat.d() * quat.d());
     }
     
     /**
     * Implementation of abs with float sqrt 
     */
-    float abs(const Quaternion<float>& quat) {
+    inline float abs(const Quaternion<float>& quat) noexcept {
         return std::sqrt(std::norm(quat));
     }
 
     /**
     * Implementation of abs with double sqrt 
     */
-    double abs(const Quaternion<double>& quat) {
+    inline double abs(const Quaternion<double>& quat) noexcept {
         return std::sqrt(std::norm(quat));
     }
 
     /**
     * Implementation of abs with long double sqrt 
     */
-    long double abs(const Quaternion<long double>& quat) {
+    inline long double abs(const Quaternion<long double>& quat) noexcept {
         return std::sqrt(std::norm(quat));
     }
     
@@ -156,7 +200,7 @@ namespace std {
     * The conjugate of quaternion
     */
     template<typename T>
-    Quaternion<T> conj(const Quaternion<T>& quat) {
+    constexpr Quaternion<T> conj(const Quaternion<T>& quat) noexcept {
         return {quat.a(), quat.b() * -1, quat.c() * -1, quat.d() * -1};
     }
     
@@ -164,24 +208,61 @@ namespace std {
      * Is not a number?
      */
     template<typename T>
-    bool isnan(Quaternion<T> quat) {
-        return std::isnan(quat.a()) || std::isnan(quat.b()) || std::isnan(quat.c()) || std::isnan(quat.d());
+    bool isnan(const Quaternion<T>& quat) noexcept {
+        return std::isnan(quat.a()) | std::isnan(quat.b()) | std::isnan(quat.c()) | std::isnan(quat.d());
     }
     
     /**
      * Is infinite?
      */
     template<typename T>
-    bool isinf(Quaternion<T> quat) {
-        return std::isinf(quat.a()) || std::isinf(quat.b()) || std::isinf(quat.c()) || std::isinf(quat.d());
+    bool isinf(const Quaternion<T>& quat) noexcept {
+        return std::isinf(quat.a()) | std::isinf(quat.b()) | std::isinf(quat.c()) | std::isinf(quat.d());
     }
     
     /**
      * Is finite?
      */
     template<typename T>
-    bool isfinite(Quaternion<T> quat) {
-        return std::isfinite(quat.a()) && std::isfinite(quat.b()) && std::isfinite(quat.c()) && std::isfinite(quat.d());
+    bool isfinite(const Quaternion<T>& quat) noexcept {
+        return std::isfinite(quat.a()) & std::isfinite(quat.b()) & std::isfinite(quat.c()) & std::isfinite(quat.d());
+    }
+    
+    /**
+     * Exponential of quaternion
+     */
+    template<typename T>
+    Quaternion<T> exp(const Quaternion<T>& quat) {
+        T vnorm = std::sqrt((quat.b() * quat.b()) + (quat.c() * quat.c()) + (quat.d() * quat.d()));
+        T ea = std::exp(quat.a());
+        T k = vnorm > 0 ? ea * std::sin(vnorm) / vnorm : ea;
+        return {ea * std::cos(vnorm), k * quat.b(), k * quat.c(), k * quat.d()};
+    }
+    
+    /**
+     * Natural logarithm of quaternion, principal branch.
+     * Negative reals take the i axis, as std::log does for std::complex.
+     */
+    template<typename T>
+    Quaternion<T> log(const Quaternion<T>& quat) {
+        T vnorm = std::sqrt((quat.b() * quat.b()) + (quat.c() * quat.c()) + (quat.d() * quat.d()));
+        T theta = std::atan2(vnorm, quat.a());
+        T ln = std::log(std::sqrt(std::norm(quat)));
+        if (vnorm > 0) {
+            T k = theta / vnorm;
+            return {ln, k * quat.b(), k * quat.c(), k * quat.d()};
+        }
+        return {ln, theta, static_cast<T>(0), static_cast<T>(0)};
+    }
+    
+    /**
+     * Quaternion raised to a real power
+     */
+    template<typename T, typename _tB, typename = std::enable_if_t<std::is_arithmetic<_tB>::value>>
+    Quaternion<T> pow(const Quaternion<T>& quat, const _tB& exponent) {
+        Quaternion<T> ln = std::log(quat);
+        T p = static_cast<T>(exponent);
+        return std::exp(Quaternion<T>(ln.a() * p, ln.b() * p, ln.c() * p, ln.d() * p));
     }
     
 }
@@ -190,7 +271,7 @@ namespace std {
  * Add operator between two quaternios.
  */
 template<typename _tA, typename _tB>
-auto operator+(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltype(lhs.a() + rhs.a())> {
+constexpr auto operator+(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) noexcept -> Quaternion<decltype(lhs.a() + rhs.a())> {
     return {lhs.a() + rhs.a(), lhs.b() + rhs.b(), lhs.c() + rhs.c(), lhs.d() + rhs.d()};
 }
 
@@ -198,15 +279,16 @@ auto operator+(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) -> Quater
  * Add operator between quaternion and std::complex.
  */
 template<typename _tA, typename _tB>
-auto operator+(const Quaternion<_tA>& lhs, const std::complex<_tB>& rhs) -> Quaternion<decltype(lhs.a() + rhs.real())> {
-    return {lhs.a() + rhs.real(), lhs.b() + rhs.imag(), lhs.c(), lhs.d()};
+constexpr auto operator+(const Quaternion<_tA>& lhs, const std::complex<_tB>& rhs) noexcept -> Quaternion<decltype(lhs.a() + rhs.real())> {
+    using _tR = decltype(lhs.a() + rhs.real());
+    return {lhs.a() + rhs.real(), lhs.b() + rhs.imag(), static_cast<_tR>(lhs.c()), static_cast<_tR>(lhs.d())};
 }
 
 /**
  * Add operator between std::complex and quaternion.
  */
 template<typename _tA, typename _tB>
-auto operator+(const std::complex<_tB>& lhs, const Quaternion<_tA>& rhs) -> Quaternion<decltype(lhs.real() + rhs.a())> {
+constexpr auto operator+(const std::complex<_tB>& lhs, const Quaternion<_tA>& rhs) noexcept -> Quaternion<decltype(lhs.real() + rhs.a())> {
     return operator+(rhs, lhs);
 }
 
@@ -214,15 +296,16 @@ auto operator+(const std::complex<_tB>& lhs, const Quaternion<_tA>& rhs) -> Quat
  * Add operator between quaternion and scalar.
  */
 template<typename _tA, typename _tB>
-auto operator+(const Quaternion<_tA>& lhs, const _tB& rhs) -> Quaternion<decltype(lhs.a() + rhs)> {
-    return {lhs.a() + rhs, lhs.b(), lhs.c(), lhs.d()};
+constexpr auto operator+(const Quaternion<_tA>& lhs, const _tB& rhs) noexcept -> Quaternion<decltype(lhs.a() + rhs)> {
+    using _tR = decltype(lhs.a() + rhs);
+    return {lhs.a() + rhs, static_cast<_tR>(lhs.b()), static_cast<_tR>(lhs.c()), static_cast<_tR>(lhs.d())};
 }
 
 /**
  * Add operator between scalar and quaternion.
  */
 template<typename _tA, typename _tB>
-auto operator+(const _tA& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltype(lhs + rhs.a())> {
+constexpr auto operator+(const _tA& lhs, const Quaternion<_tB>& rhs) noexcept -> Quaternion<decltype(lhs + rhs.a())> {
     return operator+(rhs, lhs);
 }
 
@@ -230,7 +313,7 @@ auto operator+(const _tA& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltyp
  * Sub operator between two quaternions.
  */
 template<typename _tA, typename _tB>
-auto operator-(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltype(lhs.a() - rhs.a())> {
+constexpr auto operator-(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) noexcept -> Quaternion<decltype(lhs.a() - rhs.a())> {
     return {lhs.a() - rhs.a(), lhs.b() - rhs.b(), lhs.c() - rhs.c(), lhs.d() - rhs.d()};
 }
 
@@ -238,75 +321,85 @@ auto operator-(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) -> Quater
  * Sub operator between quaternion and std:complex.
  */
 template<typename _tA, typename _tB>
-auto operator-(const Quaternion<_tA>& lhs, const std::complex<_tB>& rhs) -> Quaternion<decltype(lhs.a() - rhs.real())> {
-    return {lhs.a() - rhs.real(), lhs.b() - rhs.imag(), lhs.c(), lhs.d()};
+constexpr auto operator-(const Quaternion<_tA>& lhs, const std::complex<_tB>& rhs) noexcept -> Quaternion<decltype(lhs.a() - rhs.real())> {
+    using _tR = decltype(lhs.a() - rhs.real());
+    return {lhs.a() - rhs.real(), lhs.b() - rhs.imag(), static_cast<_tR>(lhs.c()), static_cast<_tR>(lhs.d())};
 }
 
 /**
  * Sub operator between std:complex and quaternion.
  */
 template<typename _tA, typename _tB>
-auto operator-(const std::complex<_tB>& lhs, const Quaternion<_tA>& rhs) -> Quaternion<decltype(lhs.real() - rhs.a())> {
-    return {lhs.real() - rhs.a(), lhs.imag() - rhs.b(), -rhs.c(), -rhs.d()};
+constexpr auto operator-(const std::complex<_tB>& lhs, const Quaternion<_tA>& rhs) noexcept -> Quaternion<decltype(lhs.real() - rhs.a())> {
+    using _tR = decltype(lhs.real() - rhs.a());
+    return {lhs.real() - rhs.a(), lhs.imag() - rhs.b(), static_cast<_tR>(-rhs.c()), static_cast<_tR>(-rhs.d())};
 }
 
 /**
  * Sub operator between quaternion and scalar.
  */
 template<typename _tA, typename _tB>
-auto operator-(const Quaternion<_tA>& lhs, const _tB& rhs) -> Quaternion<decltype(lhs.a() - rhs)> {
-    return {lhs.a() - rhs, lhs.b(), lhs.c(), lhs.d()};
+constexpr auto operator-(const Quaternion<_tA>& lhs, const _tB& rhs) noexcept -> Quaternion<decltype(lhs.a() - rhs)> {
+    using _tR = decltype(lhs.a() - rhs);
+    return {lhs.a() - rhs, static_cast<_tR>(lhs.b()), static_cast<_tR>(lhs.c()), static_cast<_tR>(lhs.d())};
 }
 
 /**
  * Sub operator between scalar and quaternion.
  */
 template<typename _tA, typename _tB>
-auto operator-(const _tA& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltype(lhs - rhs.a())> {
-    return {lhs - rhs.a(), -rhs.b(), -rhs.c(), -rhs.d()};
+constexpr auto operator-(const _tA& lhs, const Quaternion<_tB>& rhs) noexcept -> Quaternion<decltype(lhs - rhs.a())> {
+    using _tR = decltype(lhs - rhs.a());
+    return {lhs - rhs.a(), static_cast<_tR>(-rhs.b()), static_cast<_tR>(-rhs.c()), static_cast<_tR>(-rhs.d())};
 }
 
 /**
  * Mul operator between two quaternions.
  */
 template<typename _tA, typename _tB>
-auto operator*(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltype(lhs.a() * rhs.a())> {
-    decltype(lhs.a() * rhs.a()) tn = (lhs.a() * rhs.a()) - (lhs.b() * rhs.b()) - (lhs.c() * rhs.c()) - (lhs.d() * rhs.d());
-    decltype(lhs.a() * rhs.a()) tni = (lhs.a() * rhs.b()) + (lhs.b() * rhs.a()) + (lhs.c() * rhs.d()) - (lhs.d() * rhs.c());
-    decltype(lhs.a() * rhs.a()) tnj = (lhs.a() * rhs.c()) + (lhs.c() * rhs.a()) + (lhs.d() * rhs.b()) - (lhs.b() * rhs.d());
-    decltype(lhs.a() * rhs.a()) tnk = (lhs.a() * rhs.d()) + (lhs.d() * rhs.a()) + (lhs.b() * rhs.c()) - (lhs.c() * rhs.b());
-    return {tn, tni, tnj, tnk};
+constexpr auto operator*(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) noexcept -> Quaternion<decltype(lhs.a() * rhs.a())> {
+    decltype(lhs.a() * rhs.a()) tn = QUATERNION_NO_CONTRACT(lhs.a() * rhs.a()) - QUATERNION_NO_CONTRACT(lhs.b() * rhs.b()) - QUATERNION_NO_CONTRACT(lhs.c() * rhs.c()) - QUATERNION_NO_CONTRACT(lhs.d() * rhs.d());
+    decltype(lhs.a() * rhs.a()) tni = QUATERNION_NO_CONTRACT(lhs.a() * rhs.b()) + QUATERNION_NO_CONTRACT(lhs.b() * rhs.a()) + QUATERNION_NO_CONTRACT(lhs.c() * rhs.d()) - QUATERNION_NO_CONTRACT(lhs.d() * rhs.c());
+    decltype(lhs.a() * rhs.a()) tnj = QUATERNION_NO_CONTRACT(lhs.a() * rhs.c()) + QUATERNION_NO_CONTRACT(lhs.c() * rhs.a()) + QUATERNION_NO_CONTRACT(lhs.d() * rhs.b()) - QUATERNION_NO_CONTRACT(lhs.b() * rhs.d());
+    decltype(lhs.a() * rhs.a()) tnk = QUATERNION_NO_CONTRACT(lhs.a() * rhs.d()) + QUATERNION_NO_CONTRACT(lhs.d() * rhs.a()) + QUATERNION_NO_CONTRACT(lhs.b() * rhs.c()) - QUATERNION_NO_CONTRACT(lhs.c() * rhs.b());
+    Quaternion<decltype(lhs.a() * rhs.a())> result(tn, tni, tnj, tnk);
+    QUATERNION_RECORD(Multiply, result);
+    return result;
 }
 
 /**
  * Mul operator between quaternion and std:complex.
  */
 template<typename _tA, typename _tB>
-auto operator*(const Quaternion<_tA>& lhs, const std::complex<_tB>& rhs) -> Quaternion<decltype(lhs.a() * rhs.real())> {
+constexpr auto operator*(const Quaternion<_tA>& lhs, const std::complex<_tB>& rhs) noexcept -> Quaternion<decltype(lhs.a() * rhs.real())> {
     decltype(lhs.a() * rhs.real()) tn = (lhs.a() * rhs.real()) - (lhs.b() * rhs.imag());
     decltype(lhs.a() * rhs.real()) tni = (lhs.a() * rhs.imag()) + (lhs.b() * rhs.real());
     decltype(lhs.a() * rhs.real()) tnj = (lhs.c() * rhs.real()) + (lhs.d() * rhs.imag());
     decltype(lhs.a() * rhs.real()) tnk = (lhs.d() * rhs.real()) - (lhs.c() * rhs.imag());
-    return {tn, tni, tnj, tnk};
+    Quaternion<decltype(lhs.a() * rhs.real())> result(tn, tni, tnj, tnk);
+    QUATERNION_RECORD(Multiply, result);
+    return result;
 }
 
 /**
  * Mul operator between std:complex and quaternion.
  */
 template<typename _tA, typename _tB>
-auto operator*(const std::complex<_tB>& lhs, const Quaternion<_tA>& rhs) -> Quaternion<decltype(lhs.real() * rhs.a())> {
+constexpr auto operator*(const std::complex<_tB>& lhs, const Quaternion<_tA>& rhs) noexcept -> Quaternion<decltype(lhs.real() * rhs.a())> {
     decltype(lhs.real() * rhs.a()) tn = (lhs.real() * rhs.a()) - (lhs.imag() * rhs.b());
     decltype(lhs.real() * rhs.a()) tni = (lhs.real() * rhs.b()) + (lhs.imag() * rhs.a());
     decltype(lhs.real() * rhs.a()) tnj = (lhs.real() * rhs.c()) - (lhs.imag() * rhs.d());
     decltype(lhs.real() * rhs.a()) tnk = (lhs.real() * rhs.d()) + (lhs.imag() * rhs.c());
-    return {tn, tni, tnj, tnk};
+    Quaternion<decltype(lhs.real() * rhs.a())> result(tn, tni, tnj, tnk);
+    QUATERNION_RECORD(Multiply, result);
+    return result;
 }
 
 /**
  * Mul operator between quaternion and scalar.
  */
 template<typename _tA, typename _tB>
-auto operator*(const Quaternion<_tA>& lhs, const _tB& rhs) -> Quaternion<decltype(lhs.a() * rhs)> {
+constexpr auto operator*(const Quaternion<_tA>& lhs, const _tB& rhs) noexcept -> Quaternion<decltype(lhs.a() * rhs)> {
     return {lhs.a() * rhs, lhs.b() * rhs, lhs.c() * rhs, lhs.d() * rhs};
 }
 
@@ -314,7 +407,7 @@ auto operator*(const Quaternion<_tA>& lhs, const _tB& rhs) -> Quaternion<decltyp
  * Mul operator between scalar and quaternion.
  */
 template<typename _tA, typename _tB>
-auto operator*(const _tA& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltype(lhs * rhs.a())> {
+constexpr auto operator*(const _tA& lhs, const Quaternion<_tB>& rhs) noexcept -> Quaternion<decltype(lhs * rhs.a())> {
     return operator*(rhs, lhs);
 }
 
@@ -322,20 +415,23 @@ auto operator*(const _tA& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltyp
  * Div operator between two quaternions.
  */
 template<typename _tA, typename _tB>
-auto operator/(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) -> Quaternion<decltype((lhs.a() * rhs.a()) / rhs.a())> {
-    decltype(lhs.a() * rhs.a()) tn  = (lhs.a() * rhs.a()) + (lhs.b() * rhs.b()) + (lhs.c() * rhs.c()) + (lhs.d() * rhs.d());
-    decltype(lhs.a() * rhs.a()) tni = - (lhs.a() * rhs.b()) + (lhs.b() * rhs.a()) - (lhs.c() * rhs.d()) + (lhs.d() * rhs.c());
-    decltype(lhs.a() * rhs.a()) tnj = - (lhs.a() * rhs.c()) + (lhs.c() * rhs.a()) - (lhs.d() * rhs.b()) + (lhs.b() * rhs.d());
-    decltype(lhs.a() * rhs.a()) tnk = - (lhs.a() * rhs.d()) + (lhs.d() * rhs.a()) - (lhs.b() * rhs.c()) + (lhs.c() * rhs.b());
+constexpr auto operator/(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) noexcept -> Quaternion<decltype((lhs.a() * rhs.a()) / rhs.a())> {
+    decltype(lhs.a() * rhs.a()) tn  = QUATERNION_NO_CONTRACT(lhs.a() * rhs.a()) + QUATERNION_NO_CONTRACT(lhs.b() * rhs.b()) + QUATERNION_NO_CONTRACT(lhs.c() * rhs.c()) + QUATERNION_NO_CONTRACT(lhs.d() * rhs.d());
+    decltype(lhs.a() * rhs.a()) tni = - QUATERNION_NO_CONTRACT(lhs.a() * rhs.b()) + QUATERNION_NO_CONTRACT(lhs.b() * rhs.a()) - QUATERNION_NO_CONTRACT(lhs.c() * rhs.d()) + QUATERNION_NO_CONTRACT(lhs.d() * rhs.c());
+    decltype(lhs.a() * rhs.a()) tnj = - QUATERNION_NO_CONTRACT(lhs.a() * rhs.c()) + QUATERNION_NO_CONTRACT(lhs.c() * rhs.a()) - QUATERNION_NO_CONTRACT(lhs.d() * rhs.b()) + QUATERNION_NO_CONTRACT(lhs.b() * rhs.d());
+    decltype(lhs.a() * rhs.a()) tnk = - QUATERNION_NO_CONTRACT(lhs.a() * rhs.d()) + QUATERNION_NO_CONTRACT(lhs.d() * rhs.a()) - QUATERNION_NO_CONTRACT(lhs.b() * rhs.c()) + QUATERNION_NO_CONTRACT(lhs.c() * rhs.b());
     decltype(rhs.a()) norm = std::norm(rhs);
-    return {tn / norm, tni / norm, tnj / norm, tnk / norm};
+    Quaternion<decltype((lhs.a() * rhs.a()) / rhs.a())> result(tn / norm, tni / norm, tnj / norm, tnk / norm);
+    QUATERNION_RECORD_DIVISOR(norm);
+    QUATERNION_RECORD(Divide, result);
+    return result;
 }
 
 /**
  * Div operator between quaternion and scalar.
  */
 template<typename _tA, typename _tB>
-auto operator/(const Quaternion<_tA>& lhs, const _tB& rhs) -> Quaternion<decltype(lhs.a() / rhs)> {
+constexpr auto operator/(const Quaternion<_tA>& lhs, const _tB& rhs) noexcept -> Quaternion<decltype(lhs.a() / rhs)> {
     return {lhs.a() / rhs, lhs.b() / rhs, lhs.c() / rhs, lhs.d() / rhs};
 }
 
@@ -343,16 +439,19 @@ auto operator/(const Quaternion<_tA>& lhs, const _tB& rhs) -> Quaternion<decltyp
  * Div operator between scalar and quaternion.
  */
 template<typename _tA, typename _tB>
-auto operator/(const _tB& lhs, const Quaternion<_tA>& rhs) -> Quaternion<decltype((rhs.a() * lhs) / rhs.a())> {
+constexpr auto operator/(const _tB& lhs, const Quaternion<_tA>& rhs) noexcept -> Quaternion<decltype((rhs.a() * lhs) / rhs.a())> {
     decltype(rhs.a()) norm = std::norm(rhs);
-    return {(rhs.a() * lhs) / norm, -(rhs.b() * lhs) / norm, -(rhs.c() * lhs) / norm, -(rhs.d() * lhs) / norm};
+    Quaternion<decltype((rhs.a() * lhs) / rhs.a())> result((rhs.a() * lhs) / norm, -(rhs.b() * lhs) / norm, -(rhs.c() * lhs) / norm, -(rhs.d() * lhs) / norm);
+    QUATERNION_RECORD_DIVISOR(norm);
+    QUATERNION_RECORD(Divide, result);
+    return result;
 }
 
 /**
  * Trivial comparison operator between quaternions.
  */
 template<typename _tA, typename _tB>
-bool operator==(const _tA& lhs, const _tB& rhs) {
+constexpr bool operator==(const _tA& lhs, const _tB& rhs) noexcept {
     return lhs.a() == rhs.a() && lhs.b() == rhs.b() && lhs.c() == rhs.c() && lhs.d() == rhs.d();
 }
 
@@ -365,20 +464,99 @@ std::ostream& operator<< (std::ostream& os, const Quaternion<T>& obj) {
     return os;
 }
 
+/**
+ * Extraction operator for quaternion, reads the (a,b,c,d) form written by operator<<.
+ */
+template<typename T>
+std::istream& operator>> (std::istream& is, Quaternion<T>& obj) {
+    T a, b, c, d;
+    char open, sep_b, sep_c, sep_d, close;
+    if (is >> open >> a >> sep_b >> b >> sep_c >> c >> sep_d >> d >> close) {
+        if (open == '(' && sep_b == ',' && sep_c == ',' && sep_d == ',' && close == ')') {
+            obj = Quaternion<T>(a, b, c, d);
+        } else {
+            is.setstate(std::ios_base::failbit);
+        }
+    }
+    return is;
+}
+
 /**
  * Normalization function
  */
 template<typename T>
-auto normalized(const Quaternion<T>& quat) -> Quaternion<decltype(quat.a() / std::abs(quat))> {
-    return quat / std::abs(quat);
+auto normalized(const Quaternion<T>& quat) noexcept -> Quaternion<decltype(quat.a() / std::abs(quat))> {
+    auto modulus = std::abs(quat);
+    Quaternion<decltype(quat.a() / modulus)> result = quat / modulus;
+    QUATERNION_RECORD_DIVISOR(modulus);
+    QUATERNION_RECORD(Normalize, result);
+    return result;
 }
 
 /**
  * Inverse function
  */
 template<typename T>
-auto inverse(const Quaternion<T>& quat) {
-    return std::conj(quat) / std::norm(quat);
+constexpr auto inverse(const Quaternion<T>& quat) noexcept {
+    auto norm = std::norm(quat);
+    auto result = std::conj(quat) / norm;
+    QUATERNION_RECORD_DIVISOR(norm);
+    QUATERNION_RECORD(Inverse, result);
+    return result;
+}
+
+/**
+ * Dot product of two quaternions as 4-vectors
+ */
+template<typename _tA, typename _tB>
+constexpr auto dot(const Quaternion<_tA>& lhs, const Quaternion<_tB>& rhs) noexcept -> decltype(lhs.a() * rhs.a()) {
+    return (lhs.a() * rhs.a()) + (lhs.b() * rhs.b()) + (lhs.c() * rhs.c()) + (lhs.d() * rhs.d());
+}
+
+/**
+ * Rotation of a 3D vector by a unit quaternion.
+ * Uses v' = v + w t + u x t with t = 2 u x v, cheaper than q * v * inverse(q).
+ */
+template<typename _tA, typename _tB>
+constexpr auto rotate(const Quaternion<_tA>& quat, const std::array<_tB, 3>& vec) noexcept -> std::array<decltype(quat.a() * vec[0]), 3> {
+    using _tR = decltype(quat.a() * vec[0]);
+    _tR tx = 2 * (QUATERNION_NO_CONTRACT(quat.c() * vec[2]) - QUATERNION_NO_CONTRACT(quat.d() * vec[1]));
+    _tR ty = 2 * (QUATERNION_NO_CONTRACT(quat.d() * vec[0]) - QUATERNION_NO_CONTRACT(quat.b() * vec[2]));
+    _tR tz = 2 * (QUATERNION_NO_CONTRACT(quat.b() * vec[1]) - QUATERNION_NO_CONTRACT(quat.c() * vec[0]));
+    return {vec[0] + QUATERNION_NO_CONTRACT(quat.a() * tx) + (QUATERNION_NO_CONTRACT(quat.c() * tz) - QUATERNION_NO_CONTRACT(quat.d() * ty)),
+            vec[1] + QUATERNION_NO_CONTRACT(quat.a() * ty) + (QUATERNION_NO_CONTRACT(quat.d() * tx) - QUATERNION_NO_CONTRACT(quat.b() * tz)),
+            vec[2] + QUATERNION_NO_CONTRACT(quat.a() * tz) + (QUATERNION_NO_CONTRACT(quat.b() * ty) - QUATERNION_NO_CONTRACT(quat.c() * tx))};
 }
 
+#include "QuaternionSimd.h"
+
+/**
+ * Explicit instantiations of the class and of the out of line functions for
+ * one element type. Quaternion.cpp expands it with an empty EXTERN, the
+ * compiled quaternion library target then defines QUATERNION_EXTERN_TEMPLATES
+ * so that its users skip instantiating and emitting these again.
+ */
+#define QUATERNION_INSTANTIATE(EXTERN, T) \
+    EXTERN template class Quaternion<T>; \
+    EXTERN template bool std::isnan<T>(const Quaternion<T>&) noexcept; \
+    EXTERN template bool std::isinf<T>(const Quaternion<T>&) noexcept; \
+    EXTERN template bool std::isfinite<T>(const Quaternion<T>&) noexcept; \
+    EXTERN template Quaternion<T> std::exp<T>(const Quaternion<T>&); \
+    EXTERN template Quaternion<T> std::log<T>(const Quaternion<T>&); \
+    EXTERN template Quaternion<T> operator+<T, T>(const Quaternion<T>&, const Quaternion<T>&) noexcept; \
+    EXTERN template Quaternion<T> operator-<T, T>(const Quaternion<T>&, const Quaternion<T>&) noexcept; \
+    EXTERN template Quaternion<T> operator*<T, T>(const Quaternion<T>&, const Quaternion<T>&) noexcept; \
+    EXTERN template Quaternion<T> operator/<T, T>(const Quaternion<T>&, const Quaternion<T>&) noexcept; \
+    EXTERN template Quaternion<T> operator*<T, T>(const Quaternion<T>&, const T&) noexcept; \
+    EXTERN template Quaternion<T> operator/<T, T>(const Quaternion<T>&, const T&) noexcept; \
+    EXTERN template std::ostream& operator<< <T>(std::ostream&, const Quaternion<T>&); \
+    EXTERN template std::istream& operator>> <T>(std::istream&, Quaternion<T>&); \
+    EXTERN template Quaternion<T> normalized<T>(const Quaternion<T>&) noexcept;
+
+#if defined(QUATERNION_EXTERN_TEMPLATES) && !QUATERNION_INSTRUMENTATION
+QUATERNION_INSTANTIATE(extern, float)
+QUATERNION_INSTANTIATE(extern, double)
+QUATERNION_INSTANTIATE(extern, long double)
+#endif
+
 #endif // QUATER_H
@@ -0,0 +1,574 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_ARRAY_H
+#define QUATER_ARRAY_H
+
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionSimd.h"
+
+/**
+ * Structure-of-arrays container of quaternions.
+ *
+ * The four components are stored in separate contiguous buffers so that
+ * batched arithmetic runs over plain arrays and can be auto-vectorized.
+ */
+template<typename T = double>
+class QuaternionArray {
+
+private:
+
+    std::vector<T> n, ni, nj, nk;
+
+public:
+
+    using value_type = Quaternion<T>; ///< value_type trait for STL compatibility
+    using size_type = std::size_t;
+
+    /**
+     * Default constructor, empty array
+     */
+    QuaternionArray() = default;
+
+    /**
+     * Construct an array of given size filled with value
+     */
+    explicit QuaternionArray(size_type size, const Quaternion<T>& value = Quaternion<T>())
+        : n(size, value.a()), ni(size, value.b()), nj(size, value.c()), nk(size, value.d()) {}
+
+    /**
+     * Construct from an array-of-structs vector
+     */
+    template<typename U>
+    explicit QuaternionArray(const std::vector<Quaternion<U>>& quats)
+        : QuaternionArray(quats.size()) {
+        for (size_type i = 0; i < quats.size(); ++i) {
+            this->set(i, quats[i]);
+        }
+    }
+
+    /**
+     * Copy constructor
+     */
+    template<typename U>
+    QuaternionArray(const QuaternionArray<U>& rhs)
+        : n(rhs.a_data(), rhs.a_data() + rhs.size()), ni(rhs.b_data(), rhs.b_data() + rhs.size()),
+          nj(rhs.c_data(), rhs.c_data() + rhs.size()), nk(rhs.d_data(), rhs.d_data() + rhs.size()) {}
+
+    size_type size() const {
+        return this->n.size();
+    }
+
+    bool empty() const {
+        return this->n.empty();
+    }
+
+    void reserve(size_type capacity) {
+        this->n.reserve(capacity);
+        this->ni.reserve(capacity);
+        this->nj.reserve(capacity);
+        this->nk.reserve(capacity);
+    }
+
+    void resize(size_type size, const Quaternion<T>& value = Quaternion<T>()) {
+        this->n.resize(size, value.a());
+        this->ni.resize(size, value.b());
+        this->nj.resize(size, value.c());
+        this->nk.resize(size, value.d());
+    }
+
+    void clear() {
+        this->n.clear();
+        this->ni.clear();
+        this->nj.clear();
+        this->nk.clear();
+    }
+
+    void push_back(const Quaternion<T>& quat) {
+        this->n.push_back(quat.a());
+        this->ni.push_back(quat.b());
+        this->nj.push_back(quat.c());
+        this->nk.push_back(quat.d());
+    }
+
+    /**
+     * Gather the i-th quaternion
+     */
+    Quaternion<T> operator[](size_type i) const {
+        return {this->n[i], this->ni[i], this->nj[i], this->nk[i]};
+    }
+
+    /**
+     * Scatter a quaternion into the i-th position
+     */
+    void set(size_type i, const Quaternion<T>& quat) {
+        this->n[i] = quat.a();
+        this->ni[i] = quat.b();
+        this->nj[i] = quat.c();
+        this->nk[i] = quat.d();
+    }
+
+    T* a_data() {
+        return this->n.data();
+    }
+
+    T* b_data() {
+        return this->ni.data();
+    }
+
+    T* c_data() {
+        return this->nj.data();
+    }
+
+    T* d_data() {
+        return this->nk.data();
+    }
+
+    const T* a_data() const {
+        return this->n.data();
+    }
+
+    const T* b_data() const {
+        return this->ni.data();
+    }
+
+    const T* c_data() const {
+        return this->nj.data();
+    }
+
+    const T* d_data() const {
+        return this->nk.data();
+    }
+
+    /**
+     * Convert back to an array-of-structs vector
+     */
+    std::vector<Quaternion<T>> to_vector() const {
+        std::vector<Quaternion<T>> quats;
+        quats.reserve(this->size());
+        for (size_type i = 0; i < this->size(); ++i) {
+            quats.push_back((*this)[i]);
+        }
+        return quats;
+    }
+
+};
+
+namespace quaternion_array_detail {
+
+    template<typename _tA, typename _tB>
+    void check_size(const QuaternionArray<_tA>& lhs, const QuaternionArray<_tB>& rhs) {
+        if (lhs.size() != rhs.size()) {
+            throw std::length_error("QuaternionArray: size mismatch");
+        }
+    }
+
+    template<typename _tA, typename _tB>
+    using sum_t = decltype(std::declval<_tA>() + std::declval<_tB>());
+
+    template<typename _tA, typename _tB>
+    using diff_t = decltype(std::declval<_tA>() - std::declval<_tB>());
+
+    template<typename _tA, typename _tB>
+    using prod_t = decltype(std::declval<_tA>() * std::declval<_tB>());
+
+    template<typename _tA, typename _tB>
+    using quot_t = decltype((std::declval<_tA>() * std::declval<_tB>()) / std::declval<_tB>());
+
+    /**
+     * Hamilton product over SoA buffers, same formula as operator*.
+     */
+    template<typename _tA, typename _tB, typename _tR>
+    void multiply(const _tA* la, const _tA* lb, const _tA* lc, const _tA* ld,
+                  const _tB* ra, const _tB* rb, const _tB* rc, const _tB* rd,
+                  _tR* oa, _tR* ob, _tR* oc, _tR* od, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            _tR tn = QUATERNION_NO_CONTRACT(la[i] * ra[i]) - QUATERNION_NO_CONTRACT(lb[i] * rb[i]) - QUATERNION_NO_CONTRACT(lc[i] * rc[i]) - QUATERNION_NO_CONTRACT(ld[i] * rd[i]);
+            _tR tni = QUATERNION_NO_CONTRACT(la[i] * rb[i]) + QUATERNION_NO_CONTRACT(lb[i] * ra[i]) + QUATERNION_NO_CONTRACT(lc[i] * rd[i]) - QUATERNION_NO_CONTRACT(ld[i] * rc[i]);
+            _tR tnj = QUATERNION_NO_CONTRACT(la[i] * rc[i]) + QUATERNION_NO_CONTRACT(lc[i] * ra[i]) + QUATERNION_NO_CONTRACT(ld[i] * rb[i]) - QUATERNION_NO_CONTRACT(lb[i] * rd[i]);
+            _tR tnk = QUATERNION_NO_CONTRACT(la[i] * rd[i]) + QUATERNION_NO_CONTRACT(ld[i] * ra[i]) + QUATERNION_NO_CONTRACT(lb[i] * rc[i]) - QUATERNION_NO_CONTRACT(lc[i] * rb[i]);
+            oa[i] = tn;
+            ob[i] = tni;
+            oc[i] = tnj;
+            od[i] = tnk;
+        }
+    }
+
+    /**
+     * Quaternion division over SoA buffers, same formula as operator/.
+     */
+    template<typename _tA, typename _tB, typename _tR>
+    void divide(const _tA* la, const _tA* lb, const _tA* lc, const _tA* ld,
+                const _tB* ra, const _tB* rb, const _tB* rc, const _tB* rd,
+                _tR* oa, _tR* ob, _tR* oc, _tR* od, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            _tR tn  = QUATERNION_NO_CONTRACT(la[i] * ra[i]) + QUATERNION_NO_CONTRACT(lb[i] * rb[i]) + QUATERNION_NO_CONTRACT(lc[i] * rc[i]) + QUATERNION_NO_CONTRACT(ld[i] * rd[i]);
+            _tR tni = - QUATERNION_NO_CONTRACT(la[i] * rb[i]) + QUATERNION_NO_CONTRACT(lb[i] * ra[i]) - QUATERNION_NO_CONTRACT(lc[i] * rd[i]) + QUATERNION_NO_CONTRACT(ld[i] * rc[i]);
+            _tR tnj = - QUATERNION_NO_CONTRACT(la[i] * rc[i]) + QUATERNION_NO_CONTRACT(lc[i] * ra[i]) - QUATERNION_NO_CONTRACT(ld[i] * rb[i]) + QUATERNION_NO_CONTRACT(lb[i] * rd[i]);
+            _tR tnk = - QUATERNION_NO_CONTRACT(la[i] * rd[i]) + QUATERNION_NO_CONTRACT(ld[i] * ra[i]) - QUATERNION_NO_CONTRACT(lb[i] * rc[i]) + QUATERNION_NO_CONTRACT(lc[i] * rb[i]);
+            _tB norm = QUATERNION_NO_CONTRACT(ra[i] * ra[i]) + QUATERNION_NO_CONTRACT(rb[i] * rb[i]) + QUATERNION_NO_CONTRACT(rc[i] * rc[i]) + QUATERNION_NO_CONTRACT(rd[i] * rd[i]);
+            oa[i] = tn / norm;
+            ob[i] = tni / norm;
+            oc[i] = tnj / norm;
+            od[i] = tnk / norm;
+        }
+    }
+
+    /**
+     * Hamilton product (la, lb, lc, ld) * (ra, rb, rc, rd) on packs, same formula as operator*.
+     */
+    template<typename P>
+    inline void hamilton(typename P::type la, typename P::type lb, typename P::type lc, typename P::type ld,
+                         typename P::type ra, typename P::type rb, typename P::type rc, typename P::type rd,
+                         typename P::value_type* oa, typename P::value_type* ob, typename P::value_type* oc, typename P::value_type* od) {
+        P::store(oa, P::sub(P::sub(P::sub(P::mul(la, ra), P::mul(lb, rb)), P::mul(lc, rc)), P::mul(ld, rd)));
+        P::store(ob, P::sub(P::add(P::add(P::mul(la, rb), P::mul(lb, ra)), P::mul(lc, rd)), P::mul(ld, rc)));
+        P::store(oc, P::sub(P::add(P::add(P::mul(la, rc), P::mul(lc, ra)), P::mul(ld, rb)), P::mul(lb, rd)));
+        P::store(od, P::sub(P::add(P::add(P::mul(la, rd), P::mul(ld, ra)), P::mul(lb, rc)), P::mul(lc, rb)));
+    }
+
+    /**
+     * Hamilton product of every element with one quaternion, quat * element
+     * when Left, element * quat otherwise.
+     */
+    template<bool Left, typename _tA, typename _tB, typename _tR>
+    void broadcast_multiply(const _tA* a, const _tA* b, const _tA* c, const _tA* d, const Quaternion<_tB>& quat,
+                            _tR* oa, _tR* ob, _tR* oc, _tR* od, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            _tR la = Left ? quat.a() : a[i], lb = Left ? quat.b() : b[i], lc = Left ? quat.c() : c[i], ld = Left ? quat.d() : d[i];
+            _tR ra = Left ? a[i] : quat.a(), rb = Left ? b[i] : quat.b(), rc = Left ? c[i] : quat.c(), rd = Left ? d[i] : quat.d();
+            oa[i] = QUATERNION_NO_CONTRACT(la * ra) - QUATERNION_NO_CONTRACT(lb * rb) - QUATERNION_NO_CONTRACT(lc * rc) - QUATERNION_NO_CONTRACT(ld * rd);
+            ob[i] = QUATERNION_NO_CONTRACT(la * rb) + QUATERNION_NO_CONTRACT(lb * ra) + QUATERNION_NO_CONTRACT(lc * rd) - QUATERNION_NO_CONTRACT(ld * rc);
+            oc[i] = QUATERNION_NO_CONTRACT(la * rc) + QUATERNION_NO_CONTRACT(lc * ra) + QUATERNION_NO_CONTRACT(ld * rb) - QUATERNION_NO_CONTRACT(lb * rd);
+            od[i] = QUATERNION_NO_CONTRACT(la * rd) + QUATERNION_NO_CONTRACT(ld * ra) + QUATERNION_NO_CONTRACT(lb * rc) - QUATERNION_NO_CONTRACT(lc * rb);
+        }
+    }
+
+    /**
+     * Same-type broadcast product, the quaternion splatted into a pack once.
+     */
+    template<bool Left, typename T>
+    void broadcast_multiply(const T* a, const T* b, const T* c, const T* d, const Quaternion<T>& quat,
+                            T* oa, T* ob, T* oc, T* od, std::size_t size) {
+        using P = quaternion_simd::pack<T>;
+        using S = quaternion_simd::scalar_pack<T>;
+        const auto qa = P::set1(quat.a()), qb = P::set1(quat.b()), qc = P::set1(quat.c()), qd = P::set1(quat.d());
+        std::size_t i = 0;
+        for (; i + P::width <= size; i += P::width) {
+            auto xa = P::load(a + i), xb = P::load(b + i), xc = P::load(c + i), xd = P::load(d + i);
+            if (Left) {
+                hamilton<P>(qa, qb, qc, qd, xa, xb, xc, xd, oa + i, ob + i, oc + i, od + i);
+            } else {
+                hamilton<P>(xa, xb, xc, xd, qa, qb, qc, qd, oa + i, ob + i, oc + i, od + i);
+            }
+        }
+        for (; i < size; ++i) {
+            if (Left) {
+                hamilton<S>(quat.a(), quat.b(), quat.c(), quat.d(), a[i], b[i], c[i], d[i], oa + i, ob + i, oc + i, od + i);
+            } else {
+                hamilton<S>(a[i], b[i], c[i], d[i], quat.a(), quat.b(), quat.c(), quat.d(), oa + i, ob + i, oc + i, od + i);
+            }
+        }
+    }
+
+    /**
+     * Same-type Hamilton product, dispatched to the SIMD kernel.
+     */
+    template<typename T>
+    void multiply(const T* la, const T* lb, const T* lc, const T* ld,
+                  const T* ra, const T* rb, const T* rc, const T* rd,
+                  T* oa, T* ob, T* oc, T* od, std::size_t size) {
+        quaternion_simd::multiply(la, lb, lc, ld, ra, rb, rc, rd, oa, ob, oc, od, size);
+    }
+
+    /**
+     * Same-type quaternion division, dispatched to the SIMD kernel.
+     */
+    template<typename T>
+    void divide(const T* la, const T* lb, const T* lc, const T* ld,
+                const T* ra, const T* rb, const T* rc, const T* rd,
+                T* oa, T* ob, T* oc, T* od, std::size_t size) {
+        quaternion_simd::divide(la, lb, lc, ld, ra, rb, rc, rd, oa, ob, oc, od, size);
+    }
+
+}
+
+namespace std {
+
+    /**
+     * Norm of every quaternion in the array
+     */
+    template<typename T>
+    std::vector<T> norm(const QuaternionArray<T>& quats) {
+        std::vector<T> result(quats.size());
+        const T* a = quats.a_data();
+        const T* b = quats.b_data();
+        const T* c = quats.c_data();
+        const T* d = quats.d_data();
+        for (std::size_t i = 0; i < quats.size(); ++i) {
+            result[i] = (a[i] * a[i]) + (b[i] * b[i]) + (c[i] * c[i]) + (d[i] * d[i]);
+        }
+        return result;
+    }
+
+    /**
+     * Conjugate of every quaternion in the array
+     */
+    template<typename T>
+    QuaternionArray<T> conj(const QuaternionArray<T>& quats) {
+        QuaternionArray<T> result(quats);
+        T* b = result.b_data();
+        T* c = result.c_data();
+        T* d = result.d_data();
+        for (std::size_t i = 0; i < result.size(); ++i) {
+            b[i] = -b[i];
+            c[i] = -c[i];
+            d[i] = -d[i];
+        }
+        return result;
+    }
+
+}
+
+/**
+ * Element-wise add operator between two quaternion arrays.
+ */
+template<typename _tA, typename _tB>
+auto operator+(const QuaternionArray<_tA>& lhs, const QuaternionArray<_tB>& rhs) -> QuaternionArray<quaternion_array_detail::sum_t<_tA, _tB>> {
+    quaternion_array_detail::check_size(lhs, rhs);
+    QuaternionArray<quaternion_array_detail::sum_t<_tA, _tB>> result(lhs.size());
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+        result.a_data()[i] = lhs.a_data()[i] + rhs.a_data()[i];
+        result.b_data()[i] = lhs.b_data()[i] + rhs.b_data()[i];
+        result.c_data()[i] = lhs.c_data()[i] + rhs.c_data()[i];
+        result.d_data()[i] = lhs.d_data()[i] + rhs.d_data()[i];
+    }
+    return result;
+}
+
+/**
+ * Element-wise sub operator between two quaternion arrays.
+ */
+template<typename _tA, typename _tB>
+auto operator-(const QuaternionArray<_tA>& lhs, const QuaternionArray<_tB>& rhs) -> QuaternionArray<quaternion_array_detail::diff_t<_tA, _tB>> {
+    quaternion_array_detail::check_size(lhs, rhs);
+    QuaternionArray<quaternion_array_detail::diff_t<_tA, _tB>> result(lhs.size());
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+        result.a_data()[i] = lhs.a_data()[i] - rhs.a_data()[i];
+        result.b_data()[i] = lhs.b_data()[i] - rhs.b_data()[i];
+        result.c_data()[i] = lhs.c_data()[i] - rhs.c_data()[i];
+        result.d_data()[i] = lhs.d_data()[i] - rhs.d_data()[i];
+    }
+    return result;
+}
+
+/**
+ * Element-wise mul operator between two quaternion arrays.
+ */
+template<typename _tA, typename _tB>
+auto operator*(const QuaternionArray<_tA>& lhs, const QuaternionArray<_tB>& rhs) -> QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> {
+    quaternion_array_detail::check_size(lhs, rhs);
+    QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> result(lhs.size());
+    QUATERNION_TIMED_KERNEL("array mul", lhs.size());
+    QUATERNION_COUNT_BATCH(Multiply, lhs.size());
+    quaternion_array_detail::multiply(lhs.a_data(), lhs.b_data(), lhs.c_data(), lhs.d_data(),
+                                      rhs.a_data(), rhs.b_data(), rhs.c_data(), rhs.d_data(),
+                                      result.a_data(), result.b_data(), result.c_data(), result.d_data(), lhs.size());
+    return result;
+}
+
+/**
+ * Mul operator between quaternion array and a single quaternion.
+ */
+template<typename _tA, typename _tB>
+auto operator*(const QuaternionArray<_tA>& lhs, const Quaternion<_tB>& rhs) -> QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> {
+    QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> result(lhs.size());
+    QUATERNION_TIMED_KERNEL("array mul broadcast", lhs.size());
+    QUATERNION_COUNT_BATCH(Multiply, lhs.size());
+    quaternion_array_detail::broadcast_multiply<false>(lhs.a_data(), lhs.b_data(), lhs.c_data(), lhs.d_data(), rhs,
+                                                       result.a_data(), result.b_data(), result.c_data(), result.d_data(), lhs.size());
+    return result;
+}
+
+/**
+ * Mul operator between a single quaternion and quaternion array.
+ */
+template<typename _tA, typename _tB>
+auto operator*(const Quaternion<_tA>& lhs, const QuaternionArray<_tB>& rhs) -> QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> {
+    QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> result(rhs.size());
+    QUATERNION_TIMED_KERNEL("array mul broadcast", rhs.size());
+    QUATERNION_COUNT_BATCH(Multiply, rhs.size());
+    quaternion_array_detail::broadcast_multiply<true>(rhs.a_data(), rhs.b_data(), rhs.c_data(), rhs.d_data(), lhs,
+                                                      result.a_data(), result.b_data(), result.c_data(), result.d_data(), rhs.size());
+    return result;
+}
+
+/**
+ * Mul operator between quaternion array and scalar.
+ */
+template<typename _tA, typename _tB, typename = std::enable_if_t<std::is_arithmetic<_tB>::value>>
+auto operator*(const QuaternionArray<_tA>& lhs, const _tB& rhs) -> QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> {
+    QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> result(lhs.size());
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+        result.a_data()[i] = lhs.a_data()[i] * rhs;
+        result.b_data()[i] = lhs.b_data()[i] * rhs;
+        result.c_data()[i] = lhs.c_data()[i] * rhs;
+        result.d_data()[i] = lhs.d_data()[i] * rhs;
+    }
+    return result;
+}
+
+/**
+ * Mul operator between scalar and quaternion array.
+ */
+template<typename _tA, typename _tB, typename = std::enable_if_t<std::is_arithmetic<_tA>::value>>
+auto operator*(const _tA& lhs, const QuaternionArray<_tB>& rhs) -> QuaternionArray<quaternion_array_detail::prod_t<_tA, _tB>> {
+    return rhs * lhs;
+}
+
+/**
+ * Element-wise div operator between two quaternion arrays.
+ */
+template<typename _tA, typename _tB>
+auto operator/(const QuaternionArray<_tA>& lhs, const QuaternionArray<_tB>& rhs) -> QuaternionArray<quaternion_array_detail::quot_t<_tA, _tB>> {
+    quaternion_array_detail::check_size(lhs, rhs);
+    QuaternionArray<quaternion_array_detail::quot_t<_tA, _tB>> result(lhs.size());
+    QUATERNION_TIMED_KERNEL("array div", lhs.size());
+    QUATERNION_COUNT_BATCH(Divide, lhs.size());
+    quaternion_array_detail::divide(lhs.a_data(), lhs.b_data(), lhs.c_data(), lhs.d_data(),
+                                    rhs.a_data(), rhs.b_data(), rhs.c_data(), rhs.d_data(),
+                                    result.a_data(), result.b_data(), result.c_data(), result.d_data(), lhs.size());
+    return result;
+}
+
+/**
+ * Div operator between quaternion array and scalar.
+ */
+template<typename _tA, typename _tB, typename = std::enable_if_t<std::is_arithmetic<_tB>::value>>
+auto operator/(const QuaternionArray<_tA>& lhs, const _tB& rhs) -> QuaternionArray<decltype(std::declval<_tA>() / rhs)> {
+    QuaternionArray<decltype(std::declval<_tA>() / rhs)> result(lhs.size());
+    for (std::size_t i = 0; i < lhs.size(); ++i) {
+        result.a_data()[i] = lhs.a_data()[i] / rhs;
+        result.b_data()[i] = lhs.b_data()[i] / rhs;
+        result.c_data()[i] = lhs.c_data()[i] / rhs;
+        result.d_data()[i] = lhs.d_data()[i] / rhs;
+    }
+    return result;
+}
+
+/**
+ * Normalization of every quaternion in the array
+ */
+template<typename T>
+QuaternionArray<T> normalized(const QuaternionArray<T>& quats) {
+    QuaternionArray<T> result(quats.size());
+    QUATERNION_TIMED_KERNEL("array normalized", quats.size());
+    QUATERNION_COUNT_BATCH(Normalize, quats.size());
+    const T* a = quats.a_data();
+    const T* b = quats.b_data();
+    const T* c = quats.c_data();
+    const T* d = quats.d_data();
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        T abs = std::sqrt((a[i] * a[i]) + (b[i] * b[i]) + (c[i] * c[i]) + (d[i] * d[i]));
+        result.a_data()[i] = a[i] / abs;
+        result.b_data()[i] = b[i] / abs;
+        result.c_data()[i] = c[i] / abs;
+        result.d_data()[i] = d[i] / abs;
+    }
+    return result;
+}
+
+/**
+ * Inverse of every quaternion in the array
+ */
+template<typename T>
+QuaternionArray<T> inverse(const QuaternionArray<T>& quats) {
+    QuaternionArray<T> result(quats.size());
+    QUATERNION_TIMED_KERNEL("array inverse", quats.size());
+    QUATERNION_COUNT_BATCH(Inverse, quats.size());
+    const T* a = quats.a_data();
+    const T* b = quats.b_data();
+    const T* c = quats.c_data();
+    const T* d = quats.d_data();
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        T norm = QUATERNION_NO_CONTRACT(a[i] * a[i]) + QUATERNION_NO_CONTRACT(b[i] * b[i]) + QUATERNION_NO_CONTRACT(c[i] * c[i]) + QUATERNION_NO_CONTRACT(d[i] * d[i]);
+        result.a_data()[i] = a[i] / norm;
+        result.b_data()[i] = -b[i] / norm;
+        result.c_data()[i] = -c[i] / norm;
+        result.d_data()[i] = -d[i] / norm;
+    }
+    return result;
+}
+
+namespace quaternion_array_detail {
+
+    template<typename P, typename T>
+    inline void renormalize_step(T* a, T* b, T* c, T* d, typename P::type tolerance, std::size_t i) {
+        auto qa = P::load(a + i), qb = P::load(b + i), qc = P::load(c + i), qd = P::load(d + i);
+        auto norm = P::add(P::add(P::add(P::mul(qa, qa), P::mul(qb, qb)), P::mul(qc, qc)), P::mul(qd, qd));
+        auto drifted = P::less(tolerance, P::abs(P::sub(norm, P::set1(static_cast<T>(1)))));
+        if (!P::any(drifted)) {
+            return;
+        }
+        auto r = quaternion_simd::rsqrt_newton<P>(norm);
+        P::store(a + i, P::select(drifted, P::mul(qa, r), qa));
+        P::store(b + i, P::select(drifted, P::mul(qb, r), qb));
+        P::store(c + i, P::select(drifted, P::mul(qc, r), qc));
+        P::store(d + i, P::select(drifted, P::mul(qd, r), qd));
+    }
+
+}
+
+/**
+ * Renormalize in place, with the fast_normalized kernel, every quaternion
+ * whose norm differs from 1 by more than tolerance. Packs whose elements
+ * are all within tolerance are not written back. The default leaves alone
+ * the quaternions a previous pass already brought within a few ulp.
+ */
+template<typename T>
+void renormalize_inplace(QuaternionArray<T>& quats, const T& tolerance = 4 * std::numeric_limits<T>::epsilon()) {
+    using P = quaternion_simd::pack<T>;
+    using S = quaternion_simd::scalar_pack<T>;
+    QUATERNION_TIMED_KERNEL("renormalize_inplace", quats.size());
+    std::size_t i = 0;
+    for (; i + P::width <= quats.size(); i += P::width) {
+        quaternion_array_detail::renormalize_step<P>(quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data(), P::set1(tolerance), i);
+    }
+    for (; i < quats.size(); ++i) {
+        quaternion_array_detail::renormalize_step<S>(quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data(), tolerance, i);
+    }
+}
+
+#endif // QUATER_ARRAY_H
@@ -0,0 +1,300 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_AVERAGE_H
+#define QUATER_AVERAGE_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionParallel.h"
+#include "QuaternionSimd.h"
+#include "QuaternionSpan.h"
+
+/**
+ * Averaging method.
+ *  - Markley: dominant eigenvector of sum w q q^T (Markley et al. 2007), the
+ *    rotation minimizing the weighted squared chordal distances. Exact for
+ *    any spread and insensitive to the sign of the inputs.
+ *  - SignAligned: normalized weighted sum after flipping every quaternion
+ *    onto the hemisphere of the first one. Cheaper, agrees with Markley to
+ *    second order in the spread, meant for tightly clustered data.
+ */
+enum class AverageMethod {
+    Markley,
+    SignAligned
+};
+
+namespace quaternion_average_detail {
+
+    constexpr std::size_t grain = 1 << 14;
+
+    /**
+     * Contiguous Quaternion<T>, lanes gathered component by component
+     */
+    template<typename T>
+    struct aos_source {
+        const Quaternion<T>* ptr;
+
+        Quaternion<T> operator[](std::size_t i) const {
+            return this->ptr[i];
+        }
+
+        template<typename P>
+        void load(std::size_t i, typename P::type (&q)[4]) const {
+            T lanes[4][P::width];
+            for (std::size_t l = 0; l < P::width; ++l) {
+                lanes[0][l] = this->ptr[i + l].a();
+                lanes[1][l] = this->ptr[i + l].b();
+                lanes[2][l] = this->ptr[i + l].c();
+                lanes[3][l] = this->ptr[i + l].d();
+            }
+            for (std::size_t k = 0; k < 4; ++k) {
+                q[k] = P::load(lanes[k]);
+            }
+        }
+    };
+
+    template<typename T>
+    struct soa_source {
+        const QuaternionArray<T>* array;
+
+        Quaternion<T> operator[](std::size_t i) const {
+            return (*this->array)[i];
+        }
+
+        template<typename P>
+        void load(std::size_t i, typename P::type (&q)[4]) const {
+            q[0] = P::load(this->array->a_data() + i);
+            q[1] = P::load(this->array->b_data() + i);
+            q[2] = P::load(this->array->c_data() + i);
+            q[3] = P::load(this->array->d_data() + i);
+        }
+    };
+
+    /**
+     * Upper triangle of sum w q q^T, row major: aa ab ac ad bb bc bd cc cd dd
+     */
+    struct outer_product {
+        static constexpr std::size_t terms = 10;
+
+        template<typename P>
+        void operator()(const typename P::type (&q)[4], typename P::type w, typename P::type (&acc)[terms]) const {
+            std::size_t k = 0;
+            for (std::size_t r = 0; r < 4; ++r) {
+                auto wq = P::mul(w, q[r]);
+                for (std::size_t c = r; c < 4; ++c, ++k) {
+                    acc[k] = P::add(acc[k], P::mul(wq, q[c]));
+                }
+            }
+        }
+    };
+
+    /**
+     * sum w q with q flipped onto the hemisphere of ref
+     */
+    template<typename T>
+    struct aligned_sum {
+        static constexpr std::size_t terms = 4;
+        Quaternion<T> ref;
+
+        template<typename P>
+        void operator()(const typename P::type (&q)[4], typename P::type w, typename P::type (&acc)[terms]) const {
+            auto dot = P::add(P::add(P::add(P::mul(q[0], P::set1(this->ref.a())), P::mul(q[1], P::set1(this->ref.b()))),
+                                     P::mul(q[2], P::set1(this->ref.c()))), P::mul(q[3], P::set1(this->ref.d())));
+            w = P::select(P::less(dot, P::set1(static_cast<T>(0))), P::neg(w), w);
+            for (std::size_t k = 0; k < 4; ++k) {
+                acc[k] = P::add(acc[k], P::mul(w, q[k]));
+            }
+        }
+    };
+
+    /**
+     * Parallel weighted reduction of term over the source. Lanes and blocks
+     * are summed in a fixed order, so the result only depends on the thread count.
+     */
+    template<typename T, typename Source, typename Term>
+    std::array<T, Term::terms> accumulate(std::size_t size, const Source& source, const T* weights, const Term& term) {
+        using P = quaternion_simd::pack<T>;
+        using S = quaternion_simd::scalar_pack<T>;
+        std::size_t blocks = quaternion_parallel::block_count(size, grain);
+        std::vector<std::array<T, Term::terms>> partial(blocks);
+        quaternion_parallel::run_blocks(blocks, [&](std::size_t b) {
+            auto range = quaternion_parallel::block_range(size, blocks, b);
+            typename P::type acc[Term::terms];
+            for (std::size_t k = 0; k < Term::terms; ++k) {
+                acc[k] = P::set1(static_cast<T>(0));
+            }
+            std::size_t i = range.first;
+            for (; i + P::width <= range.second; i += P::width) {
+                typename P::type q[4];
+                source.template load<P>(i, q);
+                term.template operator()<P>(q, weights ? P::load(weights + i) : P::set1(static_cast<T>(1)), acc);
+            }
+            T tail[Term::terms] = {};
+            for (; i < range.second; ++i) {
+                T q[4];
+                source.template load<S>(i, q);
+                term.template operator()<S>(q, weights ? weights[i] : static_cast<T>(1), tail);
+            }
+            for (std::size_t k = 0; k < Term::terms; ++k) {
+                T lanes[P::width];
+                P::store(lanes, acc[k]);
+                T sum = tail[k];
+                for (std::size_t l = 0; l < P::width; ++l) {
+                    sum += lanes[l];
+                }
+                partial[b][k] = sum;
+            }
+        });
+        std::array<T, Term::terms> total = {};
+        for (std::size_t b = 0; b < blocks; ++b) {
+            for (std::size_t k = 0; k < Term::terms; ++k) {
+                total[k] += partial[b][k];
+            }
+        }
+        return total;
+    }
+
+    /**
+     * Eigenvector of the largest eigenvalue of a symmetric 4x4 matrix, cyclic Jacobi rotations
+     */
+    template<typename T>
+    std::array<T, 4> dominant_eigenvector(std::array<std::array<T, 4>, 4> m) {
+        std::array<std::array<T, 4>, 4> v = {};
+        for (std::size_t k = 0; k < 4; ++k) {
+            v[k][k] = static_cast<T>(1);
+        }
+        const T eps = std::numeric_limits<T>::epsilon();
+        for (int sweep = 0; sweep < 32; ++sweep) {
+            T off = 0, diag = 0;
+            for (std::size_t p = 0; p < 4; ++p) {
+                diag += m[p][p] * m[p][p];
+                for (std::size_t q = p + 1; q < 4; ++q) {
+                    off += m[p][q] * m[p][q];
+                }
+            }
+            if (off <= eps * eps * diag) {
+                break;
+            }
+            for (std::size_t p = 0; p < 3; ++p) {
+                for (std::size_t q = p + 1; q < 4; ++q) {
+                    if (m[p][q] == 0) {
+                        continue;
+                    }
+                    T theta = (m[q][q] - m[p][p]) / (2 * m[p][q]);
+                    T t = (theta < 0 ? static_cast<T>(-1) : static_cast<T>(1)) / (std::abs(theta) + std::sqrt((theta * theta) + 1));
+                    T c = static_cast<T>(1) / std::sqrt((t * t) + 1);
+                    T s = t * c;
+                    for (std::size_t k = 0; k < 4; ++k) {
+                        T mkp = m[k][p], mkq = m[k][q];
+                        m[k][p] = (c * mkp) - (s * mkq);
+                        m[k][q] = (s * mkp) + (c * mkq);
+                    }
+                    for (std::size_t k = 0; k < 4; ++k) {
+                        T mpk = m[p][k], mqk = m[q][k];
+                        m[p][k] = (c * mpk) - (s * mqk);
+                        m[q][k] = (s * mpk) + (c * mqk);
+                    }
+                    for (std::size_t k = 0; k < 4; ++k) {
+                        T vkp = v[k][p], vkq = v[k][q];
+                        v[k][p] = (c * vkp) - (s * vkq);
+                        v[k][q] = (s * vkp) + (c * vkq);
+                    }
+                }
+            }
+        }
+        std::size_t best = 0;
+        for (std::size_t k = 1; k < 4; ++k) {
+            if (m[k][k] > m[best][best]) {
+                best = k;
+            }
+        }
+        return {v[0][best], v[1][best], v[2][best], v[3][best]};
+    }
+
+    template<typename T, typename Source>
+    Quaternion<T> average(std::size_t size, const Source& source, const T* weights, AverageMethod method) {
+        if (size == 0) {
+            throw std::invalid_argument("average: no quaternions");
+        }
+        QUATERNION_TIMED_KERNEL("average", size);
+        Quaternion<T> ref = source[0];
+        Quaternion<T> mean;
+        if (method == AverageMethod::SignAligned) {
+            std::array<T, 4> sum = accumulate(size, source, weights, aligned_sum<T>{ref});
+            mean = Quaternion<T>(sum[0], sum[1], sum[2], sum[3]);
+        } else {
+            std::array<T, 10> upper = accumulate(size, source, weights, outer_product());
+            std::array<std::array<T, 4>, 4> m;
+            std::size_t k = 0;
+            for (std::size_t r = 0; r < 4; ++r) {
+                for (std::size_t c = r; c < 4; ++c, ++k) {
+                    m[r][c] = upper[k];
+                    m[c][r] = upper[k];
+                }
+            }
+            std::array<T, 4> e = dominant_eigenvector(m);
+            mean = Quaternion<T>(e[0], e[1], e[2], e[3]);
+            if (dot(mean, ref) < 0) {
+                mean = mean * static_cast<T>(-1);
+            }
+        }
+        return normalized(mean);
+    }
+
+}
+
+/**
+ * Weighted mean orientation of unit quaternions, weights may be null for
+ * equal weights. The result lies on the hemisphere of the first quaternion.
+ * The accumulation is split across threads.
+ */
+template<typename T>
+Quaternion<T> average(QuaternionSpan<T> quats, const typename Quaternion<T>::value_type* weights = nullptr, AverageMethod method = AverageMethod::Markley) {
+    return quaternion_average_detail::average(quats.size(), quaternion_average_detail::aos_source<T>{quats.data()}, weights, method);
+}
+
+template<typename T>
+Quaternion<T> average(const std::vector<Quaternion<T>>& quats, const typename Quaternion<T>::value_type* weights = nullptr, AverageMethod method = AverageMethod::Markley) {
+    return average(QuaternionSpan<T>(quats), weights, method);
+}
+
+template<typename T>
+Quaternion<T> average(const QuaternionArray<T>& quats, const typename Quaternion<T>::value_type* weights = nullptr, AverageMethod method = AverageMethod::Markley) {
+    return quaternion_average_detail::average(quats.size(), quaternion_average_detail::soa_source<T>{&quats}, weights, method);
+}
+
+#endif // QUATER_AVERAGE_H
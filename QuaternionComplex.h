@@ -0,0 +1,471 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_COMPLEX_H
+#define QUATER_COMPLEX_H
+
+#include <complex>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+#include "Quaternion.h"
+
+namespace quaternion_complex_detail {
+
+    template<typename T, typename U>
+    using same_const_t = std::conditional_t<std::is_const<T>::value, const U, U>;
+
+    /**
+     * Contiguous containers (std::vector, std::array, ...) of E or const E
+     */
+    template<typename C, typename E, typename = void>
+    struct is_container_of : std::false_type {};
+
+    template<typename C, typename E>
+    struct is_container_of<C, E, std::void_t<decltype(std::declval<C&>().data()), decltype(std::declval<C&>().size())>>
+        : std::is_convertible<decltype(std::declval<C&>().data()), E*> {};
+
+}
+
+/**
+ * Non-owning view of std::complex values with a stride, the complex_a()
+ * or complex_b() parts of a quaternion range.
+ * Elements are read by value and written with set(), through T only.
+ * T is the scalar type, const qualified for a read-only view.
+ */
+template<typename T = double>
+class ComplexLaneSpan {
+
+public:
+
+    using value_type = std::complex<std::remove_const_t<T>>; ///< value_type trait for STL compatibility
+    using complex_type = quaternion_complex_detail::same_const_t<T, value_type>;
+    using size_type = std::size_t;
+
+private:
+
+    T* ptr;
+    std::size_t count;
+    std::size_t step;
+
+public:
+
+    constexpr ComplexLaneSpan() noexcept
+        : ptr(nullptr), count(0), step(1) {}
+
+    /**
+     * View of count complex values stored as (real, imag) pairs of T,
+     * stride complex values apart
+     */
+    constexpr ComplexLaneSpan(T* ptr, std::size_t count, std::size_t stride = 1) noexcept
+        : ptr(ptr), count(count), step(stride) {}
+
+    ComplexLaneSpan(complex_type* ptr, std::size_t count, std::size_t stride = 1) noexcept
+        : ptr(reinterpret_cast<T*>(ptr)), count(count), step(stride) {}
+
+    /**
+     * Real part of the first element, the imaginary part follows
+     */
+    constexpr T* data() const noexcept {
+        return this->ptr;
+    }
+
+    constexpr std::size_t size() const noexcept {
+        return this->count;
+    }
+
+    constexpr bool empty() const noexcept {
+        return this->count == 0;
+    }
+
+    /**
+     * Distance between two consecutive elements, in std::complex
+     */
+    constexpr std::size_t stride() const noexcept {
+        return this->step;
+    }
+
+    constexpr value_type operator[](std::size_t i) const noexcept {
+        return {this->ptr[2 * i * this->step], this->ptr[2 * i * this->step + 1]};
+    }
+
+    void set(std::size_t i, const value_type& value) const noexcept {
+        static_assert(!std::is_const<T>::value, "ComplexLaneSpan: set on a read-only view");
+        this->ptr[2 * i * this->step] = value.real();
+        this->ptr[2 * i * this->step + 1] = value.imag();
+    }
+
+};
+
+/**
+ * Non-owning view of an interleaved buffer of complex pairs as quaternions.
+ * The complex values (z1, z2) at 2k and 2k + 1 are the quaternion
+ * z1 + z2 j, so a std::complex<T> buffer of 2n elements and a
+ * Quaternion<T> array of n elements have the same layout and either can
+ * be viewed as the other without copying.
+ * The buffer is only accessed through T, which both std::complex<T> (as
+ * T[2]) and Quaternion<T> (as T[4]) allow: elements are read by value and
+ * written with set(), like QuaternionArray, and no Quaternion<T>& or
+ * std::complex<T>& into a buffer of the other type is ever handed out.
+ * T is the scalar type, const qualified for a read-only view.
+ */
+template<typename T = double>
+class ComplexPairSpan {
+
+    static_assert(std::is_trivially_copyable<Quaternion<std::remove_const_t<T>>>::value && sizeof(Quaternion<std::remove_const_t<T>>) == 4 * sizeof(T),
+                  "Quaternion<T> must be layout compatible with T[4]");
+
+public:
+
+    using value_type = Quaternion<std::remove_const_t<T>>; ///< value_type trait for STL compatibility
+    using element_type = quaternion_complex_detail::same_const_t<T, value_type>;
+    using complex_type = quaternion_complex_detail::same_const_t<T, std::complex<std::remove_const_t<T>>>;
+    using size_type = std::size_t;
+
+private:
+
+    T* ptr;
+    std::size_t count;
+
+public:
+
+    constexpr ComplexPairSpan() noexcept
+        : ptr(nullptr), count(0) {}
+
+    /**
+     * View of count quaternions stored as 4 * count values of T
+     */
+    constexpr ComplexPairSpan(T* ptr, std::size_t count) noexcept
+        : ptr(ptr), count(count) {}
+
+    ComplexPairSpan(element_type* ptr, std::size_t count) noexcept
+        : ptr(reinterpret_cast<T*>(ptr)), count(count) {}
+
+    /**
+     * View of complex_count complex values as complex_count / 2 quaternions
+     */
+    ComplexPairSpan(complex_type* ptr, std::size_t complex_count)
+        : ptr(reinterpret_cast<T*>(ptr)), count(complex_count / 2) {
+        if (complex_count % 2 != 0) {
+            throw std::invalid_argument("ComplexPairSpan: odd number of complex values");
+        }
+    }
+
+    /**
+     * View of a contiguous container of quaternions or of complex values
+     */
+    template<typename C, typename = std::enable_if_t<quaternion_complex_detail::is_container_of<C, element_type>::value ||
+                                                     quaternion_complex_detail::is_container_of<C, complex_type>::value>>
+    ComplexPairSpan(C& container)
+        : ComplexPairSpan(container.data(), container.size()) {}
+
+    /**
+     * Read-only view of a mutable one
+     */
+    template<typename U, typename = std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value>>
+    constexpr ComplexPairSpan(const ComplexPairSpan<U>& other) noexcept
+        : ptr(other.data()), count(other.size()) {}
+
+    /**
+     * First component of the first quaternion, the others follow
+     */
+    constexpr T* data() const noexcept {
+        return this->ptr;
+    }
+
+    constexpr std::size_t size() const noexcept {
+        return this->count;
+    }
+
+    constexpr bool empty() const noexcept {
+        return this->count == 0;
+    }
+
+    /**
+     * Gather the i-th quaternion
+     */
+    constexpr value_type operator[](std::size_t i) const noexcept {
+        return {this->ptr[4 * i], this->ptr[4 * i + 1], this->ptr[4 * i + 2], this->ptr[4 * i + 3]};
+    }
+
+    /**
+     * Scatter a quaternion into the i-th position
+     */
+    void set(std::size_t i, const value_type& quat) const noexcept {
+        static_assert(!std::is_const<T>::value, "ComplexPairSpan: set on a read-only view");
+        this->ptr[4 * i] = quat.a();
+        this->ptr[4 * i + 1] = quat.b();
+        this->ptr[4 * i + 2] = quat.c();
+        this->ptr[4 * i + 3] = quat.d();
+    }
+
+    constexpr ComplexPairSpan<T> subspan(std::size_t offset, std::size_t length) const noexcept {
+        return {this->ptr + 4 * offset, length};
+    }
+
+    /**
+     * The same memory as 2 * size() complex values z1, z2, z1, z2, ...
+     */
+    constexpr ComplexLaneSpan<T> complex_values() const noexcept {
+        return {this->ptr, 2 * this->count};
+    }
+
+    /**
+     * The complex_a() parts, stride 2
+     */
+    constexpr ComplexLaneSpan<T> complex_a() const noexcept {
+        return {this->ptr, this->count, 2};
+    }
+
+    /**
+     * The complex_b() parts, stride 2
+     */
+    constexpr ComplexLaneSpan<T> complex_b() const noexcept {
+        return {this->ptr + 2, this->count, 2};
+    }
+
+};
+
+/**
+ * Non-owning view of two separate complex buffers as quaternions: the
+ * k-th quaternion is complex_a[k] + complex_b[k] j.
+ * Elements are gathered by value and scattered with set(), like
+ * QuaternionArray.
+ * T is the scalar type, const qualified for a read-only view.
+ */
+template<typename T = double>
+class SplitComplexSpan {
+
+public:
+
+    using value_type = Quaternion<std::remove_const_t<T>>; ///< value_type trait for STL compatibility
+    using complex_type = quaternion_complex_detail::same_const_t<T, std::complex<std::remove_const_t<T>>>;
+    using size_type = std::size_t;
+
+private:
+
+    complex_type* first;
+    complex_type* second;
+    std::size_t count;
+
+public:
+
+    constexpr SplitComplexSpan() noexcept
+        : first(nullptr), second(nullptr), count(0) {}
+
+    constexpr SplitComplexSpan(complex_type* complex_a, complex_type* complex_b, std::size_t count) noexcept
+        : first(complex_a), second(complex_b), count(count) {}
+
+    /**
+     * View of two contiguous containers of complex values of the same size
+     */
+    template<typename C, typename = std::enable_if_t<quaternion_complex_detail::is_container_of<C, complex_type>::value>>
+    SplitComplexSpan(C& complex_a, C& complex_b)
+        : SplitComplexSpan(complex_a.data(), complex_b.data(), complex_a.size()) {
+        if (complex_a.size() != complex_b.size()) {
+            throw std::length_error("SplitComplexSpan: size mismatch");
+        }
+    }
+
+    /**
+     * Read-only view of a mutable one
+     */
+    template<typename U, typename = std::enable_if_t<std::is_same<const U, T>::value && !std::is_same<U, T>::value>>
+    constexpr SplitComplexSpan(const SplitComplexSpan<U>& other) noexcept
+        : first(other.complex_a_data()), second(other.complex_b_data()), count(other.size()) {}
+
+    constexpr std::size_t size() const noexcept {
+        return this->count;
+    }
+
+    constexpr bool empty() const noexcept {
+        return this->count == 0;
+    }
+
+    /**
+     * Gather the i-th quaternion
+     */
+    constexpr value_type operator[](std::size_t i) const noexcept {
+        return {this->first[i], this->second[i]};
+    }
+
+    /**
+     * Scatter a quaternion into the i-th position
+     */
+    void set(std::size_t i, const value_type& quat) const noexcept {
+        static_assert(!std::is_const<T>::value, "SplitComplexSpan: set on a read-only view");
+        this->first[i] = quat.complex_a();
+        this->second[i] = quat.complex_b();
+    }
+
+    constexpr SplitComplexSpan<T> subspan(std::size_t offset, std::size_t length) const noexcept {
+        return {this->first + offset, this->second + offset, length};
+    }
+
+    constexpr complex_type* complex_a_data() const noexcept {
+        return this->first;
+    }
+
+    constexpr complex_type* complex_b_data() const noexcept {
+        return this->second;
+    }
+
+    ComplexLaneSpan<T> complex_a() const noexcept {
+        return {this->first, this->count};
+    }
+
+    ComplexLaneSpan<T> complex_b() const noexcept {
+        return {this->second, this->count};
+    }
+
+};
+
+namespace quaternion_complex_detail {
+
+    /**
+     * Scalar access to the two complex halves of a view: the real part of
+     * the k-th complex_a is a[step * k], its imaginary part a[step * k + 1]
+     */
+    template<typename V>
+    struct layout {};
+
+    template<typename T>
+    struct layout<ComplexPairSpan<T>> {
+        static constexpr std::size_t step = 4;
+        static T* a(const ComplexPairSpan<T>& view) noexcept {
+            return view.data();
+        }
+        static T* b(const ComplexPairSpan<T>& view) noexcept {
+            return view.data() + 2;
+        }
+    };
+
+    template<typename T>
+    struct layout<SplitComplexSpan<T>> {
+        static constexpr std::size_t step = 2;
+        static T* a(const SplitComplexSpan<T>& view) noexcept {
+            return reinterpret_cast<T*>(view.complex_a_data());
+        }
+        static T* b(const SplitComplexSpan<T>& view) noexcept {
+            return reinterpret_cast<T*>(view.complex_b_data());
+        }
+    };
+
+    template<typename V, typename = void>
+    struct is_view : std::false_type {};
+
+    template<typename V>
+    struct is_view<V, std::void_t<decltype(layout<V>::step)>> : std::true_type {};
+
+    template<typename L, typename O>
+    using enable_product_t = std::enable_if_t<is_view<L>::value && is_view<O>::value &&
+                                              std::is_same<typename L::value_type, typename O::value_type>::value>;
+
+    template<typename L, typename O>
+    void check_size(const L& lhs, const O& out) {
+        static_assert(!std::is_const<typename O::complex_type>::value, "complex product: read-only output view");
+        if (lhs.size() != out.size()) {
+            throw std::length_error("complex product: size mismatch");
+        }
+    }
+
+    /**
+     * q * z for every element, same formula as operator*(Quaternion, std::complex).
+     * Every element is read before it is written, out may alias lhs.
+     */
+    template<std::size_t SL, std::size_t SO, typename T>
+    void right_product(const T* la, const T* lb, const T* z, T* oa, T* ob, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            T a = la[SL * i], b = la[SL * i + 1], c = lb[SL * i], d = lb[SL * i + 1];
+            T re = z[2 * i], im = z[2 * i + 1];
+            T tn = (a * re) - (b * im);
+            T tni = (a * im) + (b * re);
+            T tnj = (c * re) + (d * im);
+            T tnk = (d * re) - (c * im);
+            oa[SO * i] = tn;
+            oa[SO * i + 1] = tni;
+            ob[SO * i] = tnj;
+            ob[SO * i + 1] = tnk;
+        }
+    }
+
+    /**
+     * z * q for every element, same formula as operator*(std::complex, Quaternion)
+     */
+    template<std::size_t SL, std::size_t SO, typename T>
+    void left_product(const T* z, const T* la, const T* lb, T* oa, T* ob, std::size_t size) {
+        for (std::size_t i = 0; i < size; ++i) {
+            T a = la[SL * i], b = la[SL * i + 1], c = lb[SL * i], d = lb[SL * i + 1];
+            T re = z[2 * i], im = z[2 * i + 1];
+            T tn = (re * a) - (im * b);
+            T tni = (re * b) + (im * a);
+            T tnj = (re * c) - (im * d);
+            T tnk = (re * d) + (im * c);
+            oa[SO * i] = tn;
+            oa[SO * i + 1] = tni;
+            ob[SO * i] = tnj;
+            ob[SO * i + 1] = tnk;
+        }
+    }
+
+}
+
+/**
+ * out[k] = lhs[k] * rhs[k] for the size() elements of lhs, with lhs and out
+ * any of ComplexPairSpan or SplitComplexSpan. out may be lhs itself.
+ */
+template<typename L, typename O, typename = quaternion_complex_detail::enable_product_t<L, O>>
+void multiply(const L& lhs, const std::complex<typename L::value_type::value_type>* rhs, const O& out) {
+    using namespace quaternion_complex_detail;
+    using T = typename L::value_type::value_type;
+    check_size(lhs, out);
+    QUATERNION_TIMED_KERNEL("complex mul right", lhs.size());
+    QUATERNION_COUNT_BATCH(Multiply, lhs.size());
+    right_product<layout<L>::step, layout<O>::step>(layout<L>::a(lhs), layout<L>::b(lhs), reinterpret_cast<const T*>(rhs),
+                                                    layout<O>::a(out), layout<O>::b(out), lhs.size());
+}
+
+/**
+ * out[k] = lhs[k] * rhs[k] for the size() elements of rhs, with rhs and out
+ * any of ComplexPairSpan or SplitComplexSpan. out may be rhs itself.
+ */
+template<typename R, typename O, typename = quaternion_complex_detail::enable_product_t<R, O>>
+void multiply(const std::complex<typename R::value_type::value_type>* lhs, const R& rhs, const O& out) {
+    using namespace quaternion_complex_detail;
+    using T = typename R::value_type::value_type;
+    check_size(rhs, out);
+    QUATERNION_TIMED_KERNEL("complex mul left", rhs.size());
+    QUATERNION_COUNT_BATCH(Multiply, rhs.size());
+    left_product<layout<R>::step, layout<O>::step>(reinterpret_cast<const T*>(lhs), layout<R>::a(rhs), layout<R>::b(rhs),
+                                                   layout<O>::a(out), layout<O>::b(out), rhs.size());
+}
+
+#endif // QUATER_COMPLEX_H
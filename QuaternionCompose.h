@@ -0,0 +1,161 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_COMPOSE_H
+#define QUATER_COMPOSE_H
+
+#include <cstddef>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionParallel.h"
+
+namespace quaternion_compose_detail {
+
+    constexpr std::size_t grain = 1 << 14;
+
+    /**
+     * Serial fold acc * q[first] * ... * q[last - 1], renormalized every renormalize_every products
+     */
+    template<typename T, typename Get>
+    Quaternion<T> fold(Quaternion<T> acc, std::size_t first, std::size_t last, Get get, std::size_t renormalize_every) {
+        std::size_t count = 0;
+        for (std::size_t i = first; i < last; ++i) {
+            acc = acc * get(i);
+            if (renormalize_every != 0 && ++count == renormalize_every) {
+                acc = normalized(acc);
+                count = 0;
+            }
+        }
+        return acc;
+    }
+
+    template<typename T, typename Get>
+    Quaternion<T> reduce(std::size_t size, Get get, std::size_t renormalize_every) {
+        std::size_t blocks = quaternion_parallel::block_count(size, grain);
+        std::vector<Quaternion<T>> partial(blocks);
+        quaternion_parallel::run_blocks(blocks, [&](std::size_t b) {
+            auto range = quaternion_parallel::block_range(size, blocks, b);
+            partial[b] = fold(Quaternion<T>(static_cast<T>(1)), range.first, range.second, get, renormalize_every);
+        });
+        return fold(Quaternion<T>(static_cast<T>(1)), 0, blocks, [&](std::size_t b) { return partial[b]; }, renormalize_every != 0 ? 1 : 0);
+    }
+
+    /**
+     * Three phase scan: local scans per block, serial scan of the block
+     * totals, then every block is left-multiplied by its prefix.
+     */
+    template<typename T, typename Get, typename Load, typename Put>
+    void scan(std::size_t size, Get get, Load load, Put put, std::size_t renormalize_every) {
+        std::size_t blocks = quaternion_parallel::block_count(size, grain);
+        std::vector<Quaternion<T>> total(blocks);
+        quaternion_parallel::run_blocks(blocks, [&](std::size_t b) {
+            auto range = quaternion_parallel::block_range(size, blocks, b);
+            Quaternion<T> acc(static_cast<T>(1));
+            std::size_t count = 0;
+            for (std::size_t i = range.first; i < range.second; ++i) {
+                acc = acc * get(i);
+                if (renormalize_every != 0 && ++count == renormalize_every) {
+                    acc = normalized(acc);
+                    count = 0;
+                }
+                put(i, acc);
+            }
+            total[b] = acc;
+        });
+        if (blocks == 1) {
+            return;
+        }
+        std::vector<Quaternion<T>> prefix(blocks, Quaternion<T>(static_cast<T>(1)));
+        for (std::size_t b = 1; b < blocks; ++b) {
+            prefix[b] = prefix[b - 1] * total[b - 1];
+            if (renormalize_every != 0) {
+                prefix[b] = normalized(prefix[b]);
+            }
+        }
+        quaternion_parallel::run_blocks(blocks - 1, [&](std::size_t b) {
+            auto range = quaternion_parallel::block_range(size, blocks, b + 1);
+            for (std::size_t i = range.first; i < range.second; ++i) {
+                put(i, prefix[b + 1] * load(i));
+            }
+        });
+    }
+
+}
+
+/**
+ * Product q[0] * q[1] * ... * q[n - 1] computed as a parallel tree reduction.
+ * With renormalize_every != 0 the partial products are renormalized every
+ * renormalize_every steps to limit drift.
+ */
+template<typename T>
+Quaternion<T> compose_all(const std::vector<Quaternion<T>>& quats, std::size_t renormalize_every = 0) {
+    return quaternion_compose_detail::reduce<T>(quats.size(), [&](std::size_t i) { return quats[i]; }, renormalize_every);
+}
+
+/**
+ * Product q[0] * q[1] * ... * q[n - 1] of a quaternion array.
+ */
+template<typename T>
+Quaternion<T> compose_all(const QuaternionArray<T>& quats, std::size_t renormalize_every = 0) {
+    return quaternion_compose_detail::reduce<T>(quats.size(), [&](std::size_t i) { return quats[i]; }, renormalize_every);
+}
+
+/**
+ * Prefix products result[i] = q[0] * ... * q[i] computed as a parallel scan.
+ * The renormalization points depend on the block partition, with unit
+ * inputs the result matches the serial fold up to rounding.
+ */
+template<typename T>
+std::vector<Quaternion<T>> inclusive_compose_scan(const std::vector<Quaternion<T>>& quats, std::size_t renormalize_every = 0) {
+    std::vector<Quaternion<T>> result(quats.size());
+    quaternion_compose_detail::scan<T>(quats.size(),
+        [&](std::size_t i) { return quats[i]; },
+        [&](std::size_t i) { return result[i]; },
+        [&](std::size_t i, const Quaternion<T>& quat) { result[i] = quat; },
+        renormalize_every);
+    return result;
+}
+
+/**
+ * Prefix products of a quaternion array.
+ */
+template<typename T>
+QuaternionArray<T> inclusive_compose_scan(const QuaternionArray<T>& quats, std::size_t renormalize_every = 0) {
+    QuaternionArray<T> result(quats.size());
+    quaternion_compose_detail::scan<T>(quats.size(),
+        [&](std::size_t i) { return quats[i]; },
+        [&](std::size_t i) { return result[i]; },
+        [&](std::size_t i, const Quaternion<T>& quat) { result.set(i, quat); },
+        renormalize_every);
+    return result;
+}
+
+#endif // QUATER_COMPOSE_H
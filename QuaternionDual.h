@@ -0,0 +1,318 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_DUAL_H
+#define QUATER_DUAL_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionParallel.h"
+#include "QuaternionSimd.h"
+
+/**
+ * Dual quaternion real + dual * epsilon, with epsilon^2 = 0.
+ * A unit dual quaternion is the rigid transform x -> rotation * x + translation
+ * with real = rotation and dual = translation * rotation / 2.
+ */
+template<typename T = double>
+class DualQuaternion {
+
+private:
+
+    Quaternion<T> qr, qd;
+
+public:
+
+    using value_type = T; ///< value_type trait for STL compatibility
+
+    /**
+     * Default constuctor
+     */
+    constexpr DualQuaternion(const Quaternion<T>& real = Quaternion<T>(), const Quaternion<T>& dual = Quaternion<T>()) noexcept
+        : qr(real), qd(dual) {}
+
+    /**
+     * Copy constructor
+     */
+    template<typename U>
+    constexpr DualQuaternion(const DualQuaternion<U>& rhs) noexcept
+        : qr(rhs.real()), qd(rhs.dual()) {}
+
+    constexpr Quaternion<T> real() const noexcept {
+        return this->qr;
+    }
+
+    constexpr Quaternion<T> dual() const noexcept {
+        return this->qd;
+    }
+
+    /**
+     * Translation of a unit dual quaternion: 2 * dual * conj(real)
+     */
+    constexpr std::array<T, 3> translation() const noexcept {
+        Quaternion<T> t = this->qd * std::conj(this->qr);
+        return {2 * t.b(), 2 * t.c(), 2 * t.d()};
+    }
+
+    template<typename U>
+    constexpr DualQuaternion<T>& operator+=(const DualQuaternion<U>& rhs) noexcept {
+        this->qr = this->qr + rhs.real();
+        this->qd = this->qd + rhs.dual();
+        return *this;
+    }
+
+    template<typename U>
+    constexpr DualQuaternion<T>& operator-=(const DualQuaternion<U>& rhs) noexcept {
+        this->qr = this->qr - rhs.real();
+        this->qd = this->qd - rhs.dual();
+        return *this;
+    }
+
+    template<typename U>
+    constexpr DualQuaternion<T>& operator*=(const DualQuaternion<U>& rhs) noexcept {
+        *this = *this * rhs;
+        return *this;
+    }
+
+};
+
+/**
+ * Rigid transform: rotation (unit quaternion) followed by translation
+ */
+template<typename T>
+constexpr DualQuaternion<T> rigid_transform(const Quaternion<T>& rotation, const std::array<T, 3>& translation) noexcept {
+    Quaternion<T> half(static_cast<T>(0), translation[0] / 2, translation[1] / 2, translation[2] / 2);
+    return {rotation, half * rotation};
+}
+
+namespace std {
+
+    /**
+     * Quaternion conjugate of both parts. For unit dual quaternions this is the inverse transform.
+     */
+    template<typename T>
+    constexpr DualQuaternion<T> conj(const DualQuaternion<T>& dq) noexcept {
+        return {std::conj(dq.real()), std::conj(dq.dual())};
+    }
+
+}
+
+/**
+ * Dual number conjugate: real - dual * epsilon
+ */
+template<typename T>
+constexpr DualQuaternion<T> dual_conj(const DualQuaternion<T>& dq) noexcept {
+    return {dq.real(), dq.dual() * static_cast<T>(-1)};
+}
+
+/**
+ * Quaternion and dual number conjugate together, used to transform points as dq * p * conj
+ */
+template<typename T>
+constexpr DualQuaternion<T> combined_conj(const DualQuaternion<T>& dq) noexcept {
+    return {std::conj(dq.real()), std::conj(dq.dual()) * static_cast<T>(-1)};
+}
+
+template<typename _tA, typename _tB>
+constexpr auto operator+(const DualQuaternion<_tA>& lhs, const DualQuaternion<_tB>& rhs) noexcept -> DualQuaternion<decltype(lhs.real().a() + rhs.real().a())> {
+    return {lhs.real() + rhs.real(), lhs.dual() + rhs.dual()};
+}
+
+template<typename _tA, typename _tB>
+constexpr auto operator-(const DualQuaternion<_tA>& lhs, const DualQuaternion<_tB>& rhs) noexcept -> DualQuaternion<decltype(lhs.real().a() - rhs.real().a())> {
+    return {lhs.real() - rhs.real(), lhs.dual() - rhs.dual()};
+}
+
+/**
+ * Product, the composition of the transforms (rhs first)
+ */
+template<typename _tA, typename _tB>
+constexpr auto operator*(const DualQuaternion<_tA>& lhs, const DualQuaternion<_tB>& rhs) noexcept -> DualQuaternion<decltype(lhs.real().a() * rhs.real().a())> {
+    return {lhs.real() * rhs.real(), (lhs.real() * rhs.dual()) + (lhs.dual() * rhs.real())};
+}
+
+template<typename _tA, typename _tB, typename = std::enable_if_t<std::is_arithmetic<_tB>::value>>
+constexpr auto operator*(const DualQuaternion<_tA>& lhs, const _tB& rhs) noexcept -> DualQuaternion<decltype(lhs.real().a() * rhs)> {
+    return {lhs.real() * rhs, lhs.dual() * rhs};
+}
+
+template<typename _tA, typename _tB, typename = std::enable_if_t<std::is_arithmetic<_tA>::value>>
+constexpr auto operator*(const _tA& lhs, const DualQuaternion<_tB>& rhs) noexcept -> DualQuaternion<decltype(lhs * rhs.real().a())> {
+    return {lhs * rhs.real(), lhs * rhs.dual()};
+}
+
+template<typename _tA, typename _tB>
+constexpr bool operator==(const DualQuaternion<_tA>& lhs, const DualQuaternion<_tB>& rhs) noexcept {
+    return lhs.real() == rhs.real() && lhs.dual() == rhs.dual();
+}
+
+/**
+ * Stream operator for dual quaternion.
+ */
+template<typename T>
+std::ostream& operator<<(std::ostream& os, const DualQuaternion<T>& dq) {
+    os << dq.real() << "+e" << dq.dual();
+    return os;
+}
+
+/**
+ * Unit dual quaternion: both parts divided by |real|, then the component
+ * of dual along real removed so that dot(real, dual) = 0.
+ */
+template<typename T>
+DualQuaternion<T> normalized(const DualQuaternion<T>& dq) {
+    T inv = static_cast<T>(1) / std::abs(dq.real());
+    Quaternion<T> real = dq.real() * inv;
+    Quaternion<T> dual = dq.dual() * inv;
+    return {real, dual - real * dot(real, dual)};
+}
+
+/**
+ * Rigid transform of a point by a unit dual quaternion
+ */
+template<typename T>
+constexpr std::array<T, 3> transform(const DualQuaternion<T>& dq, const std::array<T, 3>& point) noexcept {
+    std::array<T, 3> r = rotate(dq.real(), point);
+    std::array<T, 3> t = dq.translation();
+    return {r[0] + t[0], r[1] + t[1], r[2] + t[2]};
+}
+
+/**
+ * Dual quaternion linear blending (Kavan et al.): weighted sum of the
+ * transforms, each flipped onto the hemisphere of the first, normalized.
+ */
+template<typename T>
+DualQuaternion<T> blend(const DualQuaternion<T>* dqs, const T* weights, std::size_t count) {
+    DualQuaternion<T> sum = dqs[0] * weights[0];
+    for (std::size_t k = 1; k < count; ++k) {
+        T w = dot(dqs[k].real(), dqs[0].real()) < 0 ? -weights[k] : weights[k];
+        sum += dqs[k] * w;
+    }
+    return normalized(sum);
+}
+
+namespace quaternion_dual_detail {
+
+    constexpr std::size_t grain = 1 << 13;
+
+    /**
+     * Gather the eight components of the bones of influence k for the lanes at offset i
+     */
+    template<typename P, typename T>
+    inline void gather(const std::vector<T>& bones, const std::uint32_t* joints, std::size_t i, typename P::type (&out)[8]) {
+        T lanes[8][P::width];
+        for (std::size_t l = 0; l < P::width; ++l) {
+            const T* bone = bones.data() + 8 * static_cast<std::size_t>(joints[i + l]);
+            for (std::size_t c = 0; c < 8; ++c) {
+                lanes[c][l] = bone[c];
+            }
+        }
+        for (std::size_t c = 0; c < 8; ++c) {
+            out[c] = P::load(lanes[c]);
+        }
+    }
+
+    /**
+     * Blend the influences of the vertices at offset i and transform them.
+     * joints and weights hold influence k of vertex v at k * size + v.
+     */
+    template<typename P, typename T>
+    inline void skin_step(const std::vector<T>& bones, const std::uint32_t* joints, const T* weights, std::size_t influences, std::size_t size,
+                          const T* xs, const T* ys, const T* zs, T* out_x, T* out_y, T* out_z, std::size_t i) {
+        const auto zero = P::set1(static_cast<T>(0));
+        const auto two = P::set1(static_cast<T>(2));
+        typename P::type first[8], sum[8], bone[8];
+        gather<P>(bones, joints, i, first);
+        auto w = P::load(weights + i);
+        for (std::size_t c = 0; c < 8; ++c) {
+            sum[c] = P::mul(first[c], w);
+        }
+        for (std::size_t k = 1; k < influences; ++k) {
+            gather<P>(bones, joints + k * size, i, bone);
+            auto d = P::add(P::add(P::add(P::mul(bone[0], first[0]), P::mul(bone[1], first[1])), P::mul(bone[2], first[2])), P::mul(bone[3], first[3]));
+            w = P::load(weights + k * size + i);
+            w = P::select(P::less(d, zero), P::neg(w), w);
+            for (std::size_t c = 0; c < 8; ++c) {
+                sum[c] = P::add(sum[c], P::mul(bone[c], w));
+            }
+        }
+        auto inv = P::div(P::set1(static_cast<T>(1)), P::sqrt(P::add(P::add(P::add(P::mul(sum[0], sum[0]), P::mul(sum[1], sum[1])), P::mul(sum[2], sum[2])), P::mul(sum[3], sum[3]))));
+        auto ra = P::mul(sum[0], inv), rb = P::mul(sum[1], inv), rc = P::mul(sum[2], inv), rd = P::mul(sum[3], inv);
+        auto da = P::mul(sum[4], inv), db = P::mul(sum[5], inv), dc = P::mul(sum[6], inv), dd = P::mul(sum[7], inv);
+        // translation 2 * vec(dual * conj(real))
+        auto tx = P::mul(two, P::add(P::sub(P::mul(db, ra), P::mul(da, rb)), P::sub(P::mul(dd, rc), P::mul(dc, rd))));
+        auto ty = P::mul(two, P::add(P::sub(P::mul(dc, ra), P::mul(da, rc)), P::sub(P::mul(db, rd), P::mul(dd, rb))));
+        auto tz = P::mul(two, P::add(P::sub(P::mul(dd, ra), P::mul(da, rd)), P::sub(P::mul(dc, rb), P::mul(db, rc))));
+        auto x = P::load(xs + i), y = P::load(ys + i), z = P::load(zs + i);
+        auto ux = P::mul(two, P::sub(P::mul(rc, z), P::mul(rd, y)));
+        auto uy = P::mul(two, P::sub(P::mul(rd, x), P::mul(rb, z)));
+        auto uz = P::mul(two, P::sub(P::mul(rb, y), P::mul(rc, x)));
+        P::store(out_x + i, P::add(P::add(P::add(x, P::mul(ra, ux)), P::sub(P::mul(rc, uz), P::mul(rd, uy))), tx));
+        P::store(out_y + i, P::add(P::add(P::add(y, P::mul(ra, uy)), P::sub(P::mul(rd, ux), P::mul(rb, uz))), ty));
+        P::store(out_z + i, P::add(P::add(P::add(z, P::mul(ra, uz)), P::sub(P::mul(rb, uy), P::mul(rc, ux))), tz));
+    }
+
+}
+
+/**
+ * Batched dual quaternion skinning of size vertices with a fixed number of
+ * influences each. joints and weights are SoA by influence: influence k of
+ * vertex v is at k * size + v. Weights are expected to sum to 1.
+ * Output buffers may alias the input ones. Large meshes are split across threads.
+ */
+template<typename T>
+void skin(const std::vector<DualQuaternion<T>>& bones, const std::uint32_t* joints, const T* weights, std::size_t influences,
+          const T* xs, const T* ys, const T* zs, T* out_x, T* out_y, T* out_z, std::size_t size) {
+    using P = quaternion_simd::pack<T>;
+    using S = quaternion_simd::scalar_pack<T>;
+    std::vector<T> flat;
+    flat.reserve(8 * bones.size());
+    for (const DualQuaternion<T>& bone : bones) {
+        Quaternion<T> r = bone.real(), d = bone.dual();
+        flat.insert(flat.end(), {r.a(), r.b(), r.c(), r.d(), d.a(), d.b(), d.c(), d.d()});
+    }
+    QUATERNION_TIMED_KERNEL("skin", size);
+    quaternion_parallel::parallel_for(size, quaternion_dual_detail::grain, [&](std::size_t first, std::size_t last) {
+        std::size_t i = first;
+        for (; i + P::width <= last; i += P::width) {
+            quaternion_dual_detail::skin_step<P>(flat, joints, weights, influences, size, xs, ys, zs, out_x, out_y, out_z, i);
+        }
+        for (; i < last; ++i) {
+            quaternion_dual_detail::skin_step<S>(flat, joints, weights, influences, size, xs, ys, zs, out_x, out_y, out_z, i);
+        }
+    });
+}
+
+#endif // QUATER_DUAL_H
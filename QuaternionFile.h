@@ -0,0 +1,388 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_FILE_H
+#define QUATER_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionSpan.h"
+
+/**
+ * Binary quaternion stream format (POSIX).
+ *
+ * A 64 byte header followed by the payload in native byte order:
+ *  - AoS: count consecutive Quaternion<T> (a, b, c, d)
+ *  - SoA: four component arrays of capacity elements each, the first
+ *         count elements of each are valid
+ *
+ * The payload starts at offset 64, so a memory-mapped file is suitably
+ * aligned to be used in place as an array of Quaternion<T>.
+ */
+enum class QuaternionLayout : std::uint8_t {
+    AoS = 0,
+    SoA = 1
+};
+
+struct QuaternionFileHeader {
+    char magic[8];                  ///< "QUATERN\0"
+    std::uint32_t version;          ///< format version, currently 1
+    std::uint32_t byte_order;       ///< 0x01020304 written natively
+    std::uint8_t element_type;      ///< 1 float, 2 double, 3 long double
+    std::uint8_t element_size;      ///< sizeof(T)
+    std::uint8_t layout;            ///< QuaternionLayout
+    std::uint8_t reserved0;
+    std::uint32_t reserved1;
+    std::uint64_t count;            ///< number of quaternions
+    std::uint64_t capacity;         ///< SoA component stride, equal to count for AoS
+    std::uint8_t reserved2[24];
+};
+
+static_assert(sizeof(QuaternionFileHeader) == 64, "QuaternionFileHeader must be 64 bytes");
+
+namespace quaternion_file_detail {
+
+    constexpr char magic[8] = {'Q', 'U', 'A', 'T', 'E', 'R', 'N', '\0'};
+    constexpr std::uint32_t version = 1;
+    constexpr std::uint32_t byte_order = 0x01020304;
+
+    /**
+     * Largest file offset the writer can seek to
+     */
+    constexpr std::uint64_t max_offset() {
+        return static_cast<std::uint64_t>(std::numeric_limits<off_t>::max());
+    }
+
+    template<typename T> struct element_code;
+    template<> struct element_code<float> { static constexpr std::uint8_t value = 1; };
+    template<> struct element_code<double> { static constexpr std::uint8_t value = 2; };
+    template<> struct element_code<long double> { static constexpr std::uint8_t value = 3; };
+
+    template<typename T>
+    QuaternionFileHeader make_header(QuaternionLayout layout, std::uint64_t count, std::uint64_t capacity) {
+        QuaternionFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, magic, sizeof(magic));
+        header.version = version;
+        header.byte_order = byte_order;
+        header.element_type = element_code<T>::value;
+        header.element_size = sizeof(T);
+        header.layout = static_cast<std::uint8_t>(layout);
+        header.count = count;
+        header.capacity = capacity;
+        return header;
+    }
+
+    template<typename T>
+    void check_header(const QuaternionFileHeader& header, std::size_t file_size) {
+        if (std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version) {
+            throw std::runtime_error("QuaternionFile: not a quaternion stream");
+        }
+        if (header.byte_order != byte_order) {
+            throw std::runtime_error("QuaternionFile: byte order mismatch");
+        }
+        if (header.element_type != element_code<T>::value || header.element_size != sizeof(T)) {
+            throw std::runtime_error("QuaternionFile: element type mismatch");
+        }
+        if (header.layout > static_cast<std::uint8_t>(QuaternionLayout::SoA) || header.count > header.capacity) {
+            throw std::runtime_error("QuaternionFile: corrupted header");
+        }
+        // compare by division, capacity * 4 * sizeof(T) may wrap around
+        if (file_size < sizeof(QuaternionFileHeader) ||
+            header.capacity > (file_size - sizeof(QuaternionFileHeader)) / (4 * sizeof(T))) {
+            throw std::runtime_error("QuaternionFile: truncated payload");
+        }
+    }
+
+}
+
+/**
+ * Chunked writer. AoS streams grow without limit, SoA streams reserve
+ * capacity elements per component when opened.
+ */
+template<typename T = double>
+class QuaternionFileWriter {
+
+    static_assert(std::is_trivially_copyable<Quaternion<T>>::value && sizeof(Quaternion<T>) == 4 * sizeof(T),
+                  "Quaternion<T> must be layout compatible with T[4]");
+
+private:
+
+    std::FILE* file;
+    QuaternionLayout file_layout;
+    std::uint64_t count;
+    std::uint64_t capacity;
+
+    /**
+     * Write bytes at offset. fseeko takes an off_t, which is 64 bit even
+     * where long is not (given _FILE_OFFSET_BITS=64 on 32 bit targets);
+     * offsets it cannot represent are rejected rather than truncated.
+     */
+    void write_at(std::uint64_t offset, const void* data, std::size_t bytes) {
+        if (bytes == 0) {
+            return;
+        }
+        if (offset > quaternion_file_detail::max_offset() - bytes) {
+            throw std::length_error("QuaternionFileWriter: offset out of range");
+        }
+        if (::fseeko(this->file, static_cast<off_t>(offset), SEEK_SET) != 0 || std::fwrite(data, 1, bytes, this->file) != bytes) {
+            throw std::runtime_error("QuaternionFileWriter: write failed");
+        }
+    }
+
+    void write_header() {
+        QuaternionFileHeader header = quaternion_file_detail::make_header<T>(this->file_layout, this->count,
+            this->file_layout == QuaternionLayout::AoS ? this->count : this->capacity);
+        this->write_at(0, &header, sizeof(header));
+    }
+
+    std::uint64_t component_offset(std::size_t component, std::uint64_t index) const {
+        return sizeof(QuaternionFileHeader) + (component * this->capacity + index) * sizeof(T);
+    }
+
+public:
+
+    /**
+     * Create or truncate path. capacity is required for the SoA layout.
+     */
+    explicit QuaternionFileWriter(const std::string& path, QuaternionLayout layout = QuaternionLayout::AoS, std::uint64_t capacity = 0)
+        : file(nullptr), file_layout(layout), count(0), capacity(capacity) {
+        if (layout == QuaternionLayout::SoA && capacity > (quaternion_file_detail::max_offset() - sizeof(QuaternionFileHeader)) / sizeof(Quaternion<T>)) {
+            throw std::length_error("QuaternionFileWriter: SoA capacity out of range");
+        }
+        this->file = std::fopen(path.c_str(), "wb");
+        if (this->file == nullptr) {
+            throw std::runtime_error("QuaternionFileWriter: cannot open " + path);
+        }
+        this->write_header();
+        if (layout == QuaternionLayout::SoA && capacity > 0) {
+            // Size the file up front so every component region exists
+            T zero = static_cast<T>(0);
+            this->write_at(this->component_offset(3, capacity - 1), &zero, sizeof(T));
+        }
+    }
+
+    QuaternionFileWriter(const QuaternionFileWriter&) = delete;
+    QuaternionFileWriter& operator=(const QuaternionFileWriter&) = delete;
+
+    ~QuaternionFileWriter() {
+        try {
+            this->close();
+        } catch (...) {
+        }
+    }
+
+    /**
+     * Append size quaternions
+     */
+    void append(const Quaternion<T>* quats, std::size_t size) {
+        if (this->file_layout == QuaternionLayout::AoS) {
+            this->write_at(sizeof(QuaternionFileHeader) + this->count * sizeof(Quaternion<T>), quats, size * sizeof(Quaternion<T>));
+            this->count += size;
+            return;
+        }
+        QuaternionArray<T> chunk(std::vector<Quaternion<T>>(quats, quats + size));
+        this->append(chunk);
+    }
+
+    void append(const std::vector<Quaternion<T>>& quats) {
+        this->append(quats.data(), quats.size());
+    }
+
+    void append(const QuaternionArray<T>& quats) {
+        if (this->file_layout == QuaternionLayout::AoS) {
+            std::vector<Quaternion<T>> chunk = quats.to_vector();
+            this->append(chunk.data(), chunk.size());
+            return;
+        }
+        if (this->count + quats.size() > this->capacity) {
+            throw std::length_error("QuaternionFileWriter: SoA capacity exceeded");
+        }
+        const T* components[4] = {quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data()};
+        for (std::size_t k = 0; k < 4; ++k) {
+            this->write_at(this->component_offset(k, this->count), components[k], quats.size() * sizeof(T));
+        }
+        this->count += quats.size();
+    }
+
+    std::uint64_t size() const {
+        return this->count;
+    }
+
+    /**
+     * Update the header and close the file
+     */
+    void close() {
+        if (this->file == nullptr) {
+            return;
+        }
+        this->write_header();
+        bool failed = std::fclose(this->file) != 0;
+        this->file = nullptr;
+        if (failed) {
+            throw std::runtime_error("QuaternionFileWriter: close failed");
+        }
+    }
+
+};
+
+/**
+ * Memory-mapped read-only view of a quaternion stream.
+ */
+template<typename T = double>
+class QuaternionFileReader {
+
+    static_assert(std::is_trivially_copyable<Quaternion<T>>::value && sizeof(Quaternion<T>) == 4 * sizeof(T),
+                  "Quaternion<T> must be layout compatible with T[4]");
+
+private:
+
+    void* mapping;
+    std::size_t mapping_size;
+    QuaternionFileHeader header;
+
+    const unsigned char* payload() const {
+        return static_cast<const unsigned char*>(this->mapping) + sizeof(QuaternionFileHeader);
+    }
+
+    const T* component(std::size_t k) const {
+        if (this->layout() != QuaternionLayout::SoA) {
+            throw std::logic_error("QuaternionFileReader: not a SoA stream");
+        }
+        return reinterpret_cast<const T*>(this->payload()) + k * this->header.capacity;
+    }
+
+public:
+
+    explicit QuaternionFileReader(const std::string& path)
+        : mapping(nullptr), mapping_size(0) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("QuaternionFileReader: cannot open " + path);
+        }
+        struct stat info;
+        if (::fstat(fd, &info) != 0 || static_cast<std::size_t>(info.st_size) < sizeof(QuaternionFileHeader)) {
+            ::close(fd);
+            throw std::runtime_error("QuaternionFileReader: not a quaternion stream");
+        }
+        this->mapping_size = static_cast<std::size_t>(info.st_size);
+        this->mapping = ::mmap(nullptr, this->mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (this->mapping == MAP_FAILED) {
+            this->mapping = nullptr;
+            throw std::runtime_error("QuaternionFileReader: mmap failed");
+        }
+        std::memcpy(&this->header, this->mapping, sizeof(QuaternionFileHeader));
+        try {
+            quaternion_file_detail::check_header<T>(this->header, this->mapping_size);
+        } catch (...) {
+            ::munmap(this->mapping, this->mapping_size);
+            throw;
+        }
+    }
+
+    QuaternionFileReader(const QuaternionFileReader&) = delete;
+    QuaternionFileReader& operator=(const QuaternionFileReader&) = delete;
+
+    QuaternionFileReader(QuaternionFileReader&& rhs) noexcept
+        : mapping(rhs.mapping), mapping_size(rhs.mapping_size), header(rhs.header) {
+        rhs.mapping = nullptr;
+        rhs.mapping_size = 0;
+    }
+
+    ~QuaternionFileReader() {
+        if (this->mapping != nullptr) {
+            ::munmap(this->mapping, this->mapping_size);
+        }
+    }
+
+    QuaternionLayout layout() const {
+        return static_cast<QuaternionLayout>(this->header.layout);
+    }
+
+    std::size_t size() const {
+        return static_cast<std::size_t>(this->header.count);
+    }
+
+    /**
+     * Zero-copy view of an AoS stream
+     */
+    QuaternionSpan<T> quaternions() const {
+        if (this->layout() != QuaternionLayout::AoS) {
+            throw std::logic_error("QuaternionFileReader: not an AoS stream");
+        }
+        return {reinterpret_cast<const Quaternion<T>*>(this->payload()), this->size()};
+    }
+
+    /**
+     * Zero-copy component arrays of a SoA stream
+     */
+    const T* a_data() const {
+        return this->component(0);
+    }
+
+    const T* b_data() const {
+        return this->component(1);
+    }
+
+    const T* c_data() const {
+        return this->component(2);
+    }
+
+    const T* d_data() const {
+        return this->component(3);
+    }
+
+    /**
+     * Gather the i-th quaternion, valid for both layouts
+     */
+    Quaternion<T> operator[](std::size_t i) const {
+        if (this->layout() == QuaternionLayout::AoS) {
+            return this->quaternions()[i];
+        }
+        return {this->a_data()[i], this->b_data()[i], this->c_data()[i], this->d_data()[i]};
+    }
+
+};
+
+#endif // QUATER_FILE_H
@@ -0,0 +1,411 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_FILTER_H
+#define QUATER_FILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionParallel.h"
+#include "QuaternionSimd.h"
+
+/**
+ * Orientation filter algorithm.
+ *  - Madgwick: gradient descent step of size beta towards the orientation
+ *    that maps gravity (and the magnetic field) onto the measurements
+ *    (Madgwick 2010).
+ *  - Mahony: complementary filter, the cross product between measured and
+ *    estimated directions corrects the gyroscope through a PI controller
+ *    of gains kp, ki (Mahony et al. 2008).
+ */
+enum class FilterAlgorithm {
+    Madgwick,
+    Mahony
+};
+
+/**
+ * Filter parameters, shared by every channel. Gains follow the reference
+ * implementations: the Mahony feedback is 2 * kp * e + 2 * ki * integral(e).
+ */
+template<typename T>
+struct FilterSettings {
+    FilterAlgorithm algorithm = FilterAlgorithm::Madgwick;
+    T sample_period = static_cast<T>(1) / static_cast<T>(1000); ///< seconds
+    T beta = static_cast<T>(0.1);                               ///< Madgwick
+    T kp = static_cast<T>(0.5);                                 ///< Mahony
+    T ki = static_cast<T>(0);                                   ///< Mahony
+};
+
+/**
+ * A block of samples for every channel. Sample s of channel c is at
+ * s * channels + c in each buffer, so one sample of all the channels is
+ * contiguous. Gyroscope in rad/s, accelerometer and magnetometer in any
+ * unit. The magnetometer is optional: without it the heading is only
+ * integrated. Samples with a zero accelerometer (or magnetometer) reading
+ * skip the corresponding correction, as in the reference code.
+ */
+template<typename T>
+struct ImuBlock {
+    std::size_t samples = 0;
+    const T* gx = nullptr;
+    const T* gy = nullptr;
+    const T* gz = nullptr;
+    const T* ax = nullptr;
+    const T* ay = nullptr;
+    const T* az = nullptr;
+    const T* mx = nullptr;
+    const T* my = nullptr;
+    const T* mz = nullptr;
+};
+
+/**
+ * Caller provided output: the orientation after every sample, same layout
+ * as ImuBlock. Null buffers are not written.
+ */
+template<typename T>
+struct OrientationStream {
+    T* a = nullptr;
+    T* b = nullptr;
+    T* c = nullptr;
+    T* d = nullptr;
+};
+
+namespace quaternion_filter_detail {
+
+    /**
+     * Channel samples per thread: a block should outweigh starting a thread
+     * (tens of microseconds), smaller batches run on the calling thread
+     */
+    constexpr std::size_t grain = 1 << 15;
+
+    /**
+     * Pack with arithmetic operators, keeps the filter equations close to
+     * the published ones.
+     */
+    template<typename P>
+    struct lane {
+        using T = typename P::value_type;
+        typename P::type v;
+
+        explicit lane(typename P::type v) : v(v) {}
+
+        static lane load(const T* ptr) { return lane(P::load(ptr)); }
+        void store(T* ptr) const { P::store(ptr, this->v); }
+
+        friend lane operator+(lane x, lane y) { return lane(P::add(x.v, y.v)); }
+        friend lane operator-(lane x, lane y) { return lane(P::sub(x.v, y.v)); }
+        friend lane operator*(lane x, lane y) { return lane(P::mul(x.v, y.v)); }
+        friend lane operator-(lane x) { return lane(P::neg(x.v)); }
+        friend lane operator+(lane x, T y) { return lane(P::add(x.v, P::set1(y))); }
+        friend lane operator-(lane x, T y) { return lane(P::sub(x.v, P::set1(y))); }
+        friend lane operator-(T x, lane y) { return lane(P::sub(P::set1(x), y.v)); }
+        friend lane operator*(T x, lane y) { return lane(P::mul(P::set1(x), y.v)); }
+    };
+
+    /**
+     * 1 / sqrt(x), 0 where x is 0
+     */
+    template<typename P>
+    lane<P> inv_sqrt(lane<P> x) {
+        using T = typename P::value_type;
+        auto r = P::div(P::set1(static_cast<T>(1)), P::sqrt(x.v));
+        return lane<P>(P::select(P::less(P::set1(static_cast<T>(0)), x.v), r, P::set1(static_cast<T>(0))));
+    }
+
+    template<typename P>
+    lane<P> masked(typename P::mask m, lane<P> x) {
+        return lane<P>(P::select(m, x.v, P::set1(static_cast<typename P::value_type>(0))));
+    }
+
+    template<typename T>
+    struct channel_state {
+        T* q0;
+        T* q1;
+        T* q2;
+        T* q3;
+        T* ix;
+        T* iy;
+        T* iz;
+    };
+
+    /**
+     * Run every sample of the block on the channels i .. i + width, the
+     * orientation stays in registers between samples.
+     */
+    template<typename P, bool Mahony, bool Magnetic, typename T>
+    void filter_step(const FilterSettings<T>& settings, const channel_state<T>& state, const ImuBlock<T>& in, const OrientationStream<T>& out,
+                     std::size_t channels, std::size_t i) {
+        using L = lane<P>;
+        const T dt = settings.sample_period;
+        L q0 = L::load(state.q0 + i), q1 = L::load(state.q1 + i), q2 = L::load(state.q2 + i), q3 = L::load(state.q3 + i);
+        L ix = Mahony ? L::load(state.ix + i) : L(P::set1(static_cast<T>(0)));
+        L iy = Mahony ? L::load(state.iy + i) : ix, iz = Mahony ? L::load(state.iz + i) : ix;
+        for (std::size_t s = 0, o = i; s < in.samples; ++s, o += channels) {
+            L gx = L::load(in.gx + o), gy = L::load(in.gy + o), gz = L::load(in.gz + o);
+            L ax = L::load(in.ax + o), ay = L::load(in.ay + o), az = L::load(in.az + o);
+            L an = (ax * ax) + (ay * ay) + (az * az);
+            auto valid = P::less(P::set1(static_cast<T>(0)), an.v);
+            L ra = inv_sqrt(an);
+            ax = ax * ra;
+            ay = ay * ra;
+            az = az * ra;
+            L mx = ax, my = ax, mz = ax;
+            if (Magnetic) {
+                mx = L::load(in.mx + o);
+                my = L::load(in.my + o);
+                mz = L::load(in.mz + o);
+                L rm = inv_sqrt((mx * mx) + (my * my) + (mz * mz));
+                mx = mx * rm;
+                my = my * rm;
+                mz = mz * rm;
+            }
+            L q0q0 = q0 * q0, q0q1 = q0 * q1, q0q2 = q0 * q2, q0q3 = q0 * q3;
+            L q1q1 = q1 * q1, q1q2 = q1 * q2, q1q3 = q1 * q3;
+            L q2q2 = q2 * q2, q2q3 = q2 * q3, q3q3 = q3 * q3;
+            if (Mahony) {
+                // estimated gravity and error against the measured one, halved
+                L vx = q1q3 - q0q2, vy = q0q1 + q2q3, vz = q0q0 - static_cast<T>(0.5) + q3q3;
+                L ex = (ay * vz) - (az * vy), ey = (az * vx) - (ax * vz), ez = (ax * vy) - (ay * vx);
+                if (Magnetic) {
+                    // earth frame field, rotated back without its east component
+                    L hx = static_cast<T>(2) * ((mx * (static_cast<T>(0.5) - q2q2 - q3q3)) + (my * (q1q2 - q0q3)) + (mz * (q1q3 + q0q2)));
+                    L hy = static_cast<T>(2) * ((mx * (q1q2 + q0q3)) + (my * (static_cast<T>(0.5) - q1q1 - q3q3)) + (mz * (q2q3 - q0q1)));
+                    L bx = L(P::sqrt(((hx * hx) + (hy * hy)).v));
+                    L bz = static_cast<T>(2) * ((mx * (q1q3 - q0q2)) + (my * (q2q3 + q0q1)) + (mz * (static_cast<T>(0.5) - q1q1 - q2q2)));
+                    L wx = (bx * (static_cast<T>(0.5) - q2q2 - q3q3)) + (bz * (q1q3 - q0q2));
+                    L wy = (bx * (q1q2 - q0q3)) + (bz * (q0q1 + q2q3));
+                    L wz = (bx * (q0q2 + q1q3)) + (bz * (static_cast<T>(0.5) - q1q1 - q2q2));
+                    ex = ex + ((my * wz) - (mz * wy));
+                    ey = ey + ((mz * wx) - (mx * wz));
+                    ez = ez + ((mx * wy) - (my * wx));
+                }
+                ex = masked<P>(valid, ex);
+                ey = masked<P>(valid, ey);
+                ez = masked<P>(valid, ez);
+                if (settings.ki > static_cast<T>(0)) {
+                    const T k = static_cast<T>(2) * settings.ki * dt;
+                    ix = ix + (k * ex);
+                    iy = iy + (k * ey);
+                    iz = iz + (k * ez);
+                    gx = gx + masked<P>(valid, ix);
+                    gy = gy + masked<P>(valid, iy);
+                    gz = gz + masked<P>(valid, iz);
+                }
+                const T kp = static_cast<T>(2) * settings.kp;
+                const T h = static_cast<T>(0.5) * dt;
+                gx = h * (gx + (kp * ex));
+                gy = h * (gy + (kp * ey));
+                gz = h * (gz + (kp * ez));
+                L qa = q0, qb = q1, qc = q2;
+                q0 = q0 + (-(qb * gx) - (qc * gy) - (q3 * gz));
+                q1 = q1 + ((qa * gx) + (qc * gz) - (q3 * gy));
+                q2 = q2 + ((qa * gy) - (qb * gz) + (q3 * gx));
+                q3 = q3 + ((qa * gz) + (qb * gy) - (qc * gx));
+            } else {
+                // rate of change from the gyroscope
+                L d0 = static_cast<T>(0.5) * (-(q1 * gx) - (q2 * gy) - (q3 * gz));
+                L d1 = static_cast<T>(0.5) * ((q0 * gx) + (q2 * gz) - (q3 * gy));
+                L d2 = static_cast<T>(0.5) * ((q0 * gy) - (q1 * gz) + (q3 * gx));
+                L d3 = static_cast<T>(0.5) * ((q0 * gz) + (q1 * gy) - (q2 * gx));
+                // objective function of the gravity direction and its gradient
+                L f1 = static_cast<T>(2) * (q1q3 - q0q2) - ax;
+                L f2 = static_cast<T>(2) * (q0q1 + q2q3) - ay;
+                L f3 = static_cast<T>(1) - static_cast<T>(2) * (q1q1 + q2q2) - az;
+                L s0 = static_cast<T>(2) * ((q1 * f2) - (q2 * f1));
+                L s1 = static_cast<T>(2) * ((q3 * f1) + (q0 * f2)) - static_cast<T>(4) * (q1 * f3);
+                L s2 = static_cast<T>(2) * ((q3 * f2) - (q0 * f1)) - static_cast<T>(4) * (q2 * f3);
+                L s3 = static_cast<T>(2) * ((q1 * f1) + (q2 * f2));
+                if (Magnetic) {
+                    // earth frame field b = (bx, 0, bz), the reference code names 2 bx, 2 bz
+                    L hx = (mx * (q0q0 + q1q1 - q2q2 - q3q3)) + (static_cast<T>(2) * ((my * (q1q2 - q0q3)) + (mz * (q0q2 + q1q3))));
+                    L hy = (my * (q0q0 - q1q1 + q2q2 - q3q3)) + (static_cast<T>(2) * ((mx * (q1q2 + q0q3)) + (mz * (q2q3 - q0q1))));
+                    L bx = L(P::sqrt(((hx * hx) + (hy * hy)).v));
+                    L bz = (mz * (q0q0 - q1q1 - q2q2 + q3q3)) + (static_cast<T>(2) * ((mx * (q1q3 - q0q2)) + (my * (q0q1 + q2q3))));
+                    L f4 = (bx * (static_cast<T>(0.5) - q2q2 - q3q3)) + (bz * (q1q3 - q0q2)) - mx;
+                    L f5 = (bx * (q1q2 - q0q3)) + (bz * (q0q1 + q2q3)) - my;
+                    L f6 = (bx * (q0q2 + q1q3)) + (bz * (static_cast<T>(0.5) - q1q1 - q2q2)) - mz;
+                    s0 = s0 - (bz * q2 * f4) + (((bz * q1) - (bx * q3)) * f5) + (bx * q2 * f6);
+                    s1 = s1 + (bz * q3 * f4) + (((bx * q2) + (bz * q0)) * f5) + (((bx * q3) - (static_cast<T>(2) * (bz * q1))) * f6);
+                    s2 = s2 - (((static_cast<T>(2) * (bx * q2)) + (bz * q0)) * f4) + (((bx * q1) + (bz * q3)) * f5) + (((bx * q0) - (static_cast<T>(2) * (bz * q2))) * f6);
+                    s3 = s3 + (((bz * q1) - (static_cast<T>(2) * (bx * q3))) * f4) + (((bz * q2) - (bx * q0)) * f5) + (bx * q1 * f6);
+                }
+                L rs = masked<P>(valid, inv_sqrt((s0 * s0) + (s1 * s1) + (s2 * s2) + (s3 * s3)));
+                rs = settings.beta * rs;
+                q0 = q0 + (dt * (d0 - (rs * s0)));
+                q1 = q1 + (dt * (d1 - (rs * s1)));
+                q2 = q2 + (dt * (d2 - (rs * s2)));
+                q3 = q3 + (dt * (d3 - (rs * s3)));
+            }
+            L rq = L(P::div(P::set1(static_cast<T>(1)), P::sqrt(((q0 * q0) + (q1 * q1) + (q2 * q2) + (q3 * q3)).v)));
+            q0 = q0 * rq;
+            q1 = q1 * rq;
+            q2 = q2 * rq;
+            q3 = q3 * rq;
+            if (out.a) {
+                q0.store(out.a + o);
+            }
+            if (out.b) {
+                q1.store(out.b + o);
+            }
+            if (out.c) {
+                q2.store(out.c + o);
+            }
+            if (out.d) {
+                q3.store(out.d + o);
+            }
+        }
+        q0.store(state.q0 + i);
+        q1.store(state.q1 + i);
+        q2.store(state.q2 + i);
+        q3.store(state.q3 + i);
+        if (Mahony) {
+            ix.store(state.ix + i);
+            iy.store(state.iy + i);
+            iz.store(state.iz + i);
+        }
+    }
+
+    template<bool Mahony, bool Magnetic, typename T>
+    void run(const FilterSettings<T>& settings, const channel_state<T>& state, const ImuBlock<T>& in, const OrientationStream<T>& out, std::size_t channels) {
+        using P = quaternion_simd::pack<T>;
+        using S = quaternion_simd::scalar_pack<T>;
+        std::size_t channel_grain = std::max<std::size_t>(P::width, grain / std::max<std::size_t>(1, in.samples));
+        quaternion_parallel::parallel_for(channels, channel_grain, [&](std::size_t first, std::size_t last) {
+            std::size_t i = first;
+            for (; i + P::width <= last; i += P::width) {
+                filter_step<P, Mahony, Magnetic>(settings, state, in, out, channels, i);
+            }
+            for (; i < last; ++i) {
+                filter_step<S, Mahony, Magnetic>(settings, state, in, out, channels, i);
+            }
+        });
+    }
+
+}
+
+/**
+ * Streaming orientation filter over many independent sensor channels.
+ * Orientations are kept in SoA lanes and a block of samples is run per
+ * pack of channels, so a channel state is loaded once per block. Channel
+ * ranges are split across threads. Processing allocates nothing.
+ * Orientations map the earth frame (z up) to the sensor frame, as in the
+ * reference Madgwick and Mahony code.
+ */
+template<typename T>
+class OrientationFilter {
+
+private:
+
+    FilterSettings<T> config;
+    QuaternionArray<T> state;
+    std::vector<T> ix, iy, iz;
+
+public:
+
+    explicit OrientationFilter(std::size_t channels, const FilterSettings<T>& settings = FilterSettings<T>())
+        : config(settings), state(channels, Quaternion<T>(1)), ix(channels), iy(channels), iz(channels) {}
+
+    std::size_t channels() const noexcept {
+        return this->state.size();
+    }
+
+    const FilterSettings<T>& settings() const noexcept {
+        return this->config;
+    }
+
+    /**
+     * Current orientation of every channel
+     */
+    const QuaternionArray<T>& orientations() const noexcept {
+        return this->state;
+    }
+
+    Quaternion<T> orientation(std::size_t channel) const {
+        return this->state[channel];
+    }
+
+    /**
+     * Set the orientation of one channel, e.g. from a first accelerometer reading
+     */
+    void set_orientation(std::size_t channel, const Quaternion<T>& quat) {
+        this->state.set(channel, quat);
+    }
+
+    /**
+     * Back to the identity with the Mahony integral terms cleared
+     */
+    void reset() {
+        std::fill(this->ix.begin(), this->ix.end(), static_cast<T>(0));
+        std::fill(this->iy.begin(), this->iy.end(), static_cast<T>(0));
+        std::fill(this->iz.begin(), this->iz.end(), static_cast<T>(0));
+        for (std::size_t i = 0; i < this->channels(); ++i) {
+            this->state.set(i, Quaternion<T>(1));
+        }
+    }
+
+    /**
+     * Filter a block of samples of every channel, optionally writing the
+     * orientation after each sample to out.
+     * Channels are split across threads only when samples * channels is
+     * large enough to pay for starting them; a few samples of a few
+     * thousand channels run on the calling thread, so batch samples per
+     * call to use more cores.
+     */
+    void process(const ImuBlock<T>& block, const OrientationStream<T>& out = OrientationStream<T>()) {
+        if (!block.gx || !block.gy || !block.gz || !block.ax || !block.ay || !block.az) {
+            throw std::invalid_argument("OrientationFilter: missing gyroscope or accelerometer data");
+        }
+        bool magnetic = block.mx && block.my && block.mz;
+        if (!magnetic && (block.mx || block.my || block.mz)) {
+            throw std::invalid_argument("OrientationFilter: incomplete magnetometer data");
+        }
+        quaternion_filter_detail::channel_state<T> channel{this->state.a_data(), this->state.b_data(), this->state.c_data(), this->state.d_data(),
+                                                            this->ix.data(), this->iy.data(), this->iz.data()};
+        QUATERNION_TIMED_KERNEL("orientation filter", block.samples * this->channels());
+        bool mahony = this->config.algorithm == FilterAlgorithm::Mahony;
+        if (mahony && magnetic) {
+            quaternion_filter_detail::run<true, true>(this->config, channel, block, out, this->channels());
+        } else if (mahony) {
+            quaternion_filter_detail::run<true, false>(this->config, channel, block, out, this->channels());
+        } else if (magnetic) {
+            quaternion_filter_detail::run<false, true>(this->config, channel, block, out, this->channels());
+        } else {
+            quaternion_filter_detail::run<false, false>(this->config, channel, block, out, this->channels());
+        }
+    }
+
+};
+
+#endif // QUATER_FILTER_H
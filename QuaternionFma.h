@@ -0,0 +1,102 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_FMA_H
+#define QUATER_FMA_H
+
+#include <cmath>
+#include <type_traits>
+#include "Quaternion.h"
+
+/**
+ * Fused multiply-add arithmetic policy.
+ *
+ * Every component is one chain of std::fma in a fixed order, the last
+ * product of the sum first: a0 * b0 + a1 * b1 + a2 * b2 + a3 * b3 is
+ * fma(a0, b0, fma(a1, b1, fma(a2, b2, a3 * b3))). std::fma rounds once per
+ * step whatever the compiler flags, so results are identical across
+ * builds, and cancellation between the products loses less precision.
+ * std::fma is a single instruction on targets with FMA (-mfma, -march=native)
+ * and a correctly rounded library call elsewhere.
+ */
+namespace quaternion_fma {
+
+    template<typename T>
+    inline T dot4(T a0, T b0, T a1, T b1, T a2, T b2, T a3, T b3) {
+        return std::fma(a0, b0, std::fma(a1, b1, std::fma(a2, b2, a3 * b3)));
+    }
+
+    /**
+     * Norm of quaternion, the squared modulus
+     */
+    template<typename T>
+    T norm(const Quaternion<T>& quat) {
+        static_assert(std::is_floating_point<T>::value, "quaternion_fma: floating point types only");
+        return dot4(quat.a(), quat.a(), quat.b(), quat.b(), quat.c(), quat.c(), quat.d(), quat.d());
+    }
+
+    template<typename T>
+    T abs(const Quaternion<T>& quat) {
+        return std::sqrt(norm(quat));
+    }
+
+    template<typename T>
+    T dot(const Quaternion<T>& lhs, const Quaternion<T>& rhs) {
+        static_assert(std::is_floating_point<T>::value, "quaternion_fma: floating point types only");
+        return dot4(lhs.a(), rhs.a(), lhs.b(), rhs.b(), lhs.c(), rhs.c(), lhs.d(), rhs.d());
+    }
+
+    /**
+     * Hamilton product, four fma chains
+     */
+    template<typename T>
+    Quaternion<T> multiply(const Quaternion<T>& lhs, const Quaternion<T>& rhs) {
+        static_assert(std::is_floating_point<T>::value, "quaternion_fma: floating point types only");
+        return {dot4(lhs.a(), rhs.a(), -lhs.b(), rhs.b(), -lhs.c(), rhs.c(), -lhs.d(), rhs.d()),
+                dot4(lhs.a(), rhs.b(), lhs.b(), rhs.a(), lhs.c(), rhs.d(), -lhs.d(), rhs.c()),
+                dot4(lhs.a(), rhs.c(), lhs.c(), rhs.a(), lhs.d(), rhs.b(), -lhs.b(), rhs.d()),
+                dot4(lhs.a(), rhs.d(), lhs.d(), rhs.a(), lhs.b(), rhs.c(), -lhs.c(), rhs.b())};
+    }
+
+    /**
+     * Quaternion division lhs * inverse(rhs), four fma chains and the norm
+     */
+    template<typename T>
+    Quaternion<T> divide(const Quaternion<T>& lhs, const Quaternion<T>& rhs) {
+        T n = norm(rhs);
+        return {dot4(lhs.a(), rhs.a(), lhs.b(), rhs.b(), lhs.c(), rhs.c(), lhs.d(), rhs.d()) / n,
+                dot4(-lhs.a(), rhs.b(), lhs.b(), rhs.a(), -lhs.c(), rhs.d(), lhs.d(), rhs.c()) / n,
+                dot4(-lhs.a(), rhs.c(), lhs.c(), rhs.a(), -lhs.d(), rhs.b(), lhs.b(), rhs.d()) / n,
+                dot4(-lhs.a(), rhs.d(), lhs.d(), rhs.a(), -lhs.b(), rhs.c(), lhs.c(), rhs.b()) / n};
+    }
+
+}
+
+#endif // QUATER_FMA_H
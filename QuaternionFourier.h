@@ -0,0 +1,418 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_FOURIER_H
+#define QUATER_FOURIER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionParallel.h"
+
+/**
+ * Side of the exponential kernel in the quaternion Fourier transform:
+ * Left is sum exp(-mu w x) f(x), Right is sum f(x) exp(-mu w x).
+ */
+enum class QftSide {
+    Left,
+    Right
+};
+
+namespace quaternion_fourier_detail {
+
+    constexpr std::size_t grain = 1 << 14;
+    constexpr std::size_t column_batch = 8;
+
+    /**
+     * exp(-i pi num / den), the angle reduced in long double
+     */
+    template<typename T>
+    void twiddle(std::size_t num, std::size_t den, T& re, T& im) {
+        const long double pi = 3.141592653589793238462643383279502884L;
+        long double angle = -pi * static_cast<long double>(num) / static_cast<long double>(den);
+        re = static_cast<T>(std::cos(angle));
+        im = static_cast<T>(std::sin(angle));
+    }
+
+    /**
+     * Unnormalized complex FFT of a fixed size on split real and imaginary
+     * arrays, so that the butterflies vectorize: iterative radix-2 for
+     * powers of two, Bluestein's chirp-z through a power of two otherwise.
+     * Immutable after construction, shared by threads.
+     */
+    template<typename T>
+    class fft_plan {
+
+    private:
+
+        std::size_t n = 0;
+        std::vector<T> wr, wi;              ///< exp(-i pi k / h), k < h, the stage of half size h at h - 1
+        std::vector<std::uint32_t> bitrev;
+        std::vector<T> chirp_re, chirp_im;   ///< exp(-i pi k^2 / n)
+        std::vector<T> kernel_re, kernel_im; ///< FFT of the conjugate chirp, circularly extended
+        std::shared_ptr<const fft_plan> sub;
+
+        void radix2(T* re, T* im, bool inverse) const {
+            for (std::size_t i = 0; i < this->n; ++i) {
+                std::size_t j = this->bitrev[i];
+                if (i < j) {
+                    std::swap(re[i], re[j]);
+                    std::swap(im[i], im[j]);
+                }
+            }
+            const T sign = inverse ? static_cast<T>(-1) : static_cast<T>(1);
+            std::size_t h = 1;
+            if (this->n >= 4) {
+                // the first two stages fused, their twiddles are 1 and -+i
+                for (std::size_t i = 0; i < this->n; i += 4) {
+                    T r0 = re[i] + re[i + 1], i0 = im[i] + im[i + 1];
+                    T r1 = re[i] - re[i + 1], i1 = im[i] - im[i + 1];
+                    T r2 = re[i + 2] + re[i + 3], i2 = im[i + 2] + im[i + 3];
+                    T r3 = sign * (im[i + 2] - im[i + 3]), i3 = sign * (re[i + 3] - re[i + 2]);
+                    re[i] = r0 + r2;
+                    im[i] = i0 + i2;
+                    re[i + 1] = r1 + r3;
+                    im[i + 1] = i1 + i3;
+                    re[i + 2] = r0 - r2;
+                    im[i + 2] = i0 - i2;
+                    re[i + 3] = r1 - r3;
+                    im[i + 3] = i1 - i3;
+                }
+                h = 4;
+            }
+            for (; h < this->n; h <<= 1) {
+                const T* twr = this->wr.data() + h - 1;
+                const T* twi = this->wi.data() + h - 1;
+                for (std::size_t i = 0; i < this->n; i += 2 * h) {
+                    T* ar = re + i;
+                    T* ai = im + i;
+                    T* br = re + i + h;
+                    T* bi = im + i + h;
+                    for (std::size_t k = 0; k < h; ++k) {
+                        T w_r = twr[k], w_i = sign * twi[k];
+                        T tr = (br[k] * w_r) - (bi[k] * w_i);
+                        T ti = (br[k] * w_i) + (bi[k] * w_r);
+                        br[k] = ar[k] - tr;
+                        bi[k] = ai[k] - ti;
+                        ar[k] = ar[k] + tr;
+                        ai[k] = ai[k] + ti;
+                    }
+                }
+            }
+        }
+
+    public:
+
+        fft_plan() = default;
+
+        explicit fft_plan(std::size_t size) : n(size) {
+            if ((size & (size - 1)) == 0) {
+                unsigned bits = 0;
+                while ((std::size_t(1) << bits) < size) {
+                    ++bits;
+                }
+                this->wr.resize(size > 1 ? size - 1 : 0);
+                this->wi.resize(this->wr.size());
+                for (std::size_t h = 1; h < size; h <<= 1) {
+                    for (std::size_t k = 0; k < h; ++k) {
+                        twiddle(k, h, this->wr[h - 1 + k], this->wi[h - 1 + k]);
+                    }
+                }
+                this->bitrev.resize(size);
+                for (std::size_t i = 0; i < size; ++i) {
+                    std::size_t r = 0;
+                    for (unsigned b = 0; b < bits; ++b) {
+                        r |= ((i >> b) & 1) << (bits - 1 - b);
+                    }
+                    this->bitrev[i] = static_cast<std::uint32_t>(r);
+                }
+                return;
+            }
+            std::size_t m = 1;
+            while (m < 2 * size - 1) {
+                m <<= 1;
+            }
+            auto plan = std::make_shared<fft_plan>(m);
+            this->chirp_re.resize(size);
+            this->chirp_im.resize(size);
+            for (std::size_t k = 0; k < size; ++k) {
+                // k^2 mod 2n keeps the angle small for large k
+                twiddle((k * k) % (2 * size), size, this->chirp_re[k], this->chirp_im[k]);
+            }
+            this->kernel_re.assign(m, static_cast<T>(0));
+            this->kernel_im.assign(m, static_cast<T>(0));
+            for (std::size_t k = 0; k < size; ++k) {
+                this->kernel_re[k] = this->kernel_re[(m - k) % m] = this->chirp_re[k];
+                this->kernel_im[k] = this->kernel_im[(m - k) % m] = -this->chirp_im[k];
+            }
+            plan->radix2(this->kernel_re.data(), this->kernel_im.data(), false);
+            this->sub = plan;
+        }
+
+        std::size_t size() const noexcept {
+            return this->n;
+        }
+
+        /**
+         * Scratch elements needed by transform
+         */
+        std::size_t workspace() const noexcept {
+            return this->sub ? 2 * this->sub->n : 0;
+        }
+
+        /**
+         * In place: x_k = sum x_j exp(-+2 pi i j k / n), + when inverse, unscaled
+         */
+        void transform(T* re, T* im, bool inverse, T* work) const {
+            if (!this->sub) {
+                this->radix2(re, im, inverse);
+                return;
+            }
+            // the inverse transform is conj(forward(conj(x)))
+            const std::size_t m = this->sub->n;
+            const T sign = inverse ? static_cast<T>(-1) : static_cast<T>(1);
+            T* xr = work;
+            T* xi = work + m;
+            for (std::size_t k = 0; k < this->n; ++k) {
+                T r = re[k], i = sign * im[k];
+                xr[k] = (r * this->chirp_re[k]) - (i * this->chirp_im[k]);
+                xi[k] = (r * this->chirp_im[k]) + (i * this->chirp_re[k]);
+            }
+            std::fill(xr + this->n, xr + m, static_cast<T>(0));
+            std::fill(xi + this->n, xi + m, static_cast<T>(0));
+            this->sub->radix2(xr, xi, false);
+            for (std::size_t k = 0; k < m; ++k) {
+                T r = xr[k], i = xi[k];
+                xr[k] = (r * this->kernel_re[k]) - (i * this->kernel_im[k]);
+                xi[k] = (r * this->kernel_im[k]) + (i * this->kernel_re[k]);
+            }
+            this->sub->radix2(xr, xi, true);
+            const T scale = static_cast<T>(1) / static_cast<T>(m);
+            for (std::size_t k = 0; k < this->n; ++k) {
+                re[k] = ((xr[k] * this->chirp_re[k]) - (xi[k] * this->chirp_im[k])) * scale;
+                im[k] = sign * ((xr[k] * this->chirp_im[k]) + (xi[k] * this->chirp_re[k])) * scale;
+            }
+        }
+
+    };
+
+}
+
+/**
+ * Quaternion Fourier transform of a 1D signal or a row-major 2D image,
+ * with a pure unit quaternion axis mu (i by default, (i + j + k) / sqrt(3)
+ * is the usual choice for RGB images).
+ * With mu = i and the Cayley-Dickson split f = z1 + z2 j of complex_a()
+ * and complex_b(), exp(-i w) commutes with z1, z2 and j exp(-i w) is
+ * exp(i w) j, so
+ *     left:  F = FFT(z1) + FFT(z2) j
+ *     right: F = FFT(z1) + FFT*(z2) j, FFT* with the opposite sign.
+ * Another axis is reduced to i by the rotation r mapping mu onto i:
+ * QFT_mu(f) = r^-1 QFT_i(r f r^-1) r.
+ * The plan holds the twiddles and chirps of both dimensions and is reused
+ * across calls. Rows, then batches of columns, are split across threads.
+ * The inverse is scaled by 1 / size().
+ */
+template<typename T>
+class QftPlan {
+
+private:
+
+    std::size_t w = 0;
+    std::size_t h = 0;
+    quaternion_fourier_detail::fft_plan<T> rows;
+    quaternion_fourier_detail::fft_plan<T> cols;
+    Quaternion<T> basis;
+    bool rotated = false;
+
+    void init(const Quaternion<T>& axis) {
+        if (this->w == 0 || this->h == 0) {
+            throw std::invalid_argument("QftPlan: empty transform");
+        }
+        T length = std::abs(axis);
+        if (axis.a() != static_cast<T>(0) || !(length > static_cast<T>(0))) {
+            throw std::invalid_argument("QftPlan: axis must be a pure quaternion");
+        }
+        Quaternion<T> mu = axis / length;
+        // rotation taking mu onto i: half way quaternion, or j when mu = -i
+        Quaternion<T> half(static_cast<T>(1) + mu.b(), static_cast<T>(0), mu.d(), -mu.c());
+        this->basis = std::norm(half) > static_cast<T>(1e-8) ? normalized(half) : Quaternion<T>(0, 0, 1, 0);
+        this->rotated = !(mu.b() == static_cast<T>(1));
+    }
+
+    Quaternion<T> enter(const Quaternion<T>& quat) const {
+        return this->rotated ? this->basis * quat * std::conj(this->basis) : quat;
+    }
+
+    Quaternion<T> leave(const Quaternion<T>& quat, T scale) const {
+        return (this->rotated ? std::conj(this->basis) * quat * this->basis : quat) * scale;
+    }
+
+    void run(const Quaternion<T>* in, Quaternion<T>* out, QftSide side, bool inverse) const {
+        QUATERNION_TIMED_KERNEL(inverse ? "qft inverse" : "qft forward", this->size());
+        const bool inverse_a = inverse;
+        const bool inverse_b = side == QftSide::Left ? inverse : !inverse;
+        const T scale = inverse ? static_cast<T>(1) / static_cast<T>(this->size()) : static_cast<T>(1);
+        const bool last_pass = this->h == 1;
+        std::size_t row_grain = std::max<std::size_t>(1, quaternion_fourier_detail::grain / this->w);
+        quaternion_parallel::parallel_for(this->h, row_grain, [&](std::size_t first, std::size_t last) {
+            std::vector<T> scratch(4 * this->w + this->rows.workspace());
+            T* ar = scratch.data();
+            T* ai = ar + this->w;
+            T* br = ai + this->w;
+            T* bi = br + this->w;
+            for (std::size_t y = first; y < last; ++y) {
+                const Quaternion<T>* src = in + y * this->w;
+                Quaternion<T>* dst = out + y * this->w;
+                for (std::size_t x = 0; x < this->w; ++x) {
+                    Quaternion<T> q = this->enter(src[x]);
+                    ar[x] = q.a();
+                    ai[x] = q.b();
+                    br[x] = q.c();
+                    bi[x] = q.d();
+                }
+                this->rows.transform(ar, ai, inverse_a, bi + this->w);
+                this->rows.transform(br, bi, inverse_b, bi + this->w);
+                for (std::size_t x = 0; x < this->w; ++x) {
+                    Quaternion<T> q(ar[x], ai[x], br[x], bi[x]);
+                    dst[x] = last_pass ? this->leave(q, scale) : q;
+                }
+            }
+        });
+        if (last_pass) {
+            return;
+        }
+        const std::size_t batch = quaternion_fourier_detail::column_batch;
+        std::size_t column_grain = std::max<std::size_t>(batch, quaternion_fourier_detail::grain / this->h);
+        quaternion_parallel::parallel_for(this->w, column_grain, [&](std::size_t first, std::size_t last) {
+            const std::size_t stride = batch * this->h;
+            std::vector<T> scratch(4 * stride + this->cols.workspace());
+            T* ar = scratch.data();
+            T* ai = ar + stride;
+            T* br = ai + stride;
+            T* bi = br + stride;
+            for (std::size_t x0 = first; x0 < last; x0 += batch) {
+                std::size_t count = std::min(batch, last - x0);
+                for (std::size_t y = 0; y < this->h; ++y) {
+                    const Quaternion<T>* src = out + y * this->w + x0;
+                    for (std::size_t c = 0; c < count; ++c) {
+                        std::size_t k = c * this->h + y;
+                        ar[k] = src[c].a();
+                        ai[k] = src[c].b();
+                        br[k] = src[c].c();
+                        bi[k] = src[c].d();
+                    }
+                }
+                for (std::size_t c = 0; c < count; ++c) {
+                    std::size_t k = c * this->h;
+                    this->cols.transform(ar + k, ai + k, inverse_a, bi + stride);
+                    this->cols.transform(br + k, bi + k, inverse_b, bi + stride);
+                }
+                for (std::size_t y = 0; y < this->h; ++y) {
+                    Quaternion<T>* dst = out + y * this->w + x0;
+                    for (std::size_t c = 0; c < count; ++c) {
+                        std::size_t k = c * this->h + y;
+                        dst[c] = this->leave(Quaternion<T>(ar[k], ai[k], br[k], bi[k]), scale);
+                    }
+                }
+            }
+        });
+    }
+
+public:
+
+    /**
+     * 1D transform of size samples
+     */
+    explicit QftPlan(std::size_t size, const Quaternion<T>& axis = Quaternion<T>(0, 1, 0, 0))
+        : w(size), h(1), rows(size), cols(1) {
+        this->init(axis);
+    }
+
+    /**
+     * 2D transform of a width x height row-major image, exp(-mu (u x / width + v y / height))
+     */
+    QftPlan(std::size_t width, std::size_t height, const Quaternion<T>& axis = Quaternion<T>(0, 1, 0, 0))
+        : w(width), h(height), rows(width), cols(height) {
+        this->init(axis);
+    }
+
+    std::size_t width() const noexcept {
+        return this->w;
+    }
+
+    std::size_t height() const noexcept {
+        return this->h;
+    }
+
+    std::size_t size() const noexcept {
+        return this->w * this->h;
+    }
+
+    /**
+     * Forward transform of size() quaternions, in and out may be the same buffer
+     */
+    void forward(const Quaternion<T>* in, Quaternion<T>* out, QftSide side = QftSide::Left) const {
+        this->run(in, out, side, false);
+    }
+
+    /**
+     * Inverse of forward with the same side
+     */
+    void inverse(const Quaternion<T>* in, Quaternion<T>* out, QftSide side = QftSide::Left) const {
+        this->run(in, out, side, true);
+    }
+
+    std::vector<Quaternion<T>> forward(const std::vector<Quaternion<T>>& in, QftSide side = QftSide::Left) const {
+        if (in.size() != this->size()) {
+            throw std::length_error("QftPlan: size mismatch");
+        }
+        std::vector<Quaternion<T>> out(in.size());
+        this->run(in.data(), out.data(), side, false);
+        return out;
+    }
+
+    std::vector<Quaternion<T>> inverse(const std::vector<Quaternion<T>>& in, QftSide side = QftSide::Left) const {
+        if (in.size() != this->size()) {
+            throw std::length_error("QftPlan: size mismatch");
+        }
+        std::vector<Quaternion<T>> out(in.size());
+        this->run(in.data(), out.data(), side, true);
+        return out;
+    }
+
+};
+
+#endif // QUATER_FOURIER_H
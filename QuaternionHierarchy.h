@@ -0,0 +1,315 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_HIERARCHY_H
+#define QUATER_HIERARCHY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionParallel.h"
+
+namespace quaternion_hierarchy_detail {
+
+    constexpr std::size_t grain = 1 << 12;
+
+    using range = std::pair<std::uint32_t, std::uint32_t>;
+
+    /**
+     * Parent slot and end of the subtree, read together
+     */
+    struct link {
+        std::uint32_t parent;
+        std::uint32_t end;
+    };
+
+}
+
+/**
+ * Flat rotation hierarchy: world[n] = world[parent[n]] * local[n], with
+ * world = local for roots. Nodes are stored in depth-first order so every
+ * subtree is a contiguous run starting at its root, and a parent always
+ * precedes its children. set_local only marks the node, update() then
+ * recomposes the marked subtrees and nothing else. Independent subtrees
+ * are recomposed in parallel.
+ * Node ids are the indices given at construction, storage slots are an
+ * internal detail exposed by order() for bulk access.
+ */
+template<typename T>
+class QuaternionHierarchy {
+
+public:
+
+    static constexpr std::size_t root = std::numeric_limits<std::size_t>::max(); ///< parent of a root node
+
+private:
+
+    static constexpr std::uint32_t none = std::numeric_limits<std::uint32_t>::max();
+
+    std::vector<quaternion_hierarchy_detail::link> links; ///< by slot, parent none for roots
+    std::vector<std::uint32_t> slots;   ///< by node
+    std::vector<std::uint32_t> nodes;   ///< by slot
+    std::vector<Quaternion<T>> locals;  ///< by slot
+    std::vector<Quaternion<T>> worlds;  ///< by slot
+    std::vector<std::uint64_t> marked;  ///< bit per slot
+    std::vector<std::uint32_t> dirty;   ///< marked slots
+
+    void compose(std::uint32_t slot) {
+        std::uint32_t p = this->links[slot].parent;
+        this->worlds[slot] = p == none ? this->locals[slot] : this->worlds[p] * this->locals[slot];
+    }
+
+    /**
+     * Recompose disjoint subtrees. Subtrees larger than a share of the work
+     * get their root composed serially and are replaced by the subtrees of
+     * its children, the remaining runs are then split across threads.
+     */
+    void recompose(const std::vector<quaternion_hierarchy_detail::range>& ranges) {
+        using quaternion_hierarchy_detail::range;
+        std::size_t total = 0;
+        for (const range& r : ranges) {
+            total += r.second - r.first;
+        }
+        QUATERNION_TIMED_KERNEL("hierarchy update", total);
+        std::size_t split = std::max(quaternion_hierarchy_detail::grain, total / (4 * quaternion_parallel::thread_count()));
+        std::vector<range> work;
+        std::vector<range> pending(ranges.rbegin(), ranges.rend());
+        std::vector<range> children;
+        while (!pending.empty()) {
+            range r = pending.back();
+            pending.pop_back();
+            if (r.second - r.first <= split) {
+                work.push_back(r);
+                continue;
+            }
+            this->compose(r.first);
+            children.clear();
+            for (std::uint32_t c = r.first + 1; c < r.second; c = this->links[c].end) {
+                children.emplace_back(c, this->links[c].end);
+            }
+            pending.insert(pending.end(), children.rbegin(), children.rend());
+        }
+        std::vector<std::size_t> offsets(work.size() + 1, 0);
+        for (std::size_t k = 0; k < work.size(); ++k) {
+            offsets[k + 1] = offsets[k] + (work[k].second - work[k].first);
+        }
+        std::size_t size = offsets.back();
+        std::size_t blocks = quaternion_parallel::block_count(size, quaternion_hierarchy_detail::grain);
+        quaternion_parallel::run_blocks(blocks, [&](std::size_t b) {
+            auto bounds = quaternion_parallel::block_range(size, blocks, b);
+            auto first = std::lower_bound(offsets.begin(), offsets.end() - 1, bounds.first) - offsets.begin();
+            auto last = std::lower_bound(offsets.begin(), offsets.end() - 1, bounds.second) - offsets.begin();
+            for (auto k = first; k < last; ++k) {
+                // small scattered subtrees are latency bound, fetch ahead
+                if (k + 8 < last) {
+                    std::uint32_t ahead = work[k + 8].first;
+                    __builtin_prefetch(&this->links[ahead]);
+                    __builtin_prefetch(&this->locals[ahead]);
+                    __builtin_prefetch(&this->worlds[ahead], 1);
+                }
+                if (k + 4 < last) {
+                    std::uint32_t p = this->links[work[k + 4].first].parent;
+                    if (p != none) {
+                        __builtin_prefetch(&this->worlds[p]);
+                    }
+                }
+                for (std::uint32_t slot = work[k].first; slot < work[k].second; ++slot) {
+                    this->compose(slot);
+                }
+            }
+        });
+    }
+
+public:
+
+    QuaternionHierarchy() = default;
+
+    /**
+     * Hierarchy of parents.size() nodes, parents[n] is root or a node
+     * before n. World rotations are composed right away.
+     */
+    QuaternionHierarchy(const std::vector<std::size_t>& parents, const std::vector<Quaternion<T>>& locals) {
+        std::size_t size = parents.size();
+        if (locals.size() != size) {
+            throw std::invalid_argument("QuaternionHierarchy: parents and locals size mismatch");
+        }
+        if (size >= none) {
+            throw std::length_error("QuaternionHierarchy: too many nodes");
+        }
+        std::vector<std::uint32_t> subtree(size, 1);
+        for (std::size_t n = size; n-- > 0;) {
+            if (parents[n] != root) {
+                if (parents[n] >= n) {
+                    throw std::invalid_argument("QuaternionHierarchy: parent after child");
+                }
+                subtree[parents[n]] += subtree[n];
+            }
+        }
+        // depth first slots: a child takes the next free slot of its parent
+        std::vector<std::uint32_t> cursor(size);
+        this->slots.resize(size);
+        std::uint32_t next_root = 0;
+        for (std::size_t n = 0; n < size; ++n) {
+            std::uint32_t& from = parents[n] == root ? next_root : cursor[parents[n]];
+            this->slots[n] = from;
+            from += subtree[n];
+            cursor[n] = this->slots[n] + 1;
+        }
+        this->links.resize(size);
+        this->nodes.resize(size);
+        this->locals.resize(size);
+        this->worlds.resize(size);
+        this->marked.assign((size + 63) / 64, 0);
+        for (std::size_t n = 0; n < size; ++n) {
+            std::uint32_t slot = this->slots[n];
+            this->links[slot] = {parents[n] == root ? none : this->slots[parents[n]], slot + subtree[n]};
+            this->nodes[slot] = static_cast<std::uint32_t>(n);
+            this->locals[slot] = locals[n];
+        }
+        this->update_all();
+    }
+
+    std::size_t size() const noexcept {
+        return this->nodes.size();
+    }
+
+    std::size_t parent(std::size_t node) const {
+        std::uint32_t p = this->links[this->slots[node]].parent;
+        return p == none ? root : this->nodes[p];
+    }
+
+    /**
+     * Number of nodes in the subtree of node, itself included
+     */
+    std::size_t subtree_size(std::size_t node) const {
+        std::uint32_t slot = this->slots[node];
+        return this->links[slot].end - slot;
+    }
+
+    const Quaternion<T>& local(std::size_t node) const {
+        return this->locals[this->slots[node]];
+    }
+
+    /**
+     * World rotation as of the last update
+     */
+    const Quaternion<T>& world(std::size_t node) const {
+        return this->worlds[this->slots[node]];
+    }
+
+    /**
+     * Change a local rotation, the subtree is recomposed by the next update
+     */
+    void set_local(std::size_t node, const Quaternion<T>& quat) {
+        std::uint32_t slot = this->slots[node];
+        this->locals[slot] = quat;
+        std::uint64_t bit = std::uint64_t(1) << (slot % 64);
+        if (!(this->marked[slot / 64] & bit)) {
+            this->marked[slot / 64] |= bit;
+            this->dirty.push_back(slot);
+        }
+    }
+
+    /**
+     * Number of nodes changed since the last update
+     */
+    std::size_t dirty_count() const noexcept {
+        return this->dirty.size();
+    }
+
+    /**
+     * Recompose the subtrees of the nodes changed since the last update
+     */
+    void update() {
+        if (this->dirty.empty()) {
+            return;
+        }
+        std::vector<quaternion_hierarchy_detail::range> ranges;
+        std::uint32_t covered = 0;
+        auto visit = [&](std::uint32_t slot) {
+            if (slot >= covered) {
+                ranges.emplace_back(slot, this->links[slot].end);
+                covered = this->links[slot].end;
+            }
+        };
+        if (this->dirty.size() * 64 < this->marked.size()) {
+            std::sort(this->dirty.begin(), this->dirty.end());
+            for (std::uint32_t slot : this->dirty) {
+                visit(slot);
+            }
+        } else {
+            // dense: walking the bitmap in slot order is cheaper than sorting
+            for (std::size_t w = 0; w < this->marked.size(); ++w) {
+                for (std::uint64_t bits = this->marked[w]; bits != 0; bits &= bits - 1) {
+                    visit(static_cast<std::uint32_t>(w * 64 + __builtin_ctzll(bits)));
+                }
+            }
+        }
+        std::fill(this->marked.begin(), this->marked.end(), 0);
+        this->dirty.clear();
+        this->recompose(ranges);
+    }
+
+    /**
+     * Recompose every world rotation
+     */
+    void update_all() {
+        std::vector<quaternion_hierarchy_detail::range> ranges;
+        for (std::uint32_t slot = 0; slot < this->size(); slot = this->links[slot].end) {
+            ranges.emplace_back(slot, this->links[slot].end);
+        }
+        std::fill(this->marked.begin(), this->marked.end(), 0);
+        this->dirty.clear();
+        this->recompose(ranges);
+    }
+
+    /**
+     * Node ids in storage order, the order of local_data() and world_data()
+     */
+    const std::vector<std::uint32_t>& order() const noexcept {
+        return this->nodes;
+    }
+
+    const Quaternion<T>* local_data() const noexcept {
+        return this->locals.data();
+    }
+
+    const Quaternion<T>* world_data() const noexcept {
+        return this->worlds.data();
+    }
+
+};
+
+#endif // QUATER_HIERARCHY_H
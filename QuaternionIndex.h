@@ -0,0 +1,286 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_INDEX_H
+#define QUATER_INDEX_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionParallel.h"
+#include "QuaternionSpan.h"
+
+namespace quaternion_index_detail {
+
+    constexpr std::size_t leaf_size = 16;
+    constexpr std::size_t build_grain = 1 << 15;
+    constexpr std::size_t query_grain = 64;
+
+    /**
+     * Chordal distance on the rotation group, min(|q - r|, |q + r|) for unit
+     * inputs. It is a metric on S^3 with q and -q identified, squared here.
+     */
+    template<typename T>
+    inline T chord2(const Quaternion<T>& q, const Quaternion<T>& r) {
+        T s = dot(q, r) < 0 ? static_cast<T>(-1) : static_cast<T>(1);
+        T a = q.a() - (s * r.a()), b = q.b() - (s * r.b()), c = q.c() - (s * r.c()), d = q.d() - (s * r.d());
+        return (a * a) + (b * b) + (c * c) + (d * d);
+    }
+
+    template<typename T>
+    inline T chord_to_angle(T chord) {
+        return 4 * std::asin(std::min(chord / 2, static_cast<T>(1)));
+    }
+
+    template<typename T>
+    inline T angle_to_chord(T angle) {
+        const T pi = static_cast<T>(3.14159265358979323846);
+        return 2 * std::sin(std::min(std::max(angle, static_cast<T>(0)), pi) / 4);
+    }
+
+}
+
+/**
+ * Rotation angle between the orientations of two unit quaternions, in
+ * [0, pi]. q and -q are the same orientation.
+ */
+template<typename T>
+T geodesic_angle(const Quaternion<T>& q, const Quaternion<T>& r) {
+    return quaternion_index_detail::chord_to_angle(std::sqrt(quaternion_index_detail::chord2(q, r)));
+}
+
+/**
+ * Search result: position of the reference quaternion and its geodesic angle
+ */
+template<typename T>
+struct QuaternionNeighbor {
+    std::size_t index;
+    T angle;
+};
+
+/**
+ * Nearest-neighbor index over unit quaternions as orientations.
+ *
+ * A vantage point tree under the chordal metric min(|q - r|, |q + r|),
+ * which folds the double cover and is monotone in the geodesic angle, so
+ * k-NN and radius queries by angle are exact. Every subtree occupies a
+ * contiguous range of the reordered points: the vantage point first, then
+ * the inside half (distance <= radius) and the outside half. Ranges of at
+ * most 16 points are scanned linearly.
+ */
+template<typename T = double>
+class QuaternionIndex {
+
+private:
+
+    std::vector<Quaternion<T>> points;
+    std::vector<std::size_t> ids;
+    std::vector<T> radius;
+
+    struct entry {
+        Quaternion<T> point;
+        std::size_t id;
+        T dist;
+    };
+
+    void build(std::vector<entry>& entries, std::size_t first, std::size_t last, std::size_t depth) {
+        if (last - first <= quaternion_index_detail::leaf_size) {
+            return;
+        }
+        std::swap(entries[first], entries[first + (last - first) / 2]);
+        for (std::size_t i = first + 1; i < last; ++i) {
+            entries[i].dist = quaternion_index_detail::chord2(entries[first].point, entries[i].point);
+        }
+        std::size_t mid = first + 1 + (last - first - 1) / 2;
+        std::nth_element(entries.begin() + first + 1, entries.begin() + mid, entries.begin() + last, [](const entry& l, const entry& r) {
+            return l.dist < r.dist || (l.dist == r.dist && l.id < r.id);
+        });
+        this->radius[first] = std::sqrt(entries[mid].dist);
+        if (last - first > quaternion_index_detail::build_grain && (std::size_t(1) << depth) < quaternion_parallel::thread_count()) {
+            quaternion_parallel::run_blocks(2, [&](std::size_t b) {
+                b == 0 ? this->build(entries, first + 1, mid, depth + 1) : this->build(entries, mid, last, depth + 1);
+            });
+        } else {
+            this->build(entries, first + 1, mid, depth + 1);
+            this->build(entries, mid, last, depth + 1);
+        }
+    }
+
+    template<typename Visit>
+    void search(const Quaternion<T>& query, std::size_t first, std::size_t last, T& tau, Visit& visit) const {
+        if (last - first <= quaternion_index_detail::leaf_size) {
+            for (std::size_t i = first; i < last; ++i) {
+                T d = std::sqrt(quaternion_index_detail::chord2(query, this->points[i]));
+                if (d <= tau) {
+                    visit(i, d, tau);
+                }
+            }
+            return;
+        }
+        T d = std::sqrt(quaternion_index_detail::chord2(query, this->points[first]));
+        if (d <= tau) {
+            visit(first, d, tau);
+        }
+        std::size_t mid = first + 1 + (last - first - 1) / 2;
+        T mu = this->radius[first];
+        if (d < mu) {
+            if (d - tau <= mu) {
+                this->search(query, first + 1, mid, tau, visit);
+            }
+            if (d + tau >= mu) {
+                this->search(query, mid, last, tau, visit);
+            }
+        } else {
+            if (d + tau >= mu) {
+                this->search(query, mid, last, tau, visit);
+            }
+            if (d - tau <= mu) {
+                this->search(query, first + 1, mid, tau, visit);
+            }
+        }
+    }
+
+public:
+
+    using value_type = T; ///< value_type trait for STL compatibility
+
+    QuaternionIndex() = default;
+
+    /**
+     * Bulk build from reference quaternions, normalized on insertion.
+     * Neighbor indices refer to positions in refs. The upper levels are built in parallel.
+     */
+    explicit QuaternionIndex(QuaternionSpan<T> refs)
+        : points(refs.size()), ids(refs.size()), radius(refs.size()) {
+        std::vector<entry> entries(refs.size());
+        for (std::size_t i = 0; i < refs.size(); ++i) {
+            entries[i] = {normalized(refs[i]), i, static_cast<T>(0)};
+        }
+        this->build(entries, 0, refs.size(), 0);
+        for (std::size_t i = 0; i < refs.size(); ++i) {
+            this->points[i] = entries[i].point;
+            this->ids[i] = entries[i].id;
+        }
+    }
+
+    explicit QuaternionIndex(const std::vector<Quaternion<T>>& refs)
+        : QuaternionIndex(QuaternionSpan<T>(refs)) {}
+
+    std::size_t size() const noexcept {
+        return this->points.size();
+    }
+
+    bool empty() const noexcept {
+        return this->points.empty();
+    }
+
+    /**
+     * The k nearest orientations, closest first
+     */
+    std::vector<QuaternionNeighbor<T>> nearest(const Quaternion<T>& query, std::size_t k) const {
+        std::vector<QuaternionNeighbor<T>> result;
+        if (k == 0 || this->empty()) {
+            return result;
+        }
+        Quaternion<T> q = normalized(query);
+        std::priority_queue<std::pair<T, std::size_t>> heap;
+        T tau = std::numeric_limits<T>::infinity();
+        auto visit = [&](std::size_t i, T d, T& bound) {
+            heap.emplace(d, i);
+            if (heap.size() > k) {
+                heap.pop();
+            }
+            if (heap.size() == k) {
+                bound = heap.top().first;
+            }
+        };
+        this->search(q, 0, this->size(), tau, visit);
+        result.resize(heap.size());
+        for (std::size_t n = heap.size(); n > 0; --n) {
+            result[n - 1] = {this->ids[heap.top().second], quaternion_index_detail::chord_to_angle(heap.top().first)};
+            heap.pop();
+        }
+        return result;
+    }
+
+    /**
+     * Every orientation within max_angle radians of the query, closest first
+     */
+    std::vector<QuaternionNeighbor<T>> within(const Quaternion<T>& query, const T& max_angle) const {
+        std::vector<QuaternionNeighbor<T>> result;
+        if (this->empty()) {
+            return result;
+        }
+        Quaternion<T> q = normalized(query);
+        T tau = quaternion_index_detail::angle_to_chord(max_angle);
+        auto visit = [&](std::size_t i, T d, T&) {
+            result.push_back({this->ids[i], quaternion_index_detail::chord_to_angle(d)});
+        };
+        this->search(q, 0, this->size(), tau, visit);
+        std::sort(result.begin(), result.end(), [](const QuaternionNeighbor<T>& l, const QuaternionNeighbor<T>& r) {
+            return l.angle < r.angle || (l.angle == r.angle && l.index < r.index);
+        });
+        return result;
+    }
+
+    /**
+     * Batched k-NN, queries split across threads
+     */
+    std::vector<std::vector<QuaternionNeighbor<T>>> nearest(QuaternionSpan<T> queries, std::size_t k) const {
+        std::vector<std::vector<QuaternionNeighbor<T>>> result(queries.size());
+        quaternion_parallel::parallel_for(queries.size(), quaternion_index_detail::query_grain, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+                result[i] = this->nearest(queries[i], k);
+            }
+        });
+        return result;
+    }
+
+    /**
+     * Batched radius query, queries split across threads
+     */
+    std::vector<std::vector<QuaternionNeighbor<T>>> within(QuaternionSpan<T> queries, const T& max_angle) const {
+        std::vector<std::vector<QuaternionNeighbor<T>>> result(queries.size());
+        quaternion_parallel::parallel_for(queries.size(), quaternion_index_detail::query_grain, [&](std::size_t first, std::size_t last) {
+            for (std::size_t i = first; i < last; ++i) {
+                result[i] = this->within(queries[i], max_angle);
+            }
+        });
+        return result;
+    }
+
+};
+
+#endif // QUATER_INDEX_H
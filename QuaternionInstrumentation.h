@@ -0,0 +1,438 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+#ifndef QUATER_INSTRUMENTATION_H
+#define QUATER_INSTRUMENTATION_H
+
+/**
+ * Opt-in instrumentation. Define QUATERNION_INSTRUMENTATION to 1 to count
+ * quaternion operations per thread, trace the first non-finite result and
+ * time the batch kernels. When it is 0 (the default) every hook below
+ * expands to nothing and the generated code is unchanged.
+ */
+#ifndef QUATERNION_INSTRUMENTATION
+#define QUATERNION_INSTRUMENTATION 0
+#endif
+
+#if QUATERNION_INSTRUMENTATION
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace quaternion_instrumentation {
+
+    /**
+     * Kind of counted operation
+     */
+    enum class Operation {
+        Multiply,  ///< quaternion product
+        Divide,    ///< division by a quaternion
+        Normalize, ///< normalized() and fast_normalized()
+        Inverse    ///< inverse()
+    };
+
+    constexpr std::size_t operation_count = 4;
+
+    inline const char* operation_name(Operation op) noexcept {
+        switch (op) {
+            case Operation::Multiply: return "mul";
+            case Operation::Divide: return "div";
+            case Operation::Normalize: return "normalize";
+            case Operation::Inverse: return "inverse";
+        }
+        return "unknown";
+    }
+
+    /**
+     * Where the first non-finite result appeared: the operation, the
+     * innermost active scope or kernel (nullptr outside any), the thread
+     * and the 1-based position of the operation among those it counted.
+     */
+    struct Origin {
+        bool recorded = false;
+        Operation operation = Operation::Multiply;
+        const char* scope = nullptr;
+        std::thread::id thread;
+        std::uint64_t sequence = 0;
+    };
+
+    /**
+     * Accumulated time of a batch kernel
+     */
+    struct KernelTiming {
+        std::uint64_t calls = 0;
+        std::uint64_t elements = 0;
+        std::chrono::nanoseconds total{0};
+    };
+
+    /**
+     * Counters summed over every thread, live and exited
+     */
+    struct Report {
+        std::array<std::uint64_t, operation_count> operations = {};
+        std::uint64_t zero_divisions = 0;
+        std::uint64_t non_finite = 0;
+        Origin first_non_finite;
+        std::map<std::string, KernelTiming> kernels;
+
+        std::uint64_t count(Operation op) const noexcept {
+            return this->operations[static_cast<std::size_t>(op)];
+        }
+    };
+
+    /**
+     * Called at the end of every timed kernel, in addition to the built-in
+     * accumulation. Must be thread safe: kernels run on worker threads too.
+     */
+    using timing_hook = void (*)(const char* kernel, std::size_t elements, std::chrono::nanoseconds elapsed);
+
+    namespace detail {
+
+        /**
+         * Per-thread counters. Only the owning thread writes them, other
+         * threads read them for a snapshot, hence relaxed atomics with a
+         * plain load and store instead of a locked increment.
+         */
+        struct ThreadCounters {
+            std::array<std::atomic<std::uint64_t>, operation_count> operations = {};
+            std::atomic<std::uint64_t> zero_divisions{0};
+            std::atomic<std::uint64_t> non_finite{0};
+            std::atomic<std::uint64_t> sequence{0};
+        };
+
+        inline void bump(std::atomic<std::uint64_t>& counter, std::uint64_t amount = 1) noexcept {
+            counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+        }
+
+        inline void add(Report& report, const ThreadCounters& counters) noexcept {
+            for (std::size_t k = 0; k < operation_count; ++k) {
+                report.operations[k] += counters.operations[k].load(std::memory_order_relaxed);
+            }
+            report.zero_divisions += counters.zero_divisions.load(std::memory_order_relaxed);
+            report.non_finite += counters.non_finite.load(std::memory_order_relaxed);
+        }
+
+        struct Registry {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ThreadCounters>> threads;
+            Report retired;
+            std::atomic<bool> has_origin{false};
+            std::atomic<timing_hook> hook{nullptr};
+
+            std::shared_ptr<ThreadCounters> attach() {
+                auto counters = std::make_shared<ThreadCounters>();
+                std::lock_guard<std::mutex> lock(this->mutex);
+                this->threads.push_back(counters);
+                return counters;
+            }
+
+            /**
+             * Fold the counters of an exiting thread into the totals, so
+             * short-lived threads do not pile up.
+             */
+            void detach(const std::shared_ptr<ThreadCounters>& counters) {
+                std::lock_guard<std::mutex> lock(this->mutex);
+                add(this->retired, *counters);
+                this->threads.erase(std::remove(this->threads.begin(), this->threads.end(), counters), this->threads.end());
+            }
+        };
+
+        inline Registry& registry() {
+            static Registry instance;
+            return instance;
+        }
+
+        struct ThreadSlot {
+            std::shared_ptr<ThreadCounters> counters = registry().attach();
+
+            ~ThreadSlot() {
+                registry().detach(this->counters);
+            }
+        };
+
+        inline ThreadCounters& local() {
+            thread_local ThreadSlot slot;
+            return *slot.counters;
+        }
+
+        inline const char*& current_scope() noexcept {
+            thread_local const char* scope = nullptr;
+            return scope;
+        }
+
+        inline void record_origin(Operation op) {
+            Registry& reg = registry();
+            if (reg.has_origin.load(std::memory_order_relaxed)) {
+                return;
+            }
+            std::lock_guard<std::mutex> lock(reg.mutex);
+            if (reg.has_origin.load(std::memory_order_relaxed)) {
+                return;
+            }
+            Origin& origin = reg.retired.first_non_finite;
+            origin.recorded = true;
+            origin.operation = op;
+            origin.scope = current_scope();
+            origin.thread = std::this_thread::get_id();
+            origin.sequence = local().sequence.load(std::memory_order_relaxed);
+            reg.has_origin.store(true, std::memory_order_relaxed);
+        }
+
+        template<typename T>
+        bool finite(const T& value) noexcept {
+            return std::isfinite(value.a()) && std::isfinite(value.b()) && std::isfinite(value.c()) && std::isfinite(value.d());
+        }
+
+    }
+
+    /**
+     * Count n operations of a kind on the calling thread.
+     *
+     * The hooks run inside noexcept operators, so none of them may throw:
+     * when the first operation of a thread cannot allocate its counters, or
+     * the registry lock fails, the event is dropped instead.
+     */
+    inline void count(Operation op, std::uint64_t n = 1) noexcept {
+        try {
+            detail::ThreadCounters& counters = detail::local();
+            detail::bump(counters.operations[static_cast<std::size_t>(op)], n);
+            detail::bump(counters.sequence, n);
+        } catch (...) {
+        }
+    }
+
+    /**
+     * Count a division by (or normalization of) a zero-norm quaternion
+     */
+    template<typename T>
+    void check_divisor(const T& norm) noexcept {
+        if (norm == static_cast<T>(0)) {
+            try {
+                detail::bump(detail::local().zero_divisions);
+            } catch (...) {
+            }
+        }
+    }
+
+    /**
+     * Count an operation and check its result for NaN and infinity
+     */
+    template<typename Q>
+    void record(Operation op, const Q& result) noexcept {
+        count(op);
+        if (!detail::finite(result)) {
+            try {
+                detail::bump(detail::local().non_finite);
+                detail::record_origin(op);
+            } catch (...) {
+            }
+        }
+    }
+
+    /**
+     * Label the operations of the current thread until destruction, the
+     * label is reported as the origin of a non-finite result. Scopes nest.
+     */
+    class Scope {
+
+    private:
+
+        const char* previous;
+
+    public:
+
+        explicit Scope(const char* name) noexcept
+            : previous(detail::current_scope()) {
+            detail::current_scope() = name;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+        ~Scope() {
+            detail::current_scope() = this->previous;
+        }
+
+    };
+
+    /**
+     * Time a batch kernel, also a Scope with the kernel name
+     */
+    class KernelTimer {
+
+    private:
+
+        Scope scope;
+        const char* name;
+        std::size_t elements;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+
+        KernelTimer(const char* name, std::size_t elements)
+            : scope(name), name(name), elements(elements), start(std::chrono::steady_clock::now()) {}
+
+        KernelTimer(const KernelTimer&) = delete;
+        KernelTimer& operator=(const KernelTimer&) = delete;
+
+        ~KernelTimer() {
+            auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - this->start);
+            detail::Registry& reg = detail::registry();
+            try {
+                std::lock_guard<std::mutex> lock(reg.mutex);
+                KernelTiming& timing = reg.retired.kernels[this->name];
+                timing.calls += 1;
+                timing.elements += this->elements;
+                timing.total += elapsed;
+            } catch (...) {
+                // a destructor must not throw, the timing is dropped
+            }
+            if (timing_hook hook = reg.hook.load()) {
+                hook(this->name, this->elements, elapsed);
+            }
+        }
+
+    };
+
+    /**
+     * Install a timing hook, nullptr removes it. Returns the previous one.
+     */
+    inline timing_hook set_timing_hook(timing_hook hook) noexcept {
+        return detail::registry().hook.exchange(hook);
+    }
+
+    /**
+     * Current totals over all threads. Counters of threads still running
+     * are read without stopping them.
+     */
+    inline Report snapshot() {
+        detail::Registry& reg = detail::registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        Report report = reg.retired;
+        for (const auto& counters : reg.threads) {
+            detail::add(report, *counters);
+        }
+        return report;
+    }
+
+    /**
+     * Zero every counter, forget the non-finite origin and the kernel
+     * timings. Meant to be called while no other thread is computing.
+     */
+    inline void reset() {
+        detail::Registry& reg = detail::registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for (const auto& counters : reg.threads) {
+            for (auto& op : counters->operations) {
+                op.store(0, std::memory_order_relaxed);
+            }
+            counters->zero_divisions.store(0, std::memory_order_relaxed);
+            counters->non_finite.store(0, std::memory_order_relaxed);
+            counters->sequence.store(0, std::memory_order_relaxed);
+        }
+        reg.retired = Report();
+        reg.has_origin.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+     * Human readable dump of a report
+     */
+    inline std::ostream& operator<<(std::ostream& os, const Report& report) {
+        os << "quaternion instrumentation\n";
+        for (std::size_t k = 0; k < operation_count; ++k) {
+            os << "  " << operation_name(static_cast<Operation>(k)) << ": " << report.operations[k] << "\n";
+        }
+        os << "  zero-norm divisions: " << report.zero_divisions << "\n";
+        os << "  non-finite results: " << report.non_finite << "\n";
+        if (report.first_non_finite.recorded) {
+            const Origin& origin = report.first_non_finite;
+            os << "  first non-finite: " << operation_name(origin.operation)
+               << " in " << (origin.scope ? origin.scope : "<no scope>")
+               << ", operation " << origin.sequence << " of thread " << origin.thread << "\n";
+        }
+        for (const auto& kernel : report.kernels) {
+            const KernelTiming& timing = kernel.second;
+            double ns = static_cast<double>(timing.total.count());
+            os << "  kernel " << kernel.first << ": " << timing.calls << " calls, " << timing.elements << " elements, "
+               << ns * 1e-6 << " ms";
+            if (timing.elements > 0) {
+                os << ", " << ns / static_cast<double>(timing.elements) << " ns/element";
+            }
+            os << "\n";
+        }
+        return os;
+    }
+
+    /**
+     * Dump the current totals
+     */
+    inline void report(std::ostream& os) {
+        os << snapshot();
+    }
+
+}
+
+#define QUATERNION_INSTRUMENTATION_CONCAT_(a, b) a##b
+#define QUATERNION_INSTRUMENTATION_CONCAT(a, b) QUATERNION_INSTRUMENTATION_CONCAT_(a, b)
+
+/**
+ * Hooks. The operation hooks are usable in constexpr functions: they do
+ * nothing during constant evaluation.
+ */
+#define QUATERNION_RECORD(op, result) \
+    do { if (!__builtin_is_constant_evaluated()) quaternion_instrumentation::record(quaternion_instrumentation::Operation::op, result); } while (false)
+#define QUATERNION_RECORD_DIVISOR(norm) \
+    do { if (!__builtin_is_constant_evaluated()) quaternion_instrumentation::check_divisor(norm); } while (false)
+#define QUATERNION_COUNT_BATCH(op, n) \
+    quaternion_instrumentation::count(quaternion_instrumentation::Operation::op, n)
+#define QUATERNION_TIMED_KERNEL(name, n) \
+    quaternion_instrumentation::KernelTimer QUATERNION_INSTRUMENTATION_CONCAT(quaternion_kernel_timer_, __LINE__)(name, n)
+
+#else
+
+#define QUATERNION_RECORD(op, result) static_cast<void>(0)
+#define QUATERNION_RECORD_DIVISOR(norm) static_cast<void>(0)
+#define QUATERNION_COUNT_BATCH(op, n) static_cast<void>(0)
+#define QUATERNION_TIMED_KERNEL(name, n) static_cast<void>(0)
+
+#endif
+
+#endif // QUATER_INSTRUMENTATION_H
@@ -0,0 +1,496 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_PACKED_H
+#define QUATER_PACKED_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionSimd.h"
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace quaternion_packed_detail {
+
+    /**
+     * Normalize and split a quaternion into the index of its largest component
+     * and the other three, sign flipped so that the dropped one is positive.
+     * Ties go to the lowest index.
+     */
+    template<typename P>
+    inline void smallest_three(typename P::type a, typename P::type b, typename P::type c, typename P::type d,
+                               typename P::type& idx, typename P::type& x, typename P::type& y, typename P::type& z) {
+        using T = typename P::value_type;
+        auto n = P::sqrt(P::add(P::add(P::add(P::mul(a, a), P::mul(b, b)), P::mul(c, c)), P::mul(d, d)));
+        a = P::div(a, n);
+        b = P::div(b, n);
+        c = P::div(c, n);
+        d = P::div(d, n);
+        auto m = P::abs(a);
+        idx = P::set1(static_cast<T>(0));
+        auto gt = P::less(m, P::abs(b));
+        m = P::select(gt, P::abs(b), m);
+        idx = P::select(gt, P::set1(static_cast<T>(1)), idx);
+        gt = P::less(m, P::abs(c));
+        m = P::select(gt, P::abs(c), m);
+        idx = P::select(gt, P::set1(static_cast<T>(2)), idx);
+        gt = P::less(m, P::abs(d));
+        idx = P::select(gt, P::set1(static_cast<T>(3)), idx);
+        auto is0 = P::less(idx, P::set1(static_cast<T>(0.5)));
+        auto le1 = P::less(idx, P::set1(static_cast<T>(1.5)));
+        auto le2 = P::less(idx, P::set1(static_cast<T>(2.5)));
+        auto largest = P::select(is0, a, P::select(le1, b, P::select(le2, c, d)));
+        x = P::select(is0, b, a);
+        y = P::select(le1, c, b);
+        z = P::select(le2, d, c);
+        auto negative = P::less(largest, P::set1(static_cast<T>(0)));
+        x = P::select(negative, P::neg(x), x);
+        y = P::select(negative, P::neg(y), y);
+        z = P::select(negative, P::neg(z), z);
+    }
+
+    /**
+     * Map [-1/sqrt(2), 1/sqrt(2)] onto the integers [0, 2^Bits - 2], an even
+     * number of steps so that zero is exact.
+     */
+    template<typename P, unsigned Bits>
+    inline typename P::type quantize(typename P::type x) {
+        using T = typename P::value_type;
+        const T half = static_cast<T>((1u << (Bits - 1)) - 1);
+        auto code = P::round(P::add(P::mul(x, P::set1(half * static_cast<T>(1.41421356237309504880))), P::set1(half)));
+        return P::min(P::max(code, P::set1(static_cast<T>(0))), P::set1(static_cast<T>((1u << Bits) - 2)));
+    }
+
+    template<typename P, unsigned Bits>
+    inline typename P::type dequantize(typename P::type code) {
+        using T = typename P::value_type;
+        const T half = static_cast<T>((1u << (Bits - 1)) - 1);
+        return P::mul(P::sub(code, P::set1(half)), P::set1(static_cast<T>(0.70710678118654752440) / half));
+    }
+
+    /**
+     * Rebuild the four components from the index, the three stored ones and
+     * the unit norm constraint.
+     */
+    template<typename P>
+    inline void rebuild(typename P::type idx, typename P::type x, typename P::type y, typename P::type z,
+                        typename P::type& a, typename P::type& b, typename P::type& c, typename P::type& d) {
+        using T = typename P::value_type;
+        auto rest = P::add(P::add(P::mul(x, x), P::mul(y, y)), P::mul(z, z));
+        auto largest = P::sqrt(P::max(P::sub(P::set1(static_cast<T>(1)), rest), P::set1(static_cast<T>(0))));
+        auto is0 = P::less(idx, P::set1(static_cast<T>(0.5)));
+        auto le1 = P::less(idx, P::set1(static_cast<T>(1.5)));
+        auto le2 = P::less(idx, P::set1(static_cast<T>(2.5)));
+        a = P::select(is0, largest, x);
+        b = P::select(is0, x, P::select(le1, largest, y));
+        c = P::select(le1, y, P::select(le2, largest, z));
+        d = P::select(le2, z, largest);
+    }
+
+    /**
+     * Codes of the quaternions at offset i, written to lanes [0, P::width) of the outputs
+     */
+    template<typename P, unsigned Bits, typename T>
+    inline void encode_step(const T* qa, const T* qb, const T* qc, const T* qd, T* idx, T* x, T* y, T* z, std::size_t i) {
+        typename P::type vi, vx, vy, vz;
+        smallest_three<P>(P::load(qa + i), P::load(qb + i), P::load(qc + i), P::load(qd + i), vi, vx, vy, vz);
+        P::store(idx, vi);
+        P::store(x, quantize<P, Bits>(vx));
+        P::store(y, quantize<P, Bits>(vy));
+        P::store(z, quantize<P, Bits>(vz));
+    }
+
+    /**
+     * Quaternions at offset i from codes in lanes [0, P::width) of the inputs
+     */
+    template<typename P, unsigned Bits, typename T>
+    inline void decode_step(const T* idx, const T* x, const T* y, const T* z, T* qa, T* qb, T* qc, T* qd, std::size_t i) {
+        typename P::type a, b, c, d;
+        rebuild<P>(P::load(idx), dequantize<P, Bits>(P::load(x)), dequantize<P, Bits>(P::load(y)), dequantize<P, Bits>(P::load(z)), a, b, c, d);
+        P::store(qa + i, a);
+        P::store(qb + i, b);
+        P::store(qc + i, c);
+        P::store(qd + i, d);
+    }
+
+    /**
+     * IEEE binary16 conversion, round to nearest even. NaN becomes the quiet NaN.
+     */
+    inline std::uint16_t float_to_half(float value) {
+        std::uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        std::uint32_t sign = (f >> 16) & 0x8000u;
+        f &= 0x7fffffffu;
+        std::uint16_t h;
+        if (f >= (143u << 23)) {
+            h = f > (255u << 23) ? 0x7e00u : 0x7c00u;
+        } else if (f < (113u << 23)) {
+            float magic = 0.5f;
+            float shifted;
+            std::memcpy(&shifted, &f, sizeof(f));
+            shifted += magic;
+            std::memcpy(&f, &shifted, sizeof(f));
+            h = static_cast<std::uint16_t>(f - (126u << 23));
+        } else {
+            std::uint32_t odd = (f >> 13) & 1u;
+            f -= 112u << 23;
+            f += 0xfffu + odd;
+            h = static_cast<std::uint16_t>(f >> 13);
+        }
+        return static_cast<std::uint16_t>(h | sign);
+    }
+
+    inline float half_to_float(std::uint16_t value) {
+        std::uint32_t f = static_cast<std::uint32_t>(value & 0x7fffu) << 13;
+        std::uint32_t exponent = f & (0x7c00u << 13);
+        f += 112u << 23;
+        float result;
+        if (exponent == (0x7c00u << 13)) {
+            f += 112u << 23;
+            std::memcpy(&result, &f, sizeof(f));
+        } else if (exponent == 0) {
+            f += 1u << 23;
+            std::memcpy(&result, &f, sizeof(f));
+            result -= 6.103515625e-05f;
+        } else {
+            std::memcpy(&result, &f, sizeof(f));
+        }
+        return (value & 0x8000u) ? -result : result;
+    }
+
+}
+
+/**
+ * Unit quaternion in 2 + 3 * Bits bits ("smallest three"). The largest
+ * component is dropped and rebuilt from the unit norm, the other three are
+ * quantized on [-1/sqrt(2), 1/sqrt(2)] with step sqrt(2) / (2^Bits - 2).
+ * With e = 1 / (sqrt(2) * (2^Bits - 2)) the stored components are within e
+ * and the rebuilt one within 3 e, so the rotation angle between the input
+ * and the decoded quaternion is at most 4 sqrt(3) e (plus the rounding of T):
+ *
+ *   PackedQuaternion32 (10 bits)  4.8e-3 rad
+ *   PackedQuaternion48 (15 bits)  1.5e-4 rad
+ *
+ * Inputs must be non-zero and are normalized before encoding, q and -q
+ * encode the same.
+ */
+template<unsigned Bits>
+class SmallestThree {
+
+    static_assert(Bits > 1 && 3 * Bits + 2 <= 64, "SmallestThree: 3 * Bits + 2 must fit in 64 bits");
+
+private:
+
+    std::array<std::uint16_t, (3 * Bits + 17) / 16> words;
+
+    void set_raw(std::uint64_t value) {
+        for (std::size_t k = 0; k < this->words.size(); ++k) {
+            this->words[k] = static_cast<std::uint16_t>(value >> (16 * k));
+        }
+    }
+
+    struct raw_tag {};
+
+    SmallestThree(std::uint64_t value, raw_tag) {
+        this->set_raw(value);
+    }
+
+public:
+
+    static constexpr unsigned bits = Bits;
+
+    /**
+     * Identity
+     */
+    SmallestThree() : SmallestThree(Quaternion<float>(1)) {}
+
+    template<typename T>
+    explicit SmallestThree(const Quaternion<T>& quat) {
+        using S = quaternion_simd::scalar_pack<T>;
+        T a = quat.a(), b = quat.b(), c = quat.c(), d = quat.d();
+        T idx, x, y, z;
+        quaternion_packed_detail::encode_step<S, Bits>(&a, &b, &c, &d, &idx, &x, &y, &z, 0);
+        this->set_codes(static_cast<unsigned>(idx), static_cast<std::uint32_t>(x), static_cast<std::uint32_t>(y), static_cast<std::uint32_t>(z));
+    }
+
+    template<typename T>
+    Quaternion<T> quaternion() const {
+        using S = quaternion_simd::scalar_pack<T>;
+        T idx = static_cast<T>(this->index()), x = static_cast<T>(this->code(0)), y = static_cast<T>(this->code(1)), z = static_cast<T>(this->code(2));
+        T a, b, c, d;
+        quaternion_packed_detail::decode_step<S, Bits>(&idx, &x, &y, &z, &a, &b, &c, &d, 0);
+        return {a, b, c, d};
+    }
+
+    /**
+     * Whole encoding: index in the top two bits, then the three codes
+     */
+    std::uint64_t raw() const {
+        std::uint64_t value = 0;
+        for (std::size_t k = 0; k < this->words.size(); ++k) {
+            value |= static_cast<std::uint64_t>(this->words[k]) << (16 * k);
+        }
+        return value;
+    }
+
+    static SmallestThree from_raw(std::uint64_t value) {
+        return SmallestThree(value, raw_tag());
+    }
+
+    unsigned index() const {
+        return static_cast<unsigned>(this->raw() >> (3 * Bits)) & 3u;
+    }
+
+    /**
+     * Code of the k-th stored component, k in [0, 3)
+     */
+    std::uint32_t code(unsigned k) const {
+        return static_cast<std::uint32_t>(this->raw() >> ((2 - k) * Bits)) & ((1u << Bits) - 1);
+    }
+
+    void set_codes(unsigned idx, std::uint32_t x, std::uint32_t y, std::uint32_t z) {
+        this->set_raw((static_cast<std::uint64_t>(idx) << (3 * Bits)) | (static_cast<std::uint64_t>(x) << (2 * Bits))
+                         | (static_cast<std::uint64_t>(y) << Bits) | static_cast<std::uint64_t>(z));
+    }
+
+};
+
+using PackedQuaternion32 = SmallestThree<10>;
+using PackedQuaternion48 = SmallestThree<15>;
+
+static_assert(sizeof(PackedQuaternion32) == 4, "PackedQuaternion32 must be 4 bytes");
+static_assert(sizeof(PackedQuaternion48) == 6, "PackedQuaternion48 must be 6 bytes");
+
+/**
+ * Quaternion as four IEEE binary16 values. Any quaternion in the half range
+ * is stored, not only unit ones. Double components are rounded to float
+ * first. Each component is within 2^-11 relative (2^-11 + 2^-24 from double)
+ * of the input, so the rotation angle error is at most 9.8e-4 rad while the
+ * components stay in the normal half range.
+ */
+class HalfQuaternion {
+
+private:
+
+    std::uint16_t n;
+    std::uint16_t ni;
+    std::uint16_t nj;
+    std::uint16_t nk;
+
+public:
+
+    HalfQuaternion() : n(0x3c00u), ni(0), nj(0), nk(0) {}
+
+    template<typename T>
+    explicit HalfQuaternion(const Quaternion<T>& quat) :
+        n(quaternion_packed_detail::float_to_half(static_cast<float>(quat.a()))),
+        ni(quaternion_packed_detail::float_to_half(static_cast<float>(quat.b()))),
+        nj(quaternion_packed_detail::float_to_half(static_cast<float>(quat.c()))),
+        nk(quaternion_packed_detail::float_to_half(static_cast<float>(quat.d()))) {}
+
+    template<typename T>
+    Quaternion<T> quaternion() const {
+        return {static_cast<T>(quaternion_packed_detail::half_to_float(this->n)), static_cast<T>(quaternion_packed_detail::half_to_float(this->ni)),
+                static_cast<T>(quaternion_packed_detail::half_to_float(this->nj)), static_cast<T>(quaternion_packed_detail::half_to_float(this->nk))};
+    }
+
+    /**
+     * binary16 encoding of the four components
+     */
+    std::array<std::uint16_t, 4> raw() const {
+        return {this->n, this->ni, this->nj, this->nk};
+    }
+
+    static HalfQuaternion from_raw(const std::array<std::uint16_t, 4>& value) {
+        HalfQuaternion half;
+        half.n = value[0];
+        half.ni = value[1];
+        half.nj = value[2];
+        half.nk = value[3];
+        return half;
+    }
+
+};
+
+static_assert(sizeof(HalfQuaternion) == 8, "HalfQuaternion must be 8 bytes");
+
+/**
+ * Batched encoding, out must hold quats.size() elements.
+ * Same result as the SmallestThree constructor.
+ */
+template<unsigned Bits, typename T>
+void encode(const QuaternionArray<T>& quats, SmallestThree<Bits>* out) {
+    using P = quaternion_simd::pack<T>;
+    using S = quaternion_simd::scalar_pack<T>;
+    T idx[P::width], x[P::width], y[P::width], z[P::width];
+    std::size_t i = 0;
+    for (; i + P::width <= quats.size(); i += P::width) {
+        quaternion_packed_detail::encode_step<P, Bits>(quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data(), idx, x, y, z, i);
+        for (std::size_t l = 0; l < P::width; ++l) {
+            out[i + l].set_codes(static_cast<unsigned>(idx[l]), static_cast<std::uint32_t>(x[l]), static_cast<std::uint32_t>(y[l]), static_cast<std::uint32_t>(z[l]));
+        }
+    }
+    for (; i < quats.size(); ++i) {
+        quaternion_packed_detail::encode_step<S, Bits>(quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data(), idx, x, y, z, i);
+        out[i].set_codes(static_cast<unsigned>(idx[0]), static_cast<std::uint32_t>(x[0]), static_cast<std::uint32_t>(y[0]), static_cast<std::uint32_t>(z[0]));
+    }
+}
+
+/**
+ * Batched decoding of size elements into quats (resized).
+ * Same result as SmallestThree::quaternion.
+ */
+template<unsigned Bits, typename T>
+void decode(const SmallestThree<Bits>* in, std::size_t size, QuaternionArray<T>& quats) {
+    using P = quaternion_simd::pack<T>;
+    using S = quaternion_simd::scalar_pack<T>;
+    quats.resize(size);
+    T idx[P::width], x[P::width], y[P::width], z[P::width];
+    std::size_t i = 0;
+    for (; i + P::width <= size; i += P::width) {
+        for (std::size_t l = 0; l < P::width; ++l) {
+            idx[l] = static_cast<T>(in[i + l].index());
+            x[l] = static_cast<T>(in[i + l].code(0));
+            y[l] = static_cast<T>(in[i + l].code(1));
+            z[l] = static_cast<T>(in[i + l].code(2));
+        }
+        quaternion_packed_detail::decode_step<P, Bits>(idx, x, y, z, quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data(), i);
+    }
+    for (; i < size; ++i) {
+        idx[0] = static_cast<T>(in[i].index());
+        x[0] = static_cast<T>(in[i].code(0));
+        y[0] = static_cast<T>(in[i].code(1));
+        z[0] = static_cast<T>(in[i].code(2));
+        quaternion_packed_detail::decode_step<S, Bits>(idx, x, y, z, quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data(), i);
+    }
+}
+
+namespace quaternion_packed_detail {
+
+#if defined(__F16C__)
+
+    inline __m128 load4(const float* ptr) {
+        return _mm_loadu_ps(ptr);
+    }
+
+    inline __m128 load4(const double* ptr) {
+        return _mm256_cvtpd_ps(_mm256_loadu_pd(ptr));
+    }
+
+    inline void store4(float* ptr, __m128 v) {
+        _mm_storeu_ps(ptr, v);
+    }
+
+    inline void store4(double* ptr, __m128 v) {
+        _mm256_storeu_pd(ptr, _mm256_cvtps_pd(v));
+    }
+
+    /**
+     * Four quaternions at offset i: convert each component column with F16C
+     * and transpose the 4x4 block of halves into AoS order.
+     */
+    template<typename T>
+    inline void encode_half_step(const QuaternionArray<T>& quats, HalfQuaternion* out, std::size_t i) {
+        __m128i a = _mm_cvtps_ph(load4(quats.a_data() + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i b = _mm_cvtps_ph(load4(quats.b_data() + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i c = _mm_cvtps_ph(load4(quats.c_data() + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i d = _mm_cvtps_ph(load4(quats.d_data() + i), _MM_FROUND_TO_NEAREST_INT);
+        __m128i ab = _mm_unpacklo_epi16(a, b);
+        __m128i cd = _mm_unpacklo_epi16(c, d);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_unpacklo_epi32(ab, cd));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i + 2), _mm_unpackhi_epi32(ab, cd));
+    }
+
+    template<typename T>
+    inline void decode_half_step(const HalfQuaternion* in, QuaternionArray<T>& quats, std::size_t i) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 2));
+        __m128i x = _mm_unpacklo_epi16(lo, hi);
+        __m128i y = _mm_unpackhi_epi16(lo, hi);
+        __m128i ab = _mm_unpacklo_epi16(x, y);
+        __m128i cd = _mm_unpackhi_epi16(x, y);
+        store4(quats.a_data() + i, _mm_cvtph_ps(ab));
+        store4(quats.b_data() + i, _mm_cvtph_ps(_mm_srli_si128(ab, 8)));
+        store4(quats.c_data() + i, _mm_cvtph_ps(cd));
+        store4(quats.d_data() + i, _mm_cvtph_ps(_mm_srli_si128(cd, 8)));
+    }
+
+    constexpr std::size_t half_width = 4;
+
+#endif
+
+}
+
+/**
+ * Batched encoding, out must hold quats.size() elements.
+ * Uses F16C when available, same result as the HalfQuaternion constructor.
+ */
+template<typename T>
+void encode(const QuaternionArray<T>& quats, HalfQuaternion* out) {
+    std::size_t i = 0;
+#if defined(__F16C__)
+    if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+        for (; i + quaternion_packed_detail::half_width <= quats.size(); i += quaternion_packed_detail::half_width) {
+            quaternion_packed_detail::encode_half_step(quats, out, i);
+        }
+    }
+#endif
+    for (; i < quats.size(); ++i) {
+        out[i] = HalfQuaternion(quats[i]);
+    }
+}
+
+/**
+ * Batched decoding of size elements into quats (resized)
+ */
+template<typename T>
+void decode(const HalfQuaternion* in, std::size_t size, QuaternionArray<T>& quats) {
+    quats.resize(size);
+    std::size_t i = 0;
+#if defined(__F16C__)
+    if constexpr (std::is_same<T, float>::value || std::is_same<T, double>::value) {
+        for (; i + quaternion_packed_detail::half_width <= size; i += quaternion_packed_detail::half_width) {
+            quaternion_packed_detail::decode_half_step(in, quats, i);
+        }
+    }
+#endif
+    for (; i < size; ++i) {
+        quats.set(i, in[i].quaternion<T>());
+    }
+}
+
+#endif // QUATER_PACKED_H
@@ -0,0 +1,219 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_PARALLEL_H
+#define QUATER_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Minimal fork-join helpers used by the parallel algorithms.
+ * Work is split into contiguous blocks that run on a persistent pool of
+ * worker threads, started on first use, so the per-tick APIs do not pay
+ * thread creation on every call. The calling thread runs blocks too.
+ */
+namespace quaternion_parallel {
+
+    inline std::atomic<std::size_t>& thread_count_setting() {
+        static std::atomic<std::size_t> count(0);
+        return count;
+    }
+
+    /**
+     * Number of threads used by the parallel algorithms, 0 means one per hardware thread
+     */
+    inline void set_thread_count(std::size_t count) {
+        thread_count_setting().store(count, std::memory_order_relaxed);
+    }
+
+    inline std::size_t thread_count() {
+        std::size_t count = thread_count_setting().load(std::memory_order_relaxed);
+        if (count == 0) {
+            count = std::thread::hardware_concurrency();
+        }
+        return count == 0 ? 1 : count;
+    }
+
+    /**
+     * Number of blocks for size elements, at least grain elements each
+     */
+    inline std::size_t block_count(std::size_t size, std::size_t grain) {
+        std::size_t blocks = grain == 0 ? size : (size + grain - 1) / grain;
+        return std::max<std::size_t>(1, std::min(blocks, thread_count()));
+    }
+
+    /**
+     * Half-open range [first, second) of block b
+     */
+    inline std::pair<std::size_t, std::size_t> block_range(std::size_t size, std::size_t blocks, std::size_t b) {
+        return {size * b / blocks, size * (b + 1) / blocks};
+    }
+
+    namespace detail {
+
+        /**
+         * One run_blocks call: blocks are claimed in order by the pool
+         * workers and by the calling thread
+         */
+        struct Job {
+            void (*invoke)(void*, std::size_t);
+            void* fn;
+            std::size_t blocks;
+            std::size_t next = 0;
+            std::size_t done = 0;
+            std::exception_ptr error;
+        };
+
+        /**
+         * Worker threads waiting for jobs. Never destroyed: the workers are
+         * detached and stay blocked until the process exits.
+         */
+        class Pool {
+        public:
+            /**
+             * Queue the job on up to workers threads, run its blocks on the
+             * calling thread as well, and wait until all of them finished.
+             * Since the caller can always finish the job alone, nested calls
+             * from inside a block cannot deadlock.
+             */
+            void run(Job& job, std::size_t workers) {
+                {
+                    std::lock_guard<std::mutex> lock(this->mutex);
+                    while (this->started < workers) {
+                        std::thread(&Pool::work, this).detach();
+                        ++this->started;
+                    }
+                    this->jobs.push_back(&job);
+                }
+                this->wake.notify_all();
+                std::unique_lock<std::mutex> lock(this->mutex);
+                while (job.next < job.blocks) {
+                    this->execute(job, lock);
+                }
+                this->jobs.erase(std::remove(this->jobs.begin(), this->jobs.end(), &job), this->jobs.end());
+                this->finished.wait(lock, [&job] { return job.done == job.blocks; });
+                if (job.error) {
+                    std::rethrow_exception(job.error);
+                }
+            }
+
+        private:
+            std::mutex mutex;
+            std::condition_variable wake;
+            std::condition_variable finished;
+            std::deque<Job*> jobs;
+            std::size_t started = 0;
+
+            /**
+             * Claim and run the next block of job, called and returning with lock held
+             */
+            void execute(Job& job, std::unique_lock<std::mutex>& lock) {
+                std::size_t b = job.next++;
+                if (job.next == job.blocks) {
+                    this->jobs.erase(std::remove(this->jobs.begin(), this->jobs.end(), &job), this->jobs.end());
+                }
+                lock.unlock();
+                std::exception_ptr error;
+                try {
+                    job.invoke(job.fn, b);
+                } catch (...) {
+                    error = std::current_exception();
+                }
+                lock.lock();
+                if (error && !job.error) {
+                    job.error = error;
+                }
+                if (++job.done == job.blocks) {
+                    this->finished.notify_all();
+                }
+            }
+
+            void work() {
+                std::unique_lock<std::mutex> lock(this->mutex);
+                for (;;) {
+                    this->wake.wait(lock, [this] { return !this->jobs.empty(); });
+                    this->execute(*this->jobs.front(), lock);
+                }
+            }
+        };
+
+        inline Pool& pool() {
+            static Pool* instance = new Pool();
+            return *instance;
+        }
+
+    }
+
+    /**
+     * Run fn(b) for every block b in [0, blocks) and wait for completion.
+     * The first exception thrown by a block is rethrown once all blocks ended.
+     */
+    template<typename F>
+    void run_blocks(std::size_t blocks, F&& fn) {
+        if (blocks <= 1) {
+            if (blocks == 1) {
+                fn(0);
+            }
+            return;
+        }
+        using Fn = typename std::remove_reference<F>::type;
+        detail::Job job;
+        job.invoke = [](void* f, std::size_t b) { (*static_cast<Fn*>(f))(b); };
+        job.fn = const_cast<void*>(static_cast<const void*>(std::addressof(fn)));
+        job.blocks = blocks;
+        detail::pool().run(job, blocks - 1);
+    }
+
+    /**
+     * Run fn(first, last) over contiguous blocks of [0, size)
+     */
+    template<typename F>
+    void parallel_for(std::size_t size, std::size_t grain, F&& fn) {
+        std::size_t blocks = block_count(size, grain);
+        run_blocks(blocks, [&](std::size_t b) {
+            std::pair<std::size_t, std::size_t> range = block_range(size, blocks, b);
+            fn(range.first, range.second);
+        });
+    }
+
+}
+
+#endif // QUATER_PARALLEL_H
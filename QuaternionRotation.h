@@ -0,0 +1,247 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_ROTATION_H
+#define QUATER_ROTATION_H
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionSimd.h"
+
+namespace quaternion_simd {
+
+    /**
+     * One rotation step over SoA point buffers at offset i, same formula as rotate().
+     */
+    template<typename P, typename T>
+    inline void rotate_step(typename P::type w, typename P::type ux, typename P::type uy, typename P::type uz,
+                            T* xs, T* ys, T* zs, std::size_t i) {
+        const auto two = P::set1(static_cast<T>(2));
+        auto x = P::load(xs + i), y = P::load(ys + i), z = P::load(zs + i);
+        auto tx = P::mul(two, P::sub(P::mul(uy, z), P::mul(uz, y)));
+        auto ty = P::mul(two, P::sub(P::mul(uz, x), P::mul(ux, z)));
+        auto tz = P::mul(two, P::sub(P::mul(ux, y), P::mul(uy, x)));
+        P::store(xs + i, P::add(P::add(x, P::mul(w, tx)), P::sub(P::mul(uy, tz), P::mul(uz, ty))));
+        P::store(ys + i, P::add(P::add(y, P::mul(w, ty)), P::sub(P::mul(uz, tx), P::mul(ux, tz))));
+        P::store(zs + i, P::add(P::add(z, P::mul(w, tz)), P::sub(P::mul(ux, ty), P::mul(uy, tx))));
+    }
+
+}
+
+namespace quaternion_simd {
+
+    /**
+     * One matrix-vector step over SoA point buffers at offset i.
+     */
+    template<typename P, typename T>
+    inline void matrix_step(const typename P::type (&m)[9], T* xs, T* ys, T* zs, std::size_t i) {
+        auto x = P::load(xs + i), y = P::load(ys + i), z = P::load(zs + i);
+        P::store(xs + i, P::add(P::add(P::mul(m[0], x), P::mul(m[1], y)), P::mul(m[2], z)));
+        P::store(ys + i, P::add(P::add(P::mul(m[3], x), P::mul(m[4], y)), P::mul(m[5], z)));
+        P::store(zs + i, P::add(P::add(P::mul(m[6], x), P::mul(m[7], y)), P::mul(m[8], z)));
+    }
+
+}
+
+/**
+ * Row-major 3x3 rotation matrix
+ */
+template<typename T>
+using RotationMatrix = std::array<std::array<T, 3>, 3>;
+
+/**
+ * Rotation matrix of a quaternion. Non-unit quaternions are normalized
+ * implicitly through the 2 / norm scale factor.
+ */
+template<typename T>
+RotationMatrix<T> to_matrix(const Quaternion<T>& quat) {
+    T s = static_cast<T>(2) / std::norm(quat);
+    T w = quat.a(), x = quat.b(), y = quat.c(), z = quat.d();
+    T one = static_cast<T>(1);
+    return {{{one - s * ((y * y) + (z * z)), s * ((x * y) - (z * w)), s * ((x * z) + (y * w))},
+             {s * ((x * y) + (z * w)), one - s * ((x * x) + (z * z)), s * ((y * z) - (x * w))},
+             {s * ((x * z) - (y * w)), s * ((y * z) + (x * w)), one - s * ((x * x) + (y * y))}}};
+}
+
+/**
+ * Unit quaternion of a rotation matrix.
+ * Shepperd's method: the pivot is the largest of the trace and the
+ * diagonal, so the square root argument never approaches zero.
+ */
+template<typename T>
+Quaternion<T> from_matrix(const RotationMatrix<T>& m) {
+    const T one = static_cast<T>(1);
+    const T quarter = static_cast<T>(0.25);
+    T trace = m[0][0] + m[1][1] + m[2][2];
+    if (trace >= m[0][0] && trace >= m[1][1] && trace >= m[2][2]) {
+        T s = std::sqrt(one + trace) * 2;
+        return {quarter * s, (m[2][1] - m[1][2]) / s, (m[0][2] - m[2][0]) / s, (m[1][0] - m[0][1]) / s};
+    } else if (m[0][0] >= m[1][1] && m[0][0] >= m[2][2]) {
+        T s = std::sqrt(one + m[0][0] - m[1][1] - m[2][2]) * 2;
+        return {(m[2][1] - m[1][2]) / s, quarter * s, (m[0][1] + m[1][0]) / s, (m[0][2] + m[2][0]) / s};
+    } else if (m[1][1] >= m[2][2]) {
+        T s = std::sqrt(one + m[1][1] - m[0][0] - m[2][2]) * 2;
+        return {(m[0][2] - m[2][0]) / s, (m[0][1] + m[1][0]) / s, quarter * s, (m[1][2] + m[2][1]) / s};
+    } else {
+        T s = std::sqrt(one + m[2][2] - m[0][0] - m[1][1]) * 2;
+        return {(m[1][0] - m[0][1]) / s, (m[0][2] + m[2][0]) / s, (m[1][2] + m[2][1]) / s, quarter * s};
+    }
+}
+
+/**
+ * Rotation precomputed from a quaternion for repeated application.
+ *
+ * Caches the rotation matrix (9 mul/add per point instead of a sandwich
+ * product) and the inverse norm, so that dividing by the quaternion is a
+ * single Hamilton product.
+ */
+template<typename T = double>
+class CompiledRotation {
+
+private:
+
+    Quaternion<T> quat;
+    Quaternion<T> inv;
+    T inv_norm;
+    RotationMatrix<T> matrix;
+
+public:
+
+    using value_type = T; ///< value_type trait for STL compatibility
+
+    explicit CompiledRotation(const Quaternion<T>& quat = Quaternion<T>(static_cast<T>(1)))
+        : quat(quat), inv_norm(static_cast<T>(1) / std::norm(quat)), matrix(to_matrix(quat)) {
+        this->inv = std::conj(quat) * this->inv_norm;
+    }
+
+    const Quaternion<T>& quaternion() const {
+        return this->quat;
+    }
+
+    const Quaternion<T>& inverse() const {
+        return this->inv;
+    }
+
+    T inverse_norm() const {
+        return this->inv_norm;
+    }
+
+    const RotationMatrix<T>& rotation_matrix() const {
+        return this->matrix;
+    }
+
+    /**
+     * Rotate a single vector
+     */
+    template<typename U>
+    auto operator()(const std::array<U, 3>& vec) const -> std::array<decltype(std::declval<T>() * vec[0]), 3> {
+        const RotationMatrix<T>& m = this->matrix;
+        return {QUATERNION_NO_CONTRACT(m[0][0] * vec[0]) + QUATERNION_NO_CONTRACT(m[0][1] * vec[1]) + QUATERNION_NO_CONTRACT(m[0][2] * vec[2]),
+                QUATERNION_NO_CONTRACT(m[1][0] * vec[0]) + QUATERNION_NO_CONTRACT(m[1][1] * vec[1]) + QUATERNION_NO_CONTRACT(m[1][2] * vec[2]),
+                QUATERNION_NO_CONTRACT(m[2][0] * vec[0]) + QUATERNION_NO_CONTRACT(m[2][1] * vec[1]) + QUATERNION_NO_CONTRACT(m[2][2] * vec[2])};
+    }
+
+    /**
+     * Rotate a point cloud in place
+     */
+    void apply(T* xs, T* ys, T* zs, std::size_t size) const {
+        using P = quaternion_simd::pack<T>;
+        using S = quaternion_simd::scalar_pack<T>;
+        typename P::type pm[9];
+        typename S::type sm[9];
+        for (std::size_t k = 0; k < 9; ++k) {
+            pm[k] = P::set1(this->matrix[k / 3][k % 3]);
+            sm[k] = this->matrix[k / 3][k % 3];
+        }
+        std::size_t i = 0;
+        for (; i + P::width <= size; i += P::width) {
+            quaternion_simd::matrix_step<P>(pm, xs, ys, zs, i);
+        }
+        for (; i < size; ++i) {
+            quaternion_simd::matrix_step<S>(sm, xs, ys, zs, i);
+        }
+    }
+
+    /**
+     * Right division by the compiled quaternion, lhs * inverse(q)
+     */
+    template<typename U>
+    auto divide(const Quaternion<U>& lhs) const -> decltype(lhs * this->inv) {
+        return lhs * this->inv;
+    }
+
+};
+
+/**
+ * Rotate a point cloud in place by one unit quaternion.
+ */
+template<typename T>
+void rotate_points(const Quaternion<T>& quat, T* xs, T* ys, T* zs, std::size_t size) {
+    using P = quaternion_simd::pack<T>;
+    using S = quaternion_simd::scalar_pack<T>;
+    QUATERNION_TIMED_KERNEL("rotate_points", size);
+    std::size_t i = 0;
+    for (; i + P::width <= size; i += P::width) {
+        quaternion_simd::rotate_step<P>(P::set1(quat.a()), P::set1(quat.b()), P::set1(quat.c()), P::set1(quat.d()), xs, ys, zs, i);
+    }
+    for (; i < size; ++i) {
+        quaternion_simd::rotate_step<S>(quat.a(), quat.b(), quat.c(), quat.d(), xs, ys, zs, i);
+    }
+}
+
+/**
+ * Rotate a point cloud in place, the i-th point by the i-th unit quaternion.
+ */
+template<typename T>
+void rotate_points(const QuaternionArray<T>& quats, T* xs, T* ys, T* zs, std::size_t size) {
+    if (quats.size() != size) {
+        throw std::length_error("rotate_points: size mismatch");
+    }
+    using P = quaternion_simd::pack<T>;
+    using S = quaternion_simd::scalar_pack<T>;
+    const T* a = quats.a_data();
+    const T* b = quats.b_data();
+    const T* c = quats.c_data();
+    const T* d = quats.d_data();
+    QUATERNION_TIMED_KERNEL("rotate_points array", size);
+    std::size_t i = 0;
+    for (; i + P::width <= size; i += P::width) {
+        quaternion_simd::rotate_step<P>(P::load(a + i), P::load(b + i), P::load(c + i), P::load(d + i), xs, ys, zs, i);
+    }
+    for (; i < size; ++i) {
+        quaternion_simd::rotate_step<S>(a[i], b[i], c[i], d[i], xs, ys, zs, i);
+    }
+}
+
+#endif // QUATER_ROTATION_H
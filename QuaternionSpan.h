@@ -0,0 +1,96 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_SPAN_H
+#define QUATER_SPAN_H
+
+#include <cstddef>
+#include <vector>
+#include "Quaternion.h"
+
+/**
+ * Non-owning read-only view of contiguous quaternions, a C++17 stand-in
+ * for std::span<const Quaternion<T>>.
+ */
+template<typename T = double>
+class QuaternionSpan {
+
+private:
+
+    const Quaternion<T>* ptr;
+    std::size_t count;
+
+public:
+
+    using value_type = Quaternion<T>; ///< value_type trait for STL compatibility
+    using size_type = std::size_t;
+    using iterator = const Quaternion<T>*;
+
+    constexpr QuaternionSpan() noexcept
+        : ptr(nullptr), count(0) {}
+
+    constexpr QuaternionSpan(const Quaternion<T>* ptr, std::size_t count) noexcept
+        : ptr(ptr), count(count) {}
+
+    template<typename A>
+    QuaternionSpan(const std::vector<Quaternion<T>, A>& vec) noexcept
+        : ptr(vec.data()), count(vec.size()) {}
+
+    constexpr const Quaternion<T>* data() const noexcept {
+        return this->ptr;
+    }
+
+    constexpr std::size_t size() const noexcept {
+        return this->count;
+    }
+
+    constexpr bool empty() const noexcept {
+        return this->count == 0;
+    }
+
+    constexpr const Quaternion<T>& operator[](std::size_t i) const noexcept {
+        return this->ptr[i];
+    }
+
+    constexpr iterator begin() const noexcept {
+        return this->ptr;
+    }
+
+    constexpr iterator end() const noexcept {
+        return this->ptr + this->count;
+    }
+
+    constexpr QuaternionSpan<T> subspan(std::size_t offset, std::size_t length) const noexcept {
+        return {this->ptr + offset, length};
+    }
+
+};
+
+#endif // QUATER_SPAN_H
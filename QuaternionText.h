@@ -0,0 +1,149 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_TEXT_H
+#define QUATER_TEXT_H
+
+#include <charconv>
+#include <system_error>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+
+/**
+ * Locale-independent, allocation-free conversion between quaternions and
+ * the (a,b,c,d) text form, on caller-provided buffers. Whitespace is
+ * accepted around every token.
+ */
+namespace quaternion_text_detail {
+
+    inline const char* skip_space(const char* first, const char* last) noexcept {
+        while (first != last && (*first == ' ' || *first == '\t' || *first == '\n' || *first == '\r' || *first == '\f' || *first == '\v')) {
+            ++first;
+        }
+        return first;
+    }
+
+    inline const char* expect(const char* first, const char* last, char c) noexcept {
+        first = skip_space(first, last);
+        return first != last && *first == c ? first + 1 : nullptr;
+    }
+
+    template<typename T>
+    std::from_chars_result number(const char* first, const char* last, T& value) noexcept {
+        first = skip_space(first, last);
+        if (first != last && *first == '+') {
+            // from_chars would still take the '-' of "+-1"
+            if (first + 1 != last && (first[1] == '-' || first[1] == '+')) {
+                return {first, std::errc::invalid_argument};
+            }
+            ++first;
+        }
+        return std::from_chars(first, last, value);
+    }
+
+}
+
+/**
+ * Parse one quaternion. On success ptr points past the closing parenthesis,
+ * on failure ec is set and value is left untouched.
+ */
+template<typename T>
+std::from_chars_result from_chars(const char* first, const char* last, Quaternion<T>& value) noexcept {
+    const char* ptr = quaternion_text_detail::expect(first, last, '(');
+    if (ptr == nullptr) {
+        return {first, std::errc::invalid_argument};
+    }
+    T components[4];
+    for (int k = 0; k < 4; ++k) {
+        std::from_chars_result res = quaternion_text_detail::number(ptr, last, components[k]);
+        if (res.ec != std::errc()) {
+            return {first, res.ec};
+        }
+        ptr = quaternion_text_detail::expect(res.ptr, last, k < 3 ? ',' : ')');
+        if (ptr == nullptr) {
+            return {first, std::errc::invalid_argument};
+        }
+    }
+    value = Quaternion<T>(components[0], components[1], components[2], components[3]);
+    return {ptr, std::errc()};
+}
+
+/**
+ * Format one quaternion as (a,b,c,d) using the shortest representation
+ * that round-trips. On failure ec is std::errc::value_too_large.
+ */
+template<typename T>
+std::to_chars_result to_chars(char* first, char* last, const Quaternion<T>& value) noexcept {
+    const T components[4] = {value.a(), value.b(), value.c(), value.d()};
+    char* ptr = first;
+    for (int k = 0; k < 4; ++k) {
+        if (ptr == last) {
+            return {last, std::errc::value_too_large};
+        }
+        *ptr++ = k == 0 ? '(' : ',';
+        std::to_chars_result res = std::to_chars(ptr, last, components[k]);
+        if (res.ec != std::errc()) {
+            return {last, res.ec};
+        }
+        ptr = res.ptr;
+    }
+    if (ptr == last) {
+        return {last, std::errc::value_too_large};
+    }
+    *ptr++ = ')';
+    return {ptr, std::errc()};
+}
+
+/**
+ * Parse every quaternion in [first, last) and append it to quats.
+ * Quaternions may be separated by whitespace, ',' or ';'. Parsing stops at
+ * the first malformed entry: ptr points to it and ec is set.
+ */
+template<typename T>
+std::from_chars_result parse_quaternions(const char* first, const char* last, QuaternionArray<T>& quats) {
+    const char* ptr = first;
+    while (true) {
+        while (ptr != last && (*ptr == ',' || *ptr == ';' || *ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')) {
+            ++ptr;
+        }
+        if (ptr == last) {
+            return {ptr, std::errc()};
+        }
+        Quaternion<T> quat;
+        std::from_chars_result res = from_chars(ptr, last, quat);
+        if (res.ec != std::errc()) {
+            return res;
+        }
+        quats.push_back(quat);
+        ptr = res.ptr;
+    }
+}
+
+#endif // QUATER_TEXT_H
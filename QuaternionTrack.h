@@ -0,0 +1,398 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_TRACK_H
+#define QUATER_TRACK_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionInterpolation.h"
+#include "QuaternionParallel.h"
+#include "QuaternionSimd.h"
+
+/**
+ * Interpolation between the keyframes of a QuaternionTrack
+ */
+enum class TrackInterpolation {
+    Squad,  ///< Shoemake's spherical quadrangle, three fast_slerp per sample
+    Cubic   ///< C1 Hermite cubic on the components with Catmull-Rom tangents, normalized, no trigonometry
+};
+
+/**
+ * Segment cache for sequential queries on one track. Starts at the first
+ * segment; any value is valid, a stale cursor only costs a search.
+ */
+struct TrackCursor {
+    std::size_t segment = 0;
+};
+
+namespace quaternion_track_detail {
+
+    constexpr std::size_t grain = 1024;
+    constexpr std::size_t forward_steps = 4;   ///< segments walked from the cursor before a binary search
+    constexpr std::size_t inputs = 17;         ///< 4 control quaternions and the local parameter
+
+    /**
+     * Interpolate the lanes of in, laid out as [input * stride + lane]:
+     * control quaternions p0..p3 component by component, then u in [0, 1]
+     */
+    template<typename P, typename T>
+    inline void interpolate(TrackInterpolation mode, const T* in, std::size_t stride, T* a, T* b, T* c, T* d) {
+        using quaternion_interpolation_detail::slerp_weights;
+        using quaternion_interpolation_detail::slerp_weights_direct;
+        const auto one = P::set1(static_cast<T>(1));
+        typename P::type p[4][4];
+        for (std::size_t k = 0; k < 4; ++k) {
+            for (std::size_t j = 0; j < 4; ++j) {
+                p[k][j] = P::load(in + (4 * k + j) * stride);
+            }
+        }
+        auto u = P::load(in + 16 * stride);
+        typename P::type r[4];
+        if (mode == TrackInterpolation::Cubic) {
+            // ((c3 u + c2) u + c1) u + c0
+            for (std::size_t j = 0; j < 4; ++j) {
+                r[j] = P::add(P::mul(P::add(P::mul(P::add(P::mul(p[3][j], u), p[2][j]), u), p[1][j]), u), p[0][j]);
+            }
+        } else {
+            // slerp(slerp(q0, q1, u), slerp(s0, s1, u), 2 u (1 - u)); the last
+            // two must not flip to the shorter arc or the curve jumps inside a segment
+            typename P::type w0, w1, x[4], y[4];
+            auto dot = P::add(P::add(P::add(P::mul(p[0][0], p[3][0]), P::mul(p[0][1], p[3][1])), P::mul(p[0][2], p[3][2])), P::mul(p[0][3], p[3][3]));
+            slerp_weights<P>(dot, u, w0, w1);
+            for (std::size_t j = 0; j < 4; ++j) {
+                x[j] = P::add(P::mul(w0, p[0][j]), P::mul(w1, p[3][j]));
+            }
+            dot = P::add(P::add(P::add(P::mul(p[1][0], p[2][0]), P::mul(p[1][1], p[2][1])), P::mul(p[1][2], p[2][2])), P::mul(p[1][3], p[2][3]));
+            slerp_weights_direct<P>(dot, u, w0, w1);
+            for (std::size_t j = 0; j < 4; ++j) {
+                y[j] = P::add(P::mul(w0, p[1][j]), P::mul(w1, p[2][j]));
+            }
+            dot = P::add(P::add(P::add(P::mul(x[0], y[0]), P::mul(x[1], y[1])), P::mul(x[2], y[2])), P::mul(x[3], y[3]));
+            auto h = P::mul(P::add(u, u), P::sub(one, u));
+            slerp_weights_direct<P>(dot, h, w0, w1);
+            for (std::size_t j = 0; j < 4; ++j) {
+                r[j] = P::add(P::mul(w0, x[j]), P::mul(w1, y[j]));
+            }
+        }
+        auto abs = P::sqrt(P::add(P::add(P::add(P::mul(r[0], r[0]), P::mul(r[1], r[1])), P::mul(r[2], r[2])), P::mul(r[3], r[3])));
+        P::store(a, P::div(r[0], abs));
+        P::store(b, P::div(r[1], abs));
+        P::store(c, P::div(r[2], abs));
+        P::store(d, P::div(r[3], abs));
+    }
+
+}
+
+/**
+ * Keyframe track of unit quaternions sampled by time.
+ * Keys are normalized and flipped onto the hemisphere of their predecessor
+ * at construction, and the control quaternions of every segment are
+ * precomputed, so a sample is a segment lookup and one interpolation.
+ * Times outside the keys clamp to the first or last key. Squad control
+ * points assume roughly uniform key spacing, Cubic tangents account for
+ * the actual spacing.
+ * Immutable after construction: share it between threads and keep one
+ * TrackCursor per reader.
+ */
+template<typename T = double>
+class QuaternionTrack {
+
+private:
+
+    std::vector<T> stamps;
+    std::vector<T> scales;         ///< 1 / segment duration
+    std::vector<T> controls;       ///< 16 per segment: p0..p3 of the interpolation, component by component
+    TrackInterpolation mode = TrackInterpolation::Squad;
+
+    void add_segment(const Quaternion<T>& p0, const Quaternion<T>& p1, const Quaternion<T>& p2, const Quaternion<T>& p3) {
+        for (const Quaternion<T>& p : {p0, p1, p2, p3}) {
+            this->controls.insert(this->controls.end(), {p.a(), p.b(), p.c(), p.d()});
+        }
+    }
+
+    std::size_t search(const T& time) const {
+        auto first = this->stamps.begin() + 1;
+        return static_cast<std::size_t>(std::upper_bound(first, first + (this->segments() - 1), time) - this->stamps.begin()) - 1;
+    }
+
+public:
+
+    using value_type = Quaternion<T>; ///< value_type trait for STL compatibility
+
+    /**
+     * Track through keys at strictly increasing times
+     */
+    QuaternionTrack(const std::vector<T>& times, const std::vector<Quaternion<T>>& keys, TrackInterpolation interpolation = TrackInterpolation::Squad)
+        : stamps(times), mode(interpolation) {
+        if (keys.empty() || times.size() != keys.size()) {
+            throw std::invalid_argument("QuaternionTrack: times and keys must be non-empty and of the same size");
+        }
+        for (std::size_t i = 1; i < times.size(); ++i) {
+            if (!(times[i - 1] < times[i])) {
+                throw std::invalid_argument("QuaternionTrack: times must be strictly increasing");
+            }
+        }
+        const std::size_t n = keys.size();
+        std::vector<Quaternion<T>> q(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            q[i] = normalized(keys[i]);
+            if (i > 0 && dot(q[i - 1], q[i]) < 0) {
+                q[i] = q[i] * static_cast<T>(-1);
+            }
+        }
+        if (n == 1) {
+            // a constant segment of zero length
+            Quaternion<T> rest = interpolation == TrackInterpolation::Squad ? q[0] : Quaternion<T>();
+            this->scales.push_back(static_cast<T>(0));
+            this->add_segment(q[0], rest, rest, rest);
+            return;
+        }
+        this->scales.reserve(n - 1);
+        this->controls.reserve(16 * (n - 1));
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+            this->scales.push_back(static_cast<T>(1) / (times[i + 1] - times[i]));
+        }
+        if (interpolation == TrackInterpolation::Squad) {
+            // s_i = q_i exp(-(log(q_i^-1 q_i+1) + log(q_i^-1 q_i-1)) / 4), s = q at the ends
+            std::vector<Quaternion<T>> s(q);
+            for (std::size_t i = 1; i + 1 < n; ++i) {
+                Quaternion<T> inv = std::conj(q[i]);
+                Quaternion<T> sum = std::log(inv * q[i + 1]) + std::log(inv * q[i - 1]);
+                s[i] = normalized(q[i] * std::exp(sum * static_cast<T>(-0.25)));
+            }
+            for (std::size_t i = 0; i + 1 < n; ++i) {
+                this->add_segment(q[i], s[i], s[i + 1], q[i + 1]);
+            }
+            return;
+        }
+        // Hermite on u in [0, 1] with tangents m scaled by the segment duration
+        std::vector<Quaternion<T>> m(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            std::size_t lo = i == 0 ? 0 : i - 1, hi = i + 1 == n ? i : i + 1;
+            m[i] = (q[hi] - q[lo]) / (times[hi] - times[lo]);
+        }
+        for (std::size_t i = 0; i + 1 < n; ++i) {
+            T duration = times[i + 1] - times[i];
+            Quaternion<T> m0 = m[i] * duration, m1 = m[i + 1] * duration;
+            this->add_segment(q[i], m0, (q[i + 1] - q[i]) * static_cast<T>(3) - m0 * static_cast<T>(2) - m1,
+                              (q[i] - q[i + 1]) * static_cast<T>(2) + m0 + m1);
+        }
+    }
+
+    /**
+     * Number of keys
+     */
+    std::size_t size() const noexcept {
+        return this->stamps.size();
+    }
+
+    std::size_t segments() const noexcept {
+        return this->scales.size();
+    }
+
+    TrackInterpolation interpolation() const noexcept {
+        return this->mode;
+    }
+
+    T start_time() const noexcept {
+        return this->stamps.front();
+    }
+
+    T end_time() const noexcept {
+        return this->stamps.back();
+    }
+
+    T time(std::size_t i) const {
+        return this->stamps[i];
+    }
+
+    /**
+     * Segment containing time, moving the cursor: O(1) when time does not
+     * go backwards and does not skip more than a few segments, a binary
+     * search otherwise
+     */
+    std::size_t locate(const T& time, TrackCursor& cursor) const noexcept {
+        const std::size_t last = this->segments() - 1;
+        std::size_t s = std::min(cursor.segment, last);
+        if (time < this->stamps[s]) {
+            s = this->search(time);
+        } else {
+            for (std::size_t k = 0; k < quaternion_track_detail::forward_steps && s < last && !(time < this->stamps[s + 1]); ++k) {
+                ++s;
+            }
+            if (s < last && !(time < this->stamps[s + 1])) {
+                s = this->search(time);
+            }
+        }
+        cursor.segment = s;
+        return s;
+    }
+
+    /**
+     * Start loading what locate and the interpolation will read, when the
+     * cursor does not move out of its segment
+     */
+    void prefetch(const TrackCursor& cursor) const noexcept {
+        std::size_t s = std::min(cursor.segment, this->segments() - 1);
+        __builtin_prefetch(this->stamps.data() + s);
+        __builtin_prefetch(this->scales.data() + s);
+        __builtin_prefetch(this->controls.data() + 16 * s);
+        __builtin_prefetch(this->controls.data() + 16 * s + 15);
+    }
+
+    /**
+     * Control quaternions of segment s, 16 values
+     */
+    const T* control_data(std::size_t s) const noexcept {
+        return this->controls.data() + 16 * s;
+    }
+
+    /**
+     * Local parameter in [0, 1] of time in segment s
+     */
+    T parameter(std::size_t s, const T& time) const noexcept {
+        T u = (time - this->stamps[s]) * this->scales[s];
+        return std::min(std::max(u, static_cast<T>(0)), static_cast<T>(1));
+    }
+
+    /**
+     * Sample at time, with a binary search
+     */
+    Quaternion<T> operator()(const T& time) const {
+        TrackCursor cursor{this->search(time)};
+        return (*this)(time, cursor);
+    }
+
+    /**
+     * Sample at time, starting the segment lookup from cursor
+     */
+    Quaternion<T> operator()(const T& time, TrackCursor& cursor) const {
+        std::size_t s = this->locate(time, cursor);
+        T in[quaternion_track_detail::inputs];
+        std::copy(this->control_data(s), this->control_data(s) + 16, in);
+        in[16] = this->parameter(s, time);
+        T a, b, c, d;
+        quaternion_track_detail::interpolate<quaternion_simd::scalar_pack<T>>(this->mode, in, 1, &a, &b, &c, &d);
+        return {a, b, c, d};
+    }
+
+};
+
+namespace quaternion_track_detail {
+
+    /**
+     * Lanes of one interpolation mode waiting for a full pack
+     */
+    template<typename P, typename T>
+    struct staging {
+        std::size_t count = 0;
+        std::size_t targets[P::width];
+        T in[inputs * P::width];
+        T out[4][P::width];
+
+        void flush(TrackInterpolation mode, Quaternion<T>* result) {
+            if (this->count == 0) {
+                return;
+            }
+            // pad with the first lane, the padding results are dropped
+            for (std::size_t l = this->count; l < P::width; ++l) {
+                for (std::size_t k = 0; k < inputs; ++k) {
+                    this->in[k * P::width + l] = this->in[k * P::width];
+                }
+            }
+            interpolate<P>(mode, this->in, P::width, this->out[0], this->out[1], this->out[2], this->out[3]);
+            for (std::size_t l = 0; l < this->count; ++l) {
+                result[this->targets[l]] = Quaternion<T>(this->out[0][l], this->out[1][l], this->out[2][l], this->out[3][l]);
+            }
+            this->count = 0;
+        }
+
+        void push(const QuaternionTrack<T>& track, std::size_t s, const T& time, std::size_t target, Quaternion<T>* result) {
+            const T* controls = track.control_data(s);
+            for (std::size_t k = 0; k < 16; ++k) {
+                this->in[k * P::width + this->count] = controls[k];
+            }
+            this->in[16 * P::width + this->count] = track.parameter(s, time);
+            this->targets[this->count] = target;
+            if (++this->count == P::width) {
+                this->flush(track.interpolation(), result);
+            }
+        }
+    };
+
+    template<typename T, typename F>
+    void evaluate(const std::vector<QuaternionTrack<T>>& tracks, std::vector<TrackCursor>& cursors, F time_of, Quaternion<T>* out) {
+        using P = quaternion_simd::pack<T>;
+        cursors.resize(tracks.size());
+        QUATERNION_TIMED_KERNEL("track evaluate", tracks.size());
+        quaternion_parallel::parallel_for(tracks.size(), grain, [&](std::size_t first, std::size_t last) {
+            staging<P, T> squad, cubic;
+            for (std::size_t i = first; i < last; ++i) {
+                // every track is a few scattered cache lines, fetch ahead
+                if (i + 8 < last) {
+                    tracks[i + 8].prefetch(cursors[i + 8]);
+                }
+                const QuaternionTrack<T>& track = tracks[i];
+                T time = time_of(i);
+                std::size_t s = track.locate(time, cursors[i]);
+                (track.interpolation() == TrackInterpolation::Squad ? squad : cubic).push(track, s, time, i, out);
+            }
+            squad.flush(TrackInterpolation::Squad, out);
+            cubic.flush(TrackInterpolation::Cubic, out);
+        });
+    }
+
+}
+
+/**
+ * Sample every track at the same time: out[i] = tracks[i](time, cursors[i]).
+ * cursors is resized to tracks.size() if needed. Lookups are scalar,
+ * interpolations of the same mode are evaluated a SIMD pack at a time and
+ * large batches are split across threads.
+ */
+template<typename T>
+void evaluate_tracks(const std::vector<QuaternionTrack<T>>& tracks, std::vector<TrackCursor>& cursors, const T& time, Quaternion<T>* out) {
+    quaternion_track_detail::evaluate(tracks, cursors, [&](std::size_t) { return time; }, out);
+}
+
+/**
+ * Sample every track at its own time: out[i] = tracks[i](times[i], cursors[i])
+ */
+template<typename T>
+void evaluate_tracks(const std::vector<QuaternionTrack<T>>& tracks, std::vector<TrackCursor>& cursors, const T* times, Quaternion<T>* out) {
+    quaternion_track_detail::evaluate(tracks, cursors, [&](std::size_t i) { return times[i]; }, out);
+}
+
+#endif // QUATER_TRACK_H
@@ -0,0 +1,238 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#ifndef QUATER_VALIDATE_H
+#define QUATER_VALIDATE_H
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionSimd.h"
+#include "QuaternionSpan.h"
+
+/**
+ * Element test of the batch validators.
+ *  - NaN: some component is NaN (std::isnan)
+ *  - Inf: some component is infinite (std::isinf)
+ *  - NonFinite: some component is NaN or infinite (!std::isfinite)
+ *  - NonUnit: non-finite, or the norm differs from 1 by more than the tolerance
+ */
+enum class QuaternionCheck {
+    NaN,
+    Inf,
+    NonFinite,
+    NonUnit
+};
+
+namespace quaternion_validate_detail {
+
+    /**
+     * Lane bits of the elements failing check. x - x is NaN exactly when x
+     * is NaN or infinite, so no comparison against infinity is needed.
+     */
+    template<typename P>
+    inline unsigned invalid_bits(const typename P::type (&q)[4], QuaternionCheck check, typename P::value_type tolerance) {
+        using T = typename P::value_type;
+        unsigned nan = 0, inf = 0, nonfinite = 0;
+        for (std::size_t k = 0; k < 4; ++k) {
+            auto z = P::sub(q[k], q[k]);
+            unsigned n = P::bits(P::unordered(q[k], q[k]));
+            unsigned f = P::bits(P::unordered(z, z));
+            nan |= n;
+            inf |= f & ~n;
+            nonfinite |= f;
+        }
+        switch (check) {
+            case QuaternionCheck::NaN:
+                return nan;
+            case QuaternionCheck::Inf:
+                return inf;
+            case QuaternionCheck::NonFinite:
+                return nonfinite;
+            default: {
+                auto norm = P::add(P::add(P::add(P::mul(q[0], q[0]), P::mul(q[1], q[1])), P::mul(q[2], q[2])), P::mul(q[3], q[3]));
+                auto drift = P::abs(P::sub(norm, P::set1(static_cast<T>(1))));
+                return nonfinite | P::bits(P::less(P::set1(tolerance), drift));
+            }
+        }
+    }
+
+    template<typename T>
+    struct soa_source {
+        const T* a;
+        const T* b;
+        const T* c;
+        const T* d;
+
+        template<typename P>
+        void load(std::size_t i, typename P::type (&q)[4]) const {
+            q[0] = P::load(this->a + i);
+            q[1] = P::load(this->b + i);
+            q[2] = P::load(this->c + i);
+            q[3] = P::load(this->d + i);
+        }
+    };
+
+    template<typename T>
+    struct aos_source {
+        const Quaternion<T>* ptr;
+
+        template<typename P>
+        void load(std::size_t i, typename P::type (&q)[4]) const {
+            T lanes[4][P::width];
+            for (std::size_t l = 0; l < P::width; ++l) {
+                lanes[0][l] = this->ptr[i + l].a();
+                lanes[1][l] = this->ptr[i + l].b();
+                lanes[2][l] = this->ptr[i + l].c();
+                lanes[3][l] = this->ptr[i + l].d();
+            }
+            for (std::size_t k = 0; k < 4; ++k) {
+                q[k] = P::load(lanes[k]);
+            }
+        }
+    };
+
+    /**
+     * Call visit(i, bits) for every pack of elements starting at i, bit l of
+     * bits set when element i + l fails check. Tails are one element wide.
+     */
+    template<typename T, typename Source, typename Visit>
+    void scan(std::size_t size, const Source& source, QuaternionCheck check, T tolerance, Visit visit) {
+        using P = quaternion_simd::pack<T>;
+        using S = quaternion_simd::scalar_pack<T>;
+        std::size_t i = 0;
+        for (; i + P::width <= size; i += P::width) {
+            typename P::type q[4];
+            source.template load<P>(i, q);
+            visit(i, invalid_bits<P>(q, check, tolerance));
+        }
+        for (; i < size; ++i) {
+            T q[4];
+            source.template load<S>(i, q);
+            visit(i, invalid_bits<S>(q, check, tolerance));
+        }
+    }
+
+    template<typename T, typename Source>
+    std::size_t count(std::size_t size, const Source& source, QuaternionCheck check, T tolerance) {
+        std::size_t total = 0;
+        scan(size, source, check, tolerance, [&](std::size_t, unsigned bits) {
+            total += std::bitset<32>(bits).count();
+        });
+        return total;
+    }
+
+    template<typename T, typename Source>
+    std::vector<std::uint64_t> mask(std::size_t size, const Source& source, QuaternionCheck check, T tolerance) {
+        std::vector<std::uint64_t> words((size + 63) / 64, 0);
+        scan(size, source, check, tolerance, [&](std::size_t i, unsigned bits) {
+            for (; bits != 0; bits &= bits - 1) {
+                std::size_t e = i + static_cast<std::size_t>(__builtin_ctz(bits));
+                words[e / 64] |= std::uint64_t(1) << (e % 64);
+            }
+        });
+        return words;
+    }
+
+}
+
+/**
+ * Number of elements failing check
+ */
+template<typename T>
+std::size_t count_invalid(const QuaternionArray<T>& quats, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    return quaternion_validate_detail::count(quats.size(), quaternion_validate_detail::soa_source<T>{quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data()}, check, tolerance);
+}
+
+template<typename T>
+std::size_t count_invalid(QuaternionSpan<T> quats, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    return quaternion_validate_detail::count(quats.size(), quaternion_validate_detail::aos_source<T>{quats.data()}, check, tolerance);
+}
+
+template<typename T>
+std::size_t count_invalid(const std::vector<Quaternion<T>>& quats, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    return count_invalid(QuaternionSpan<T>(quats), check, tolerance);
+}
+
+/**
+ * Bitmask of the elements failing check: element i is bit i % 64 of word i / 64
+ */
+template<typename T>
+std::vector<std::uint64_t> invalid_mask(const QuaternionArray<T>& quats, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    return quaternion_validate_detail::mask(quats.size(), quaternion_validate_detail::soa_source<T>{quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data()}, check, tolerance);
+}
+
+template<typename T>
+std::vector<std::uint64_t> invalid_mask(QuaternionSpan<T> quats, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    return quaternion_validate_detail::mask(quats.size(), quaternion_validate_detail::aos_source<T>{quats.data()}, check, tolerance);
+}
+
+template<typename T>
+std::vector<std::uint64_t> invalid_mask(const std::vector<Quaternion<T>>& quats, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    return invalid_mask(QuaternionSpan<T>(quats), check, tolerance);
+}
+
+/**
+ * Replace in place every element failing check with replacement, return
+ * the number of replaced elements. Clean packs are not written.
+ */
+template<typename T>
+std::size_t sanitize(QuaternionArray<T>& quats, const Quaternion<T>& replacement, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    std::size_t total = 0;
+    quaternion_validate_detail::scan(quats.size(), quaternion_validate_detail::soa_source<T>{quats.a_data(), quats.b_data(), quats.c_data(), quats.d_data()}, check, tolerance,
+        [&](std::size_t i, unsigned bits) {
+            for (; bits != 0; bits &= bits - 1, ++total) {
+                quats.set(i + static_cast<std::size_t>(__builtin_ctz(bits)), replacement);
+            }
+        });
+    return total;
+}
+
+template<typename T>
+std::size_t sanitize(Quaternion<T>* quats, std::size_t size, const Quaternion<T>& replacement, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    std::size_t total = 0;
+    quaternion_validate_detail::scan(size, quaternion_validate_detail::aos_source<T>{quats}, check, tolerance,
+        [&](std::size_t i, unsigned bits) {
+            for (; bits != 0; bits &= bits - 1, ++total) {
+                quats[i + static_cast<std::size_t>(__builtin_ctz(bits))] = replacement;
+            }
+        });
+    return total;
+}
+
+template<typename T>
+std::size_t sanitize(std::vector<Quaternion<T>>& quats, const Quaternion<T>& replacement, QuaternionCheck check = QuaternionCheck::NonFinite, const typename Quaternion<T>::value_type& tolerance = static_cast<T>(0)) {
+    return sanitize(quats.data(), quats.size(), replacement, check, tolerance);
+}
+
+#endif // QUATER_VALIDATE_H
@@ -0,0 +1,789 @@
+/*
+ * Copyright © 2019 Andrea Bontempi All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ * 
+ * - Redistributions of source code must retain the above copyright notice, this
+ *   list of conditions and the following disclaimer.
+ * 
+ * - Redistributions in binary form must reproduce the above copyright notice, this
+ *   list of conditions and the following disclaimer in the documentation and/or
+ *   other materials provided with the distribution.
+ * 
+ * - Neither the name of Andrea Bontempi nor the names of its contributors may be used to
+ *   endorse or promote products derived from this software without specific prior
+ *   written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS “AS IS” AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ * ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ * 
+ */
+
+#include <chrono>
+#include <complex>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionIntegration.h"
+#include "QuaternionPacked.h"
+#include "QuaternionDual.h"
+#include "QuaternionFma.h"
+#include "QuaternionAverage.h"
+#include "QuaternionIndex.h"
+#include "QuaternionValidate.h"
+#include "QuaternionFilter.h"
+#include "QuaternionHierarchy.h"
+#include "QuaternionFourier.h"
+#include "QuaternionComplex.h"
+#include "QuaternionTrack.h"
+#include "QuaternionText.h"
+
+/**
+ * Throughput and latency benchmark of the quaternion operators.
+ *
+ * Every operator overload is run in two modes:
+ *  - latency: a chain of dependent operations on a single value
+ *  - throughput: independent operations over large arrays
+ *
+ * Usage: quaternion_bench [--csv|--json] [--size N] [--min-time MS] [--filter TEXT] [--output FILE] [--check]
+ *
+ * --check only compares the operators with hook-free reference kernels and
+ * fails on any difference, without timing anything.
+ */
+
+template<typename T> struct type_name;
+template<> struct type_name<int> { static constexpr const char* value = "int"; };
+template<> struct type_name<float> { static constexpr const char* value = "float"; };
+template<> struct type_name<double> { static constexpr const char* value = "double"; };
+template<> struct type_name<long double> { static constexpr const char* value = "long double"; };
+template<typename T> struct type_name<Quaternion<T>> {
+    static std::string get() { return std::string("quaternion<") + type_name<T>::value + ">"; }
+};
+template<typename T> struct type_name<std::complex<T>> {
+    static std::string get() { return std::string("complex<") + type_name<T>::value + ">"; }
+};
+template<typename T> struct type_name<QuaternionArray<T>> {
+    static std::string get() { return std::string("array<") + type_name<T>::value + ">"; }
+};
+
+template<typename T>
+std::string name_of() {
+    if constexpr (std::is_arithmetic<T>::value) {
+        return type_name<T>::value;
+    } else {
+        return type_name<T>::get();
+    }
+}
+
+/**
+ * Keep the compiler from optimizing a value away
+ */
+template<typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "r"(&value) : "memory");
+}
+
+template<typename T> struct is_quaternion : std::false_type {};
+template<typename T> struct is_quaternion<Quaternion<T>> : std::true_type {};
+
+/**
+ * Deterministic sample values. Scalars alternate between 2 and 1/2 and
+ * quaternions and complex numbers have unit modulus, so that dependent
+ * chains neither overflow nor decay into denormals.
+ */
+template<typename T>
+T sample(std::size_t i, T*) {
+    if constexpr (std::is_integral<T>::value) {
+        return i % 2 ? 1 : -1;
+    } else {
+        return i % 2 ? static_cast<T>(2) : static_cast<T>(0.5);
+    }
+}
+
+template<typename T>
+std::complex<T> sample(std::size_t i, std::complex<T>*) {
+    return i % 2 ? std::complex<T>(static_cast<T>(0.6), static_cast<T>(0.8)) : std::complex<T>(static_cast<T>(0.8), static_cast<T>(-0.6));
+}
+
+template<typename T>
+Quaternion<T> sample(std::size_t i, Quaternion<T>*) {
+    if constexpr (std::is_integral<T>::value) {
+        return i % 2 ? Quaternion<T>(0, 1, 0, 0) : Quaternion<T>(0, 0, 0, -1);
+    } else {
+        return normalized(Quaternion<T>(static_cast<T>(1) + static_cast<T>(i % 7) / static_cast<T>(8), static_cast<T>(0.5), static_cast<T>(-0.25), static_cast<T>(0.125)));
+    }
+}
+
+struct Result {
+    std::string op;
+    std::string lhs;
+    std::string rhs;
+    std::string mode;
+    double ns_per_op;
+};
+
+class Bench {
+
+private:
+
+    std::size_t size;
+    double min_time_ns;
+    std::string filter;
+    std::vector<Result> results;
+
+    /**
+     * Repeat fn until min_time is reached, return ns per call
+     */
+    template<typename F>
+    double measure(F&& fn) {
+        using clock = std::chrono::steady_clock;
+        fn();
+        std::size_t reps = 1;
+        while (true) {
+            auto start = clock::now();
+            for (std::size_t r = 0; r < reps; ++r) {
+                fn();
+            }
+            double elapsed = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            if (elapsed >= this->min_time_ns) {
+                return elapsed / static_cast<double>(reps);
+            }
+            reps *= 2;
+        }
+    }
+
+    bool selected(const std::string& label) const {
+        return this->filter.empty() || label.find(this->filter) != std::string::npos;
+    }
+
+    void record(const std::string& op, const std::string& lhs, const std::string& rhs, const std::string& mode, double ns_per_op) {
+        this->results.push_back({op, lhs, rhs, mode, ns_per_op});
+        std::cerr << op << " " << lhs << " " << rhs << " " << mode << " " << ns_per_op << " ns/op" << std::endl;
+    }
+
+public:
+
+    Bench(std::size_t size, double min_time_ms, const std::string& filter)
+        : size(size), min_time_ns(min_time_ms * 1e6), filter(filter) {}
+
+    /**
+     * Binary operator on single values and on arrays of values
+     */
+    template<typename L, typename R, typename Op>
+    void binary(const std::string& op, Op fn) {
+        std::string lhs_name = name_of<L>(), rhs_name = name_of<R>();
+        if (!this->selected(op + " " + lhs_name + " " + rhs_name)) {
+            return;
+        }
+        std::vector<L> lhs(this->size);
+        std::vector<R> rhs(this->size);
+        for (std::size_t i = 0; i < this->size; ++i) {
+            lhs[i] = sample(i, static_cast<L*>(nullptr));
+            rhs[i] = sample(i + 1, static_cast<R*>(nullptr));
+        }
+        using Res = decltype(fn(lhs[0], rhs[0]));
+        std::vector<Res> out(this->size);
+        double ns = this->measure([&] {
+            for (std::size_t i = 0; i < this->size; ++i) {
+                out[i] = fn(lhs[i], rhs[i]);
+            }
+            keep(out[0]);
+        });
+        this->record(op, lhs_name, rhs_name, "throughput", ns / static_cast<double>(this->size));
+        ns = this->measure([&] {
+            if constexpr (is_quaternion<L>::value) {
+                L acc = lhs[0];
+                for (std::size_t i = 0; i < this->size; ++i) {
+                    acc = L(fn(acc, rhs[i]));
+                }
+                keep(acc);
+            } else {
+                R acc = rhs[0];
+                for (std::size_t i = 0; i < this->size; ++i) {
+                    acc = R(fn(lhs[i], acc));
+                }
+                keep(acc);
+            }
+        });
+        this->record(op, lhs_name, rhs_name, "latency", ns / static_cast<double>(this->size));
+    }
+
+    /**
+     * Unary function on single values and on arrays of values
+     */
+    template<typename Q, typename Op>
+    void unary(const std::string& op, Op fn) {
+        std::string name = name_of<Q>();
+        if (!this->selected(op + " " + name)) {
+            return;
+        }
+        std::vector<Q> in(this->size);
+        for (std::size_t i = 0; i < this->size; ++i) {
+            in[i] = sample(i, static_cast<Q*>(nullptr));
+        }
+        using Res = decltype(fn(in[0]));
+        std::vector<Res> out(this->size);
+        double ns = this->measure([&] {
+            for (std::size_t i = 0; i < this->size; ++i) {
+                out[i] = fn(in[i]);
+            }
+            keep(out[0]);
+        });
+        this->record(op, name, "", "throughput", ns / static_cast<double>(this->size));
+        if constexpr (std::is_same<Res, Q>::value) {
+            ns = this->measure([&] {
+                Q acc = in[0];
+                for (std::size_t i = 0; i < this->size; ++i) {
+                    acc = fn(acc);
+                }
+                keep(acc);
+            });
+            this->record(op, name, "", "latency", ns / static_cast<double>(this->size));
+        }
+    }
+
+    /**
+     * Batched operation over structure-of-arrays containers
+     */
+    template<typename T, typename Op>
+    void batch(const std::string& op, Op fn, bool binary = true) {
+        std::string name = name_of<QuaternionArray<T>>();
+        if (!this->selected(op + " " + name)) {
+            return;
+        }
+        QuaternionArray<T> lhs(this->size), rhs(this->size);
+        for (std::size_t i = 0; i < this->size; ++i) {
+            lhs.set(i, sample(i, static_cast<Quaternion<T>*>(nullptr)));
+            rhs.set(i, sample(i + 1, static_cast<Quaternion<T>*>(nullptr)));
+        }
+        double ns = this->measure([&] {
+            auto out = fn(lhs, rhs);
+            keep(out);
+        });
+        this->record(op, name, binary ? name : "", "throughput", ns / static_cast<double>(this->size));
+    }
+
+    /**
+     * Arbitrary kernel processing ops elements per call
+     */
+    template<typename F>
+    void kernel(const std::string& op, const std::string& type, std::size_t ops, F&& fn) {
+        if (!this->selected(op + " " + type)) {
+            return;
+        }
+        this->record(op, type, "", "throughput", this->measure(fn) / static_cast<double>(ops));
+    }
+
+    void write_csv(std::ostream& os) const {
+        os << "op,lhs,rhs,mode,ns_per_op" << std::endl;
+        for (const Result& r : this->results) {
+            os << r.op << "," << r.lhs << "," << r.rhs << "," << r.mode << "," << r.ns_per_op << std::endl;
+        }
+    }
+
+    void write_json(std::ostream& os) const {
+        os << "[" << std::endl;
+        for (std::size_t i = 0; i < this->results.size(); ++i) {
+            const Result& r = this->results[i];
+            os << "  {\"op\": \"" << r.op << "\", \"lhs\": \"" << r.lhs << "\", \"rhs\": \"" << r.rhs
+               << "\", \"mode\": \"" << r.mode << "\", \"ns_per_op\": " << r.ns_per_op << "}"
+               << (i + 1 < this->results.size() ? "," : "") << std::endl;
+        }
+        os << "]" << std::endl;
+    }
+
+};
+
+/**
+ * Every arithmetic operator for one lhs/rhs type pair
+ */
+template<typename A, typename B>
+void arithmetic(Bench& bench) {
+    using QA = Quaternion<A>;
+    using QB = Quaternion<B>;
+    bench.binary<QA, QB>("+", [](const QA& l, const QB& r) { return l + r; });
+    bench.binary<QA, QB>("-", [](const QA& l, const QB& r) { return l - r; });
+    bench.binary<QA, QB>("*", [](const QA& l, const QB& r) { return l * r; });
+    bench.binary<QA, QB>("/", [](const QA& l, const QB& r) { return l / r; });
+    bench.binary<QA, B>("+", [](const QA& l, const B& r) { return l + r; });
+    bench.binary<QA, B>("-", [](const QA& l, const B& r) { return l - r; });
+    bench.binary<QA, B>("*", [](const QA& l, const B& r) { return l * r; });
+    bench.binary<QA, B>("/", [](const QA& l, const B& r) { return l / r; });
+    bench.binary<A, QB>("+", [](const A& l, const QB& r) { return l + r; });
+    bench.binary<A, QB>("-", [](const A& l, const QB& r) { return l - r; });
+    bench.binary<A, QB>("*", [](const A& l, const QB& r) { return l * r; });
+    bench.binary<A, QB>("/", [](const A& l, const QB& r) { return l / r; });
+    if constexpr (std::is_floating_point<B>::value) {
+        using CB = std::complex<B>;
+        bench.binary<QA, CB>("+", [](const QA& l, const CB& r) { return l + r; });
+        bench.binary<QA, CB>("-", [](const QA& l, const CB& r) { return l - r; });
+        bench.binary<QA, CB>("*", [](const QA& l, const CB& r) { return l * r; });
+        bench.binary<CB, QA>("+", [](const CB& l, const QA& r) { return l + r; });
+        bench.binary<CB, QA>("-", [](const CB& l, const QA& r) { return l - r; });
+        bench.binary<CB, QA>("*", [](const CB& l, const QA& r) { return l * r; });
+    }
+}
+
+/**
+ * Hook-free reference kernels of the hot operators: the plain Hamilton
+ * product, division and normalization, written without instrumentation
+ * hooks or SIMD overloads. They are benchmarked next to the operators and
+ * compared with them bit for bit by --check.
+ */
+namespace reference {
+
+    template<typename T>
+    Quaternion<T> multiply(const Quaternion<T>& l, const Quaternion<T>& r) {
+        return {QUATERNION_NO_CONTRACT(l.a() * r.a()) - QUATERNION_NO_CONTRACT(l.b() * r.b()) - QUATERNION_NO_CONTRACT(l.c() * r.c()) - QUATERNION_NO_CONTRACT(l.d() * r.d()),
+                QUATERNION_NO_CONTRACT(l.a() * r.b()) + QUATERNION_NO_CONTRACT(l.b() * r.a()) + QUATERNION_NO_CONTRACT(l.c() * r.d()) - QUATERNION_NO_CONTRACT(l.d() * r.c()),
+                QUATERNION_NO_CONTRACT(l.a() * r.c()) + QUATERNION_NO_CONTRACT(l.c() * r.a()) + QUATERNION_NO_CONTRACT(l.d() * r.b()) - QUATERNION_NO_CONTRACT(l.b() * r.d()),
+                QUATERNION_NO_CONTRACT(l.a() * r.d()) + QUATERNION_NO_CONTRACT(l.d() * r.a()) + QUATERNION_NO_CONTRACT(l.b() * r.c()) - QUATERNION_NO_CONTRACT(l.c() * r.b())};
+    }
+
+    template<typename T>
+    Quaternion<T> divide(const Quaternion<T>& l, const Quaternion<T>& r) {
+        T norm = std::norm(r);
+        return {(QUATERNION_NO_CONTRACT(l.a() * r.a()) + QUATERNION_NO_CONTRACT(l.b() * r.b()) + QUATERNION_NO_CONTRACT(l.c() * r.c()) + QUATERNION_NO_CONTRACT(l.d() * r.d())) / norm,
+                (- QUATERNION_NO_CONTRACT(l.a() * r.b()) + QUATERNION_NO_CONTRACT(l.b() * r.a()) - QUATERNION_NO_CONTRACT(l.c() * r.d()) + QUATERNION_NO_CONTRACT(l.d() * r.c())) / norm,
+                (- QUATERNION_NO_CONTRACT(l.a() * r.c()) + QUATERNION_NO_CONTRACT(l.c() * r.a()) - QUATERNION_NO_CONTRACT(l.d() * r.b()) + QUATERNION_NO_CONTRACT(l.b() * r.d())) / norm,
+                (- QUATERNION_NO_CONTRACT(l.a() * r.d()) + QUATERNION_NO_CONTRACT(l.d() * r.a()) - QUATERNION_NO_CONTRACT(l.b() * r.c()) + QUATERNION_NO_CONTRACT(l.c() * r.b())) / norm};
+    }
+
+    template<typename T>
+    Quaternion<T> normalize(const Quaternion<T>& q) {
+        T modulus = std::abs(q);
+        return {q.a() / modulus, q.b() / modulus, q.c() / modulus, q.d() / modulus};
+    }
+
+    /**
+     * Number of inputs on which the operators differ from the references
+     */
+    template<typename T>
+    std::size_t mismatches(std::size_t size) {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < size; ++i) {
+            T s = static_cast<T>(i) * static_cast<T>(0.618034);
+            Quaternion<T> l(std::cos(s), std::sin(s * 3), std::cos(s * 7) * 2, std::sin(s * 13));
+            Quaternion<T> r(std::sin(s * 5), std::cos(s * 11), std::sin(s * 2), std::cos(s * 17) * 3);
+            count += !(l * r == multiply(l, r));
+            count += !(l / r == divide(l, r));
+            count += !(normalized(l) == normalize(l));
+        }
+        return count;
+    }
+
+}
+
+/**
+ * Operators against their hook-free references
+ */
+template<typename T>
+void overhead(Bench& bench) {
+    using Q = Quaternion<T>;
+    bench.binary<Q, Q>("* reference", [](const Q& l, const Q& r) { return reference::multiply(l, r); });
+    bench.binary<Q, Q>("/ reference", [](const Q& l, const Q& r) { return reference::divide(l, r); });
+    bench.unary<Q>("normalized reference", [](const Q& q) { return reference::normalize(q); });
+}
+
+template<typename T>
+void functions(Bench& bench) {
+    using Q = Quaternion<T>;
+    bench.unary<Q>("normalized", [](const Q& q) { return normalized(q); });
+    bench.unary<Q>("fast_normalized", [](const Q& q) { return fast_normalized(q); });
+    bench.unary<Q>("inverse", [](const Q& q) { return inverse(q); });
+    bench.unary<Q>("abs", [](const Q& q) { return std::abs(q); });
+    bench.unary<Q>("norm", [](const Q& q) { return std::norm(q); });
+    bench.unary<Q>("conj", [](const Q& q) { return std::conj(q); });
+    bench.unary<Q>("isfinite", [](const Q& q) { return std::isfinite(q); });
+    bench.unary<Q>("exp", [](const Q& q) { return std::exp(q); });
+    bench.unary<Q>("log", [](const Q& q) { return std::log(q); });
+    bench.unary<Q>("pow", [](const Q& q) { return std::pow(q, static_cast<T>(0.5)); });
+    if constexpr (std::is_floating_point<T>::value) {
+        bench.binary<Q, Q>("fma *", [](const Q& l, const Q& r) { return quaternion_fma::multiply(l, r); });
+        bench.binary<Q, Q>("fma /", [](const Q& l, const Q& r) { return quaternion_fma::divide(l, r); });
+        bench.unary<Q>("fma norm", [](const Q& q) { return quaternion_fma::norm(q); });
+    }
+}
+
+template<typename T>
+void arrays(Bench& bench) {
+    using A = QuaternionArray<T>;
+    bench.batch<T>("+", [](const A& l, const A& r) { return l + r; });
+    bench.batch<T>("-", [](const A& l, const A& r) { return l - r; });
+    bench.batch<T>("*", [](const A& l, const A& r) { return l * r; });
+    bench.batch<T>("/", [](const A& l, const A& r) { return l / r; });
+    bench.batch<T>("normalized", [](const A& l, const A&) { return normalized(l); }, false);
+    bench.batch<T>("inverse", [](const A& l, const A&) { return inverse(l); }, false);
+    bench.batch<T>("renormalize_inplace", [](const A& l, const A&) {
+        A copy = l;
+        renormalize_inplace(copy);
+        return copy;
+    }, false);
+    bench.batch<T>("integrate_angular_velocity", [](const A& l, const A& r) {
+        A copy = l;
+        integrate_angular_velocity(copy, r.b_data(), r.c_data(), r.d_data(), static_cast<T>(0.01));
+        return copy;
+    });
+    bench.batch<T>("average", [](const A& l, const A&) { return average(l); }, false);
+    bench.batch<T>("average_aligned", [](const A& l, const A&) { return average(l, nullptr, AverageMethod::SignAligned); }, false);
+    bench.batch<T>("count_invalid", [](const A& l, const A&) { return count_invalid(l, QuaternionCheck::NonUnit, static_cast<T>(1e-3)); }, false);
+    bench.batch<T>("encode32", [](const A& l, const A&) {
+        std::vector<PackedQuaternion32> packed(l.size());
+        encode(l, packed.data());
+        return packed;
+    }, false);
+    bench.batch<T>("encode_half", [](const A& l, const A&) {
+        std::vector<HalfQuaternion> packed(l.size());
+        encode(l, packed.data());
+        return packed;
+    }, false);
+}
+
+template<typename T>
+void text(Bench& bench, std::size_t size) {
+    std::string name = name_of<Quaternion<T>>();
+    std::vector<Quaternion<T>> quats(size);
+    std::string buffer(size * 128, ' ');
+    char* end = &buffer[0];
+    for (std::size_t i = 0; i < size; ++i) {
+        quats[i] = sample(i, static_cast<Quaternion<T>*>(nullptr));
+        end = to_chars(end, &buffer[0] + buffer.size(), quats[i]).ptr;
+        *end++ = '\n';
+    }
+    buffer.resize(end - &buffer[0]);
+    bench.kernel("to_chars", name, size, [&] {
+        char* ptr = &buffer[0];
+        for (std::size_t i = 0; i < size; ++i) {
+            ptr = to_chars(ptr, &buffer[0] + buffer.size(), quats[i]).ptr;
+        }
+        keep(ptr);
+    });
+    bench.kernel("parse_quaternions", name, size, [&] {
+        QuaternionArray<T> parsed;
+        parsed.reserve(size);
+        parse_quaternions(buffer.data(), buffer.data() + buffer.size(), parsed);
+        keep(parsed);
+    });
+    bench.kernel("operator>>", name, size, [&] {
+        std::istringstream stream(buffer);
+        Quaternion<T> quat;
+        while (stream >> quat) {
+            keep(quat);
+        }
+    });
+}
+
+/**
+ * Dual quaternion skinning with four influences per vertex
+ */
+template<typename T>
+void skinning(Bench& bench, std::size_t size) {
+    const std::size_t influences = 4;
+    std::vector<DualQuaternion<T>> bones;
+    for (std::size_t b = 0; b < 64; ++b) {
+        bones.push_back(rigid_transform(sample(b, static_cast<Quaternion<T>*>(nullptr)), {static_cast<T>(b), static_cast<T>(1), static_cast<T>(-1)}));
+    }
+    std::vector<std::uint32_t> joints(influences * size);
+    std::vector<T> weights(influences * size, static_cast<T>(0.25)), xs(size, static_cast<T>(1)), ys(size), zs(size), ox(size), oy(size), oz(size);
+    for (std::size_t i = 0; i < joints.size(); ++i) {
+        joints[i] = static_cast<std::uint32_t>((i * 7) % bones.size());
+    }
+    bench.kernel("skin", name_of<T>(), size, [&] {
+        skin(bones, joints.data(), weights.data(), influences, xs.data(), ys.data(), zs.data(), ox.data(), oy.data(), oz.data(), size);
+        keep(ox);
+    });
+}
+
+/**
+ * Orientation filters over size sensor channels, blocks of 16 samples and
+ * single-sample blocks (one call per sensor tick)
+ */
+template<typename T>
+void filtering(Bench& bench, std::size_t size) {
+    for (std::size_t samples : {std::size_t(16), std::size_t(1)}) {
+        std::vector<T> gyro(samples * size, static_cast<T>(0.01)), acc(samples * size, static_cast<T>(0.5)), mag(samples * size, static_cast<T>(0.3));
+        std::vector<T> a(samples * size), b(samples * size), c(samples * size), d(samples * size);
+        ImuBlock<T> in;
+        in.samples = samples;
+        in.gx = in.gy = in.gz = gyro.data();
+        in.ax = in.ay = in.az = acc.data();
+        in.mx = in.my = in.mz = mag.data();
+        for (FilterAlgorithm algorithm : {FilterAlgorithm::Madgwick, FilterAlgorithm::Mahony}) {
+            FilterSettings<T> settings;
+            settings.algorithm = algorithm;
+            OrientationFilter<T> filter(size, settings);
+            std::string op = algorithm == FilterAlgorithm::Madgwick ? "madgwick" : "mahony";
+            bench.kernel(samples == 1 ? op + " 1 sample" : op, name_of<T>(), samples * size, [&] {
+                filter.process(in, OrientationStream<T>{a.data(), b.data(), c.data(), d.data()});
+                keep(a);
+            });
+        }
+    }
+}
+
+/**
+ * Rotation hierarchy of size nodes (4-ary tree): full recomposition against
+ * an incremental update after changing 1% of the local rotations
+ */
+template<typename T>
+void hierarchy(Bench& bench, std::size_t size) {
+    std::string name = name_of<Quaternion<T>>();
+    std::vector<std::size_t> parents(size);
+    std::vector<Quaternion<T>> locals(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        parents[n] = n == 0 ? QuaternionHierarchy<T>::root : (n - 1) / 4;
+        locals[n] = sample(n, static_cast<Quaternion<T>*>(nullptr));
+    }
+    QuaternionHierarchy<T> tree(parents, locals);
+    bench.kernel("hierarchy update_all", name, size, [&] {
+        tree.update_all();
+        keep(tree);
+    });
+    std::size_t next = 0;
+    bench.kernel("hierarchy update 1%", name, size, [&] {
+        for (std::size_t k = 0; k < size / 100; ++k) {
+            next = (next + 7919) % size;
+            tree.set_local(next, locals[next]);
+        }
+        tree.update();
+        keep(tree);
+    });
+}
+
+/**
+ * Quaternion Fourier transform: 1D of size samples, 2D of a square image of
+ * about size pixels, left sided with the gray axis
+ */
+template<typename T>
+void fourier(Bench& bench, std::size_t size) {
+    std::string name = name_of<Quaternion<T>>();
+    Quaternion<T> gray = normalized(Quaternion<T>(0, 1, 1, 1));
+    std::vector<Quaternion<T>> data(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        data[i] = sample(i, static_cast<Quaternion<T>*>(nullptr));
+    }
+    QftPlan<T> plan1d(size, gray);
+    bench.kernel("qft1d", name, size, [&] {
+        plan1d.forward(data.data(), data.data());
+        keep(data);
+    });
+    std::size_t side = static_cast<std::size_t>(std::sqrt(static_cast<double>(size)));
+    QftPlan<T> plan2d(side, side, gray);
+    bench.kernel("qft2d", name, side * side, [&] {
+        plan2d.forward(data.data(), data.data());
+        keep(data);
+    });
+}
+
+/**
+ * Quaternion times complex over complex buffers: copied through a
+ * quaternion vector, against the interleaved and split views
+ */
+template<typename T>
+void complexes(Bench& bench, std::size_t size) {
+    std::string name = name_of<std::complex<T>>();
+    std::vector<std::complex<T>> pairs(2 * size), first(size), second(size), factors(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        Quaternion<T> q = sample(i, static_cast<Quaternion<T>*>(nullptr));
+        pairs[2 * i] = first[i] = q.complex_a();
+        pairs[2 * i + 1] = second[i] = q.complex_b();
+        factors[i] = std::polar(static_cast<T>(1), static_cast<T>(i));
+    }
+    std::vector<Quaternion<T>> quats(size);
+    bench.kernel("complex mul copy", name, size, [&] {
+        for (std::size_t i = 0; i < size; ++i) {
+            quats[i] = Quaternion<T>(first[i], second[i]) * factors[i];
+        }
+        for (std::size_t i = 0; i < size; ++i) {
+            first[i] = quats[i].complex_a();
+            second[i] = quats[i].complex_b();
+        }
+        keep(first);
+    });
+    ComplexPairSpan<T> interleaved(pairs);
+    bench.kernel("complex mul interleaved", name, size, [&] {
+        multiply(interleaved, factors.data(), interleaved);
+        keep(pairs);
+    });
+    SplitComplexSpan<T> split(first, second);
+    bench.kernel("complex mul split", name, size, [&] {
+        multiply(split, factors.data(), split);
+        keep(first);
+    });
+}
+
+/**
+ * Keyframe tracks of 16 keys sampled at advancing times: one lookup and
+ * interpolation per track, against the batched evaluation with cursors
+ */
+template<typename T>
+void tracks(Bench& bench, std::size_t size) {
+    std::string name = name_of<Quaternion<T>>();
+    std::vector<T> times(16);
+    std::vector<Quaternion<T>> keys(16);
+    std::vector<Quaternion<T>> out(size);
+    for (TrackInterpolation mode : {TrackInterpolation::Squad, TrackInterpolation::Cubic}) {
+        std::string kind = mode == TrackInterpolation::Squad ? "squad" : "cubic";
+        std::vector<QuaternionTrack<T>> all;
+        all.reserve(size);
+        for (std::size_t i = 0; i < size; ++i) {
+            for (std::size_t k = 0; k < keys.size(); ++k) {
+                times[k] = static_cast<T>(k) + static_cast<T>(i % 7) / 8;
+                keys[k] = sample(i + k, static_cast<Quaternion<T>*>(nullptr));
+            }
+            all.emplace_back(times, keys, mode);
+        }
+        T time = 0;
+        bench.kernel("track " + kind + " search", name, size, [&] {
+            time = time < 16 ? time + static_cast<T>(0.01) : 0;
+            for (std::size_t i = 0; i < size; ++i) {
+                out[i] = all[i](time);
+            }
+            keep(out);
+        });
+        std::vector<TrackCursor> cursors;
+        bench.kernel("track " + kind + " batch", name, size, [&] {
+            time = time < 16 ? time + static_cast<T>(0.01) : 0;
+            evaluate_tracks(all, cursors, time, out.data());
+            keep(out);
+        });
+    }
+}
+
+/**
+ * Nearest orientation index: bulk build and single query latency
+ */
+template<typename T>
+void index(Bench& bench, std::size_t size) {
+    std::string name = name_of<Quaternion<T>>();
+    std::vector<Quaternion<T>> refs(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        T s = static_cast<T>(i) * static_cast<T>(0.618034);
+        refs[i] = normalized(Quaternion<T>(std::cos(s), std::sin(s * 3), std::cos(s * 7), std::sin(s * 13)));
+    }
+    bench.kernel("index build", name, size, [&] {
+        QuaternionIndex<T> built(refs);
+        keep(built);
+    });
+    QuaternionIndex<T> index(refs);
+    std::size_t i = 0;
+    bench.kernel("index nearest", name, 1, [&] {
+        auto result = index.nearest(refs[i++ % size] * static_cast<T>(-1), 4);
+        keep(result);
+    });
+}
+
+int main(int argc, char **argv) {
+
+    bool json = false;
+    std::size_t size = 1 << 14;
+    double min_time_ms = 5;
+    std::string filter;
+    std::string output;
+    bool check = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (std::strcmp(argv[i], "--csv") == 0) {
+            json = false;
+        } else if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            size = std::strtoul(argv[++i], nullptr, 10);
+        } else if (std::strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            min_time_ms = std::strtod(argv[++i], nullptr);
+        } else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (std::strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (std::strcmp(argv[i], "--check") == 0) {
+            check = true;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--csv|--json] [--size N] [--min-time MS] [--filter TEXT] [--output FILE] [--check]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (check) {
+        std::size_t float_mismatches = reference::mismatches<float>(size);
+        std::size_t double_mismatches = reference::mismatches<double>(size);
+        std::cerr << "reference mismatches: float " << float_mismatches << ", double " << double_mismatches << std::endl;
+        return float_mismatches + double_mismatches == 0 ? 0 : 1;
+    }
+
+    Bench bench(size, min_time_ms, filter);
+
+    arithmetic<float, float>(bench);
+    arithmetic<double, double>(bench);
+    arithmetic<long double, long double>(bench);
+    arithmetic<int, int>(bench);
+    arithmetic<int, float>(bench);
+    arithmetic<int, double>(bench);
+    arithmetic<float, double>(bench);
+    arithmetic<double, float>(bench);
+    arithmetic<double, long double>(bench);
+    arithmetic<float, long double>(bench);
+
+    overhead<float>(bench);
+    overhead<double>(bench);
+
+    functions<float>(bench);
+    functions<double>(bench);
+    functions<long double>(bench);
+
+    arrays<float>(bench);
+    arrays<double>(bench);
+
+    text<float>(bench, size);
+    text<double>(bench, size);
+
+    skinning<float>(bench, size);
+    skinning<double>(bench, size);
+
+    filtering<float>(bench, size);
+    filtering<double>(bench, size);
+
+    hierarchy<float>(bench, size);
+    hierarchy<double>(bench, size);
+
+    fourier<float>(bench, size);
+    fourier<double>(bench, size);
+
+    complexes<float>(bench, size);
+    complexes<double>(bench, size);
+
+    tracks<float>(bench, size);
+    tracks<double>(bench, size);
+
+    index<float>(bench, size);
+    index<double>(bench, size);
+
+    if (output.empty()) {
+        json ? bench.write_json(std::cout) : bench.write_csv(std::cout);
+    } else {
+        std::ofstream file(output);
+        json ? bench.write_json(file) : bench.write_csv(file);
+    }
+
+#if QUATERNION_INSTRUMENTATION
+    quaternion_instrumentation::report(std::cerr);
+#endif
+
+    return 0;
+
+}
@@ -32,7 +32,30 @@
 #define BOOST_TEST_MODULE "Quaternion tests"
 
 #include <complex>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
 #include "Quaternion.h"
+#include "QuaternionArray.h"
+#include "QuaternionRotation.h"
+#include "QuaternionInterpolation.h"
+#include "QuaternionCompose.h"
+#include "QuaternionFile.h"
+#include "QuaternionText.h"
+#include "QuaternionIntegration.h"
+#include "QuaternionPacked.h"
+#include "QuaternionDual.h"
+#include "QuaternionFma.h"
+#include "QuaternionAverage.h"
+#include "QuaternionIndex.h"
+#include "QuaternionValidate.h"
+#include "QuaternionFilter.h"
+#include "QuaternionHierarchy.h"
+#include "QuaternionFourier.h"
+#include "QuaternionComplex.h"
+#include "QuaternionTrack.h"
 #include <boost/test/unit_test.hpp> //VERY IMPORTANT - include this last
 
 
@@ -244,3 +267,1406 @@ BOOST_AUTO_TEST_CASE(division_between_quaternion_and_scalar) {
     Quaternion<double> c(-0.5,0.5,-0.5,0.5);
     BOOST_CHECK_EQUAL(a / b, c);
 }
+
+/** QUATERNION ARRAY **/
+
+BOOST_AUTO_TEST_CASE(quaternion_array_conversion) {
+    std::vector<Quaternion<double>> a = {{0.1,0.5,0.9,1}, {-1,1,-1,1}};
+    QuaternionArray<double> b(a);
+    BOOST_CHECK_EQUAL(b.size(), 2);
+    BOOST_CHECK_EQUAL(b[1], a[1]);
+    BOOST_CHECK_EQUAL(b.to_vector()[0], a[0]);
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_array_arithmetic) {
+    QuaternionArray<double> a(std::vector<Quaternion<double>>{{-1,1,-1,1}, {0.1,0.5,0.9,1}});
+    QuaternionArray<double> b(std::vector<Quaternion<double>>{{0.1,0.5,0.9,1}, {-1,1,-1,1}});
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        BOOST_CHECK_EQUAL((a + b)[i], a[i] + b[i]);
+        BOOST_CHECK_EQUAL((a - b)[i], a[i] - b[i]);
+        BOOST_CHECK_EQUAL((a * b)[i], a[i] * b[i]);
+        BOOST_CHECK_EQUAL((a / b)[i], a[i] / b[i]);
+        BOOST_CHECK_EQUAL((a * b[0])[i], a[i] * b[0]);
+        BOOST_CHECK_EQUAL((b[0] * a)[i], b[0] * a[i]);
+        BOOST_CHECK_EQUAL((a * 2.0)[i], a[i] * 2.0);
+        BOOST_CHECK_EQUAL((a / 2.0)[i], a[i] / 2.0);
+    }
+    BOOST_CHECK_THROW(a + QuaternionArray<double>(3), std::length_error);
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_array_unary) {
+    QuaternionArray<double> a(std::vector<Quaternion<double>>{{-1,1,-1,1}, {0.1,0.5,0.9,1}});
+    std::vector<double> norms = std::norm(a);
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        BOOST_CHECK_EQUAL(compare_double(norms[i], std::norm(a[i])), true);
+        BOOST_CHECK_EQUAL(std::conj(a)[i], std::conj(a[i]));
+        BOOST_CHECK_EQUAL(normalized(a)[i], normalized(a[i]));
+        BOOST_CHECK_EQUAL(inverse(a)[i], inverse(a[i]));
+    }
+}
+
+/** SIMD KERNELS **/
+
+template<typename T>
+constexpr bool identical(const Quaternion<T>& lhs, const Quaternion<T>& rhs) {
+    return lhs.a() == rhs.a() && lhs.b() == rhs.b() && lhs.c() == rhs.c() && lhs.d() == rhs.d();
+}
+
+template<typename T>
+Quaternion<T> random_quaternion(std::mt19937& gen) {
+    std::uniform_real_distribution<T> dist(-2, 2);
+    T a = dist(gen), b = dist(gen), c = dist(gen), d = dist(gen);
+    return {a, b, c, d};
+}
+
+BOOST_AUTO_TEST_CASE(simd_product_matches_scalar) {
+    std::mt19937 gen(42);
+    for (int i = 0; i < 100; ++i) {
+        Quaternion<float> fa = random_quaternion<float>(gen), fb = random_quaternion<float>(gen);
+        Quaternion<double> da = random_quaternion<double>(gen), db = random_quaternion<double>(gen);
+        BOOST_CHECK(identical(fa * fb, operator*<float, float>(fa, fb)));
+        BOOST_CHECK(identical(fa / fb, operator/<float, float>(fa, fb)));
+        BOOST_CHECK(identical(da * db, operator*<double, double>(da, db)));
+        BOOST_CHECK(identical(da / db, operator/<double, double>(da, db)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(simd_batch_product_matches_scalar) {
+    std::mt19937 gen(7);
+    QuaternionArray<float> fa, fb;
+    QuaternionArray<double> da, db;
+    for (int i = 0; i < 37; ++i) {
+        fa.push_back(random_quaternion<float>(gen));
+        fb.push_back(random_quaternion<float>(gen));
+        da.push_back(random_quaternion<double>(gen));
+        db.push_back(random_quaternion<double>(gen));
+    }
+    QuaternionArray<float> fmul = fa * fb, fdiv = fa / fb;
+    QuaternionArray<double> dmul = da * db, ddiv = da / db;
+    QuaternionArray<float> fright = fa * fb[0], fleft = fb[0] * fa;
+    QuaternionArray<double> dright = da * db[0], dleft = db[0] * da, mixed = fa * db[0];
+    for (std::size_t i = 0; i < fa.size(); ++i) {
+        BOOST_CHECK(identical(fmul[i], operator*<float, float>(fa[i], fb[i])));
+        BOOST_CHECK(identical(fdiv[i], operator/<float, float>(fa[i], fb[i])));
+        BOOST_CHECK(identical(dmul[i], operator*<double, double>(da[i], db[i])));
+        BOOST_CHECK(identical(ddiv[i], operator/<double, double>(da[i], db[i])));
+        BOOST_CHECK(identical(fright[i], operator*<float, float>(fa[i], fb[0])));
+        BOOST_CHECK(identical(fleft[i], operator*<float, float>(fb[0], fa[i])));
+        BOOST_CHECK(identical(dright[i], operator*<double, double>(da[i], db[0])));
+        BOOST_CHECK(identical(dleft[i], operator*<double, double>(db[0], da[i])));
+        BOOST_CHECK(identical(mixed[i], fa[i] * db[0]));
+    }
+}
+
+/** ROTATION **/
+
+BOOST_AUTO_TEST_CASE(vector_rotation) {
+    Quaternion<double> q = normalized(Quaternion<double>(0.1,0.5,0.9,1));
+    std::array<double, 3> v = {1.5, -2, 0.25};
+    std::array<double, 3> r = rotate(q, v);
+    Quaternion<double> expected = q * Quaternion<double>(0, v[0], v[1], v[2]) * inverse(q);
+    BOOST_CHECK_EQUAL(compare_double(r[0], expected.b()), true);
+    BOOST_CHECK_EQUAL(compare_double(r[1], expected.c()), true);
+    BOOST_CHECK_EQUAL(compare_double(r[2], expected.d()), true);
+}
+
+BOOST_AUTO_TEST_CASE(batch_rotate_points) {
+    std::mt19937 gen(3);
+    std::vector<double> xs, ys, zs;
+    QuaternionArray<double> qs;
+    for (int i = 0; i < 21; ++i) {
+        Quaternion<double> p = random_quaternion<double>(gen);
+        xs.push_back(p.b());
+        ys.push_back(p.c());
+        zs.push_back(p.d());
+        qs.push_back(normalized(random_quaternion<double>(gen)));
+    }
+    std::vector<double> x1 = xs, y1 = ys, z1 = zs;
+    rotate_points(qs[0], x1.data(), y1.data(), z1.data(), x1.size());
+    std::vector<double> x2 = xs, y2 = ys, z2 = zs;
+    rotate_points(qs, x2.data(), y2.data(), z2.data(), x2.size());
+    for (std::size_t i = 0; i < xs.size(); ++i) {
+        std::array<double, 3> r1 = rotate(qs[0], std::array<double, 3>{xs[i], ys[i], zs[i]});
+        std::array<double, 3> r2 = rotate(qs[i], std::array<double, 3>{xs[i], ys[i], zs[i]});
+        BOOST_CHECK(x1[i] == r1[0] && y1[i] == r1[1] && z1[i] == r1[2]);
+        BOOST_CHECK(x2[i] == r2[0] && y2[i] == r2[1] && z2[i] == r2[2]);
+    }
+    BOOST_CHECK_THROW(rotate_points(qs, x2.data(), y2.data(), z2.data(), 3), std::length_error);
+}
+
+BOOST_AUTO_TEST_CASE(rotation_matrix_round_trip) {
+    std::mt19937 gen(11);
+    for (int i = 0; i < 50; ++i) {
+        Quaternion<double> q = normalized(random_quaternion<double>(gen));
+        Quaternion<double> r = from_matrix(to_matrix(q));
+        if (r.a() * q.a() < 0) {
+            r = r * -1.0;
+        }
+        BOOST_CHECK_SMALL(std::abs(r - q), 1e-12);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(compiled_rotation) {
+    Quaternion<double> q(0.1,0.5,0.9,1);
+    CompiledRotation<double> compiled(q);
+    std::array<double, 3> v = {1.5, -2, 0.25};
+    std::array<double, 3> expected = rotate(normalized(q), v);
+    std::array<double, 3> r = compiled(v);
+    std::vector<double> xs(9, v[0]), ys(9, v[1]), zs(9, v[2]);
+    compiled.apply(xs.data(), ys.data(), zs.data(), xs.size());
+    for (std::size_t k = 0; k < 3; ++k) {
+        BOOST_CHECK_EQUAL(compare_double(r[k], expected[k]), true);
+    }
+    BOOST_CHECK(xs[8] == r[0] && ys[8] == r[1] && zs[8] == r[2]);
+    Quaternion<double> a(-1,1,-1,1);
+    BOOST_CHECK_EQUAL(compiled.divide(a), a / q);
+}
+
+/** CONSTANT EXPRESSIONS **/
+
+constexpr Quaternion<int> const_int(-1,1,-1,1);
+constexpr Quaternion<double> const_double(0.5,1.5,2,1);
+constexpr Quaternion<float> const_float(0.5f,1.5f,2,1);
+constexpr std::complex<double> const_complex_a(1,2);
+constexpr std::complex<double> const_complex_b(3,4);
+
+static_assert(const_int.a() == -1 && const_int.b() == 1 && const_int.c() == -1 && const_int.d() == 1, "accessors");
+static_assert(const_int.real() == -1 && identical(const_int.unreal(), Quaternion<int>(0,1,-1,1)), "real and unreal parts");
+static_assert(identical(Quaternion<double>(const_complex_a, const_complex_b), Quaternion<double>(1,2,3,4)), "complex pair constructor");
+static_assert(Quaternion<double>(const_complex_a, const_complex_b).complex_b() == const_complex_b, "complex accessors");
+static_assert(std::norm(const_int) == 4, "norm");
+static_assert(identical(std::conj(const_int), Quaternion<int>(-1,-1,1,-1)), "conjugate");
+static_assert(identical(const_int + const_double, Quaternion<double>(-0.5,2.5,1,2)), "mixed sum");
+static_assert(identical(const_double - const_complex_a, Quaternion<double>(-0.5,-0.5,2,1)), "complex difference");
+static_assert((const_int * const_double).a() == -1, "mixed product");
+static_assert(identical(const_int * const_double, Quaternion<double>(const_int) * const_double), "double product");
+static_assert(identical(const_float * const_float, operator*<float, float>(const_float, const_float)), "float product");
+static_assert(identical(const_float / const_float, operator/<float, float>(const_float, const_float)), "float division");
+static_assert(identical(const_double / const_int, operator/<double, double>(const_double, Quaternion<double>(const_int))), "mixed division");
+static_assert(identical(2.0 / const_double, inverse(const_double) * 2.0), "scalar division");
+static_assert(identical(inverse(const_int), Quaternion<int>(0,0,0,0)), "integer inverse");
+static_assert(rotate(Quaternion<int>(0,1,0,0), std::array<int, 3>{0,1,0})[1] == -1, "rotation");
+static_assert(noexcept(const_int * const_double) && noexcept(const_double / const_double), "noexcept operators");
+
+constexpr Quaternion<double> const_assigned = [] {
+    Quaternion<double> quat;
+    quat = Quaternion<int>(1,2,3,4);
+    return quat;
+}();
+static_assert(identical(const_assigned, Quaternion<double>(1,2,3,4)), "assignment");
+
+BOOST_AUTO_TEST_CASE(constant_expressions) {
+    constexpr Quaternion<double> folded = const_double * const_double;
+    BOOST_CHECK(identical(folded, operator*<double, double>(const_double, const_double)));
+}
+
+/** INTERPOLATION **/
+
+BOOST_AUTO_TEST_CASE(quaternion_slerp) {
+    Quaternion<double> a(1,0,0,0);
+    Quaternion<double> b(0,0,0,1);
+    Quaternion<double> half(std::sqrt(0.5),0,0,std::sqrt(0.5));
+    BOOST_CHECK_SMALL(std::abs(slerp(a, b, 0.5) - half), 1e-12);
+    BOOST_CHECK_SMALL(std::abs(nlerp(a, b, 0.5) - half), 1e-12);
+    Quaternion<double> c(0.8,0,0,0.6);
+    BOOST_CHECK_SMALL(std::abs(slerp(a, c * -1.0, 0.3) - slerp(a, c, 0.3)), 1e-12);
+    BOOST_CHECK_SMALL(std::abs(slerp(a, a, 0.3) - a), 1e-12);
+    // t converts to the element type instead of taking part in deduction
+    Quaternion<float> fa(1, 0, 0, 0), fb(0, 0, 0, 1);
+    Quaternion<float> fhalf(std::sqrt(0.5f), 0, 0, std::sqrt(0.5f));
+    BOOST_CHECK_SMALL(std::abs(slerp(fa, fb, 0.5) - fhalf), 1e-6f);
+    BOOST_CHECK_SMALL(std::abs(nlerp(fa, fb, 0.5) - fhalf), 1e-6f);
+    BOOST_CHECK_SMALL(std::abs(fast_slerp(fa, fb, 0.5) - fhalf), 1e-6f);
+    BOOST_CHECK_SMALL(std::abs(slerp(a, b, 1) - b), 1e-12);
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_fast_slerp_error_bound) {
+    std::mt19937 gen(5);
+    for (int i = 0; i < 1000; ++i) {
+        Quaternion<double> a = normalized(random_quaternion<double>(gen));
+        Quaternion<double> b = normalized(random_quaternion<double>(gen));
+        double t = i / 999.0;
+        BOOST_CHECK_SMALL(std::abs(fast_slerp(a, b, t) - slerp(a, b, t)), 4e-8);
+    }
+    BOOST_CHECK_SMALL(std::abs(fast_slerp(Quaternion<double>(1), Quaternion<double>(1), 0.5) - Quaternion<double>(1)), 1e-15);
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_batch_interpolation) {
+    std::mt19937 gen(9);
+    QuaternionArray<float> from, to, slerped, nlerped;
+    std::vector<float> t;
+    for (int i = 0; i < 43; ++i) {
+        from.push_back(normalized(random_quaternion<float>(gen)));
+        to.push_back(normalized(random_quaternion<float>(gen)));
+        t.push_back(i / 42.0f);
+    }
+    fast_slerp(from, to, t.data(), slerped);
+    nlerp(from, to, t.data(), nlerped);
+    for (std::size_t i = 0; i < from.size(); ++i) {
+        BOOST_CHECK_SMALL(std::abs(slerped[i] - fast_slerp(from[i], to[i], t[i])), 1e-6f);
+        BOOST_CHECK_SMALL(std::abs(slerped[i] - slerp(from[i], to[i], t[i])), 1e-5f);
+        BOOST_CHECK(identical(nlerped[i], nlerp(from[i], to[i], t[i])));
+    }
+}
+
+/** COMPOSITION **/
+
+BOOST_AUTO_TEST_CASE(quaternion_compose_chain) {
+    std::mt19937 gen(13);
+    std::vector<Quaternion<double>> quats;
+    for (int i = 0; i < 100000; ++i) {
+        quats.push_back(normalized(random_quaternion<double>(gen)));
+    }
+    std::vector<Quaternion<double>> serial(quats.size());
+    Quaternion<double> acc(1);
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        acc = acc * quats[i];
+        serial[i] = acc;
+    }
+    quaternion_parallel::set_thread_count(4);
+    std::vector<Quaternion<double>> scan = inclusive_compose_scan(quats);
+    QuaternionArray<double> array_scan = inclusive_compose_scan(QuaternionArray<double>(quats), 64);
+    BOOST_CHECK_SMALL(std::abs(compose_all(quats) - acc), 1e-9);
+    BOOST_CHECK_SMALL(std::abs(compose_all(QuaternionArray<double>(quats), 64) - acc), 1e-9);
+    for (std::size_t i = 0; i < quats.size(); i += 997) {
+        BOOST_CHECK_SMALL(std::abs(scan[i] - serial[i]), 1e-9);
+        BOOST_CHECK_SMALL(std::abs(array_scan[i] - serial[i]), 1e-9);
+    }
+    quaternion_parallel::set_thread_count(0);
+    BOOST_CHECK(identical(compose_all(std::vector<Quaternion<double>>()), Quaternion<double>(1)));
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_parallel_pool) {
+    // blocks run once each, nested calls from inside a block complete, and
+    // an exception thrown by any block reaches the caller
+    std::vector<std::atomic<int>> runs(64);
+    for (int repeat = 0; repeat < 100; ++repeat) {
+        quaternion_parallel::run_blocks(8, [&](std::size_t b) {
+            quaternion_parallel::run_blocks(8, [&](std::size_t n) { ++runs[b * 8 + n]; });
+        });
+    }
+    for (const std::atomic<int>& count : runs) {
+        BOOST_CHECK_EQUAL(count.load(), 100);
+    }
+    for (std::size_t thrower = 0; thrower < 4; ++thrower) {
+        BOOST_CHECK_THROW(quaternion_parallel::run_blocks(4, [thrower](std::size_t b) {
+            if (b == thrower) {
+                throw std::runtime_error("block failed");
+            }
+        }), std::runtime_error);
+    }
+}
+
+/** FAST NORMALIZATION **/
+
+BOOST_AUTO_TEST_CASE(quaternion_fast_normalization) {
+    std::mt19937 gen(17);
+    for (int i = 0; i < 100; ++i) {
+        Quaternion<double> q = normalized(random_quaternion<double>(gen)) * (1 + (i - 50) * 1e-4);
+        BOOST_CHECK_SMALL(std::abs(fast_normalized(q)) - 1, 1e-15);
+        BOOST_CHECK_SMALL(std::abs(fast_normalized(q) - normalized(q)), 1e-15);
+        Quaternion<float> f = q;
+        BOOST_CHECK_SMALL(std::abs(fast_normalized(f)) - 1, 5e-7f);
+    }
+    // norms outside the float range of the estimate
+    for (double scale : {1e-25, 1e-160, 1e25, 1e160}) {
+        Quaternion<double> q = normalized(random_quaternion<double>(gen)) * scale;
+        BOOST_CHECK_SMALL(std::abs(fast_normalized(q) - normalized(q)), 1e-15);
+        QuaternionArray<double> quats(9, q);
+        renormalize_inplace(quats);
+        for (std::size_t i = 0; i < quats.size(); ++i) {
+            BOOST_CHECK_SMALL(std::abs(quats[i] - normalized(q)), 1e-15);
+        }
+    }
+    Quaternion<float> tiny(1e-19f, 1e-20f, 0, 0);
+    BOOST_CHECK_SMALL(std::abs(fast_normalized(tiny)) - 1, 5e-7f);
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_array_renormalization) {
+    std::mt19937 gen(19);
+    QuaternionArray<double> quats;
+    for (int i = 0; i < 29; ++i) {
+        quats.push_back(normalized(random_quaternion<double>(gen)) * (i % 3 == 0 ? 1.01 : 1.0));
+    }
+    QuaternionArray<double> original = quats;
+    renormalize_inplace(quats, 1e-6);
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        BOOST_CHECK_SMALL(std::norm(quats[i]) - 1, 5e-7);
+        if (i % 3 != 0) {
+            BOOST_CHECK(identical(quats[i], original[i]));
+        } else {
+            BOOST_CHECK(identical(quats[i], fast_normalized(original[i])));
+        }
+    }
+    // the default tolerance does not add drift to unit quaternions
+    QuaternionArray<double> unit;
+    for (int i = 0; i < 29; ++i) {
+        unit.push_back(normalized(random_quaternion<double>(gen)));
+    }
+    original = unit;
+    renormalize_inplace(unit);
+    for (std::size_t i = 0; i < unit.size(); ++i) {
+        BOOST_CHECK_SMALL(std::abs(unit[i]) - 1, 1e-15);
+        BOOST_CHECK_SMALL(std::abs(unit[i] - original[i]), 1e-15);
+    }
+}
+
+/** BINARY STREAMS **/
+
+BOOST_AUTO_TEST_CASE(quaternion_file_aos_round_trip) {
+    std::mt19937 gen(23);
+    std::vector<Quaternion<double>> quats;
+    for (int i = 0; i < 100; ++i) {
+        quats.push_back(random_quaternion<double>(gen));
+    }
+    {
+        QuaternionFileWriter<double> writer("quaternion_test_aos.bin");
+        writer.append(quats.data(), 60);
+        writer.append(QuaternionArray<double>(std::vector<Quaternion<double>>(quats.begin() + 60, quats.end())));
+    }
+    QuaternionFileReader<double> reader("quaternion_test_aos.bin");
+    BOOST_CHECK(reader.layout() == QuaternionLayout::AoS);
+    BOOST_CHECK_EQUAL(reader.size(), quats.size());
+    QuaternionSpan<double> view = reader.quaternions();
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        BOOST_CHECK(identical(view[i], quats[i]));
+    }
+    BOOST_CHECK_THROW(QuaternionFileReader<float>("quaternion_test_aos.bin"), std::runtime_error);
+    std::remove("quaternion_test_aos.bin");
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_file_soa_round_trip) {
+    std::mt19937 gen(29);
+    std::vector<Quaternion<float>> quats;
+    for (int i = 0; i < 50; ++i) {
+        quats.push_back(random_quaternion<float>(gen));
+    }
+    {
+        QuaternionFileWriter<float> writer("quaternion_test_soa.bin", QuaternionLayout::SoA, 64);
+        writer.append(quats.data(), 20);
+        writer.append(std::vector<Quaternion<float>>(quats.begin() + 20, quats.end()));
+        BOOST_CHECK_THROW(writer.append(quats), std::length_error);
+    }
+    QuaternionFileReader<float> reader("quaternion_test_soa.bin");
+    BOOST_CHECK(reader.layout() == QuaternionLayout::SoA);
+    BOOST_CHECK_EQUAL(reader.size(), quats.size());
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        BOOST_CHECK(identical(reader[i], quats[i]));
+        BOOST_CHECK_EQUAL(reader.c_data()[i], quats[i].c());
+    }
+    BOOST_CHECK_THROW(reader.quaternions(), std::logic_error);
+    std::remove("quaternion_test_soa.bin");
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_file_huge_capacity) {
+    {
+        QuaternionFileWriter<double> writer("quaternion_test_huge.bin", QuaternionLayout::SoA, 4);
+        writer.append(std::vector<Quaternion<double>>(4, Quaternion<double>(1, 2, 3, 4)));
+    }
+    // capacity * 32 bytes wraps around to 32
+    std::uint64_t capacity = (std::uint64_t(1) << 59) + 1;
+    {
+        std::fstream file("quaternion_test_huge.bin", std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offsetof(QuaternionFileHeader, capacity));
+        file.write(reinterpret_cast<const char*>(&capacity), sizeof(capacity));
+    }
+    BOOST_CHECK_THROW(QuaternionFileReader<double>("quaternion_test_huge.bin"), std::runtime_error);
+    std::remove("quaternion_test_huge.bin");
+    BOOST_CHECK_THROW(QuaternionFileWriter<double>("quaternion_test_huge.bin", QuaternionLayout::SoA, capacity), std::length_error);
+    std::remove("quaternion_test_huge.bin");
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_file_large_offsets) {
+    // 4 GiB sparse SoA payload: the c and d components start past 2 GiB
+    std::uint64_t capacity = std::uint64_t(1) << 27;
+    {
+        QuaternionFileWriter<double> writer("quaternion_test_large.bin", QuaternionLayout::SoA, capacity);
+        writer.append(std::vector<Quaternion<double>>(3, Quaternion<double>(1, 2, 3, 4)));
+    }
+    {
+        QuaternionFileReader<double> reader("quaternion_test_large.bin");
+        BOOST_CHECK_EQUAL(reader.size(), 3);
+        for (std::size_t i = 0; i < reader.size(); ++i) {
+            BOOST_CHECK(identical(reader[i], Quaternion<double>(1, 2, 3, 4)));
+        }
+    }
+    std::remove("quaternion_test_large.bin");
+}
+
+/** TEXT CONVERSION **/
+
+BOOST_AUTO_TEST_CASE(quaternion_stream_extraction) {
+    Quaternion<double> a(0.1,0.5,0.9,1);
+    std::stringstream stream;
+    stream << a << " ( -1 , 2 , 3.5 , 4 ) (1;2;3;4)";
+    Quaternion<double> b, c, d;
+    stream >> b >> c;
+    BOOST_CHECK(identical(b, a));
+    BOOST_CHECK(identical(c, Quaternion<double>(-1,2,3.5,4)));
+    BOOST_CHECK(!(stream >> d));
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_chars_round_trip) {
+    std::mt19937 gen(31);
+    char buffer[128];
+    for (int i = 0; i < 100; ++i) {
+        Quaternion<double> q = random_quaternion<double>(gen);
+        std::to_chars_result written = to_chars(buffer, buffer + sizeof(buffer), q);
+        BOOST_REQUIRE(written.ec == std::errc());
+        Quaternion<double> r;
+        std::from_chars_result read = from_chars(buffer, written.ptr, r);
+        BOOST_CHECK(read.ec == std::errc() && read.ptr == written.ptr);
+        BOOST_CHECK(identical(q, r));
+    }
+    BOOST_CHECK(to_chars(buffer, buffer + 8, Quaternion<double>(0.1,0.5,0.9,1)).ec == std::errc::value_too_large);
+    const char text[] = "(1, 2, x, 4)";
+    Quaternion<double> untouched(7);
+    BOOST_CHECK(from_chars(text, text + sizeof(text) - 1, untouched).ec == std::errc::invalid_argument);
+    BOOST_CHECK(identical(untouched, Quaternion<double>(7)));
+    for (const char* sign : {"(+-1,0,0,0)", "(0,++1,0,0)", "(0,0,0,+ 1)"}) {
+        BOOST_CHECK(from_chars(sign, sign + std::strlen(sign), untouched).ec == std::errc::invalid_argument);
+    }
+    BOOST_CHECK(identical(untouched, Quaternion<double>(7)));
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_bulk_parse) {
+    const std::string text = "(1,2,3,4)\n(-0.5, 0.25, +1e3, 0);(5,6,7,8), (9,10,11,12)\n";
+    QuaternionArray<float> quats;
+    std::from_chars_result res = parse_quaternions(text.data(), text.data() + text.size(), quats);
+    BOOST_CHECK(res.ec == std::errc());
+    BOOST_REQUIRE_EQUAL(quats.size(), 4);
+    BOOST_CHECK(identical(quats[1], Quaternion<float>(-0.5f,0.25f,1000,0)));
+    BOOST_CHECK(identical(quats[3], Quaternion<float>(9,10,11,12)));
+    const std::string broken = "(1,2,3,4) (1,2,3)";
+    QuaternionArray<float> partial;
+    res = parse_quaternions(broken.data(), broken.data() + broken.size(), partial);
+    BOOST_CHECK(res.ec == std::errc::invalid_argument);
+    BOOST_CHECK_EQUAL(partial.size(), 1);
+    BOOST_CHECK_EQUAL(res.ptr - broken.data(), 10);
+}
+
+/** EXPONENTIAL AND INTEGRATION **/
+
+BOOST_AUTO_TEST_CASE(quaternion_exp_log) {
+    std::mt19937 gen(23);
+    for (int n = 0; n < 100; ++n) {
+        Quaternion<double> q = random_quaternion<double>(gen);
+        BOOST_CHECK_SMALL(std::abs(std::exp(std::log(q)) - q), 1e-12);
+        BOOST_CHECK_SMALL(std::abs(std::pow(q, 3) - q * q * q), 1e-10);
+        BOOST_CHECK_SMALL(std::abs(std::pow(q, 0.5) * std::pow(q, 0.5) - q), 1e-12);
+    }
+    BOOST_CHECK(identical(std::exp(Quaternion<double>(0)), Quaternion<double>(1)));
+    Quaternion<double> l = std::log(Quaternion<double>(-1));
+    BOOST_CHECK_SMALL(std::abs(l - Quaternion<double>(0, M_PI, 0, 0)), 1e-15);
+    Quaternion<double> e = std::exp(Quaternion<double>(0, 0, M_PI / 2, 0));
+    BOOST_CHECK_SMALL(std::abs(e - Quaternion<double>(0, 0, 1, 0)), 1e-15);
+}
+
+BOOST_AUTO_TEST_CASE(angular_velocity_integration) {
+    std::mt19937 gen(29);
+    std::uniform_real_distribution<double> rate(-4, 4);
+    const std::size_t size = 1031;
+    std::vector<Quaternion<double>> start;
+    std::vector<double> wx(size), wy(size), wz(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        start.push_back(normalized(random_quaternion<double>(gen)));
+        double scale = i % 2 == 0 ? 0.01 : 2;
+        wx[i] = rate(gen) * scale;
+        wy[i] = rate(gen) * scale;
+        wz[i] = rate(gen) * scale;
+    }
+    for (double dt : {0.01, 1.5}) {
+        QuaternionArray<double> quats(start);
+        integrate_angular_velocity(quats, wx.data(), wy.data(), wz.data(), dt);
+        for (std::size_t i = 0; i < size; ++i) {
+            Quaternion<double> expected = integrate(start[i], {wx[i], wy[i], wz[i]}, dt);
+            BOOST_CHECK_SMALL(std::abs(quats[i] - expected), 1e-13);
+        }
+    }
+    Quaternion<double> spin = integrate(Quaternion<double>(1), {0.0, 0.0, M_PI}, 1.0);
+    BOOST_CHECK_SMALL(std::abs(spin - Quaternion<double>(0, 0, 0, 1)), 1e-15);
+}
+
+/** PACKED STORAGE **/
+
+double rotation_angle(const Quaternion<double>& q1, const Quaternion<double>& q2) {
+    double cos_half = std::abs(dot(q1, q2)) / (std::abs(q1) * std::abs(q2));
+    return 2 * std::acos(std::min(cos_half, 1.0));
+}
+
+template<unsigned Bits>
+void check_smallest_three(double bound) {
+    std::mt19937 gen(31);
+    QuaternionArray<double> quats;
+    double worst = 0;
+    for (int n = 0; n < 5003; ++n) {
+        Quaternion<double> q = random_quaternion<double>(gen);
+        quats.push_back(n % 3 == 0 ? q * -1.0 : q);
+        Quaternion<double> r = SmallestThree<Bits>(q).template quaternion<double>();
+        worst = std::max(worst, rotation_angle(q, r));
+        BOOST_CHECK_SMALL(std::abs(r) - 1, 1e-12);
+    }
+    BOOST_CHECK_LT(worst, bound);
+    std::vector<SmallestThree<Bits>> packed(quats.size());
+    encode(quats, packed.data());
+    QuaternionArray<double> decoded;
+    decode(packed.data(), packed.size(), decoded);
+    BOOST_REQUIRE_EQUAL(decoded.size(), quats.size());
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        BOOST_CHECK_EQUAL(packed[i].raw(), SmallestThree<Bits>(quats[i]).raw());
+        BOOST_CHECK(identical(decoded[i], packed[i].template quaternion<double>()));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(smallest_three_packing) {
+    check_smallest_three<10>(4.8e-3);
+    check_smallest_three<15>(1.5e-4);
+    PackedQuaternion32 p(Quaternion<float>(0.1f, -0.2f, -0.9f, 0.3f));
+    BOOST_CHECK_EQUAL(p.index(), 2);
+    BOOST_CHECK(identical(PackedQuaternion32().quaternion<double>(), Quaternion<double>(1)));
+    BOOST_CHECK_EQUAL(PackedQuaternion48::from_raw(p.raw()).raw(), p.raw());
+}
+
+BOOST_AUTO_TEST_CASE(half_packing) {
+    BOOST_CHECK_EQUAL(HalfQuaternion(Quaternion<float>(1, -2, 0.5f, 65504)).raw()[3], 0x7bff);
+    BOOST_CHECK_EQUAL(HalfQuaternion(Quaternion<float>(1, -2, 0.5f, 65520)).raw()[3], 0x7c00);
+    BOOST_CHECK_EQUAL(HalfQuaternion(Quaternion<float>(1, -2, 0.5f, 0)).raw()[1], 0xc000);
+    BOOST_CHECK_EQUAL(HalfQuaternion(Quaternion<float>(std::ldexp(1.0f, -24))).raw()[0], 0x0001);
+    BOOST_CHECK_EQUAL(HalfQuaternion(Quaternion<float>(1 + std::ldexp(1.0f, -11))).raw()[0], 0x3c00);
+    BOOST_CHECK(identical(HalfQuaternion().quaternion<float>(), Quaternion<float>(1)));
+    std::mt19937 gen(37);
+    QuaternionArray<float> quats;
+    double worst = 0;
+    for (int n = 0; n < 1003; ++n) {
+        Quaternion<double> q = random_quaternion<double>(gen);
+        quats.push_back(q);
+        worst = std::max(worst, rotation_angle(q, HalfQuaternion(q).quaternion<double>()));
+    }
+    BOOST_CHECK_LT(worst, 9.8e-4);
+    std::vector<HalfQuaternion> packed(quats.size());
+    encode(quats, packed.data());
+    QuaternionArray<float> decoded;
+    decode(packed.data(), packed.size(), decoded);
+    for (std::size_t i = 0; i < quats.size(); ++i) {
+        BOOST_CHECK(packed[i].raw() == HalfQuaternion(quats[i]).raw());
+        BOOST_CHECK(identical(decoded[i], packed[i].quaternion<float>()));
+        BOOST_CHECK(identical(HalfQuaternion(decoded[i]).quaternion<float>(), decoded[i]));
+    }
+}
+
+/** DUAL QUATERNIONS **/
+
+BOOST_AUTO_TEST_CASE(dual_quaternion_transform) {
+    std::mt19937 gen(41);
+    for (int n = 0; n < 50; ++n) {
+        Quaternion<double> r1 = normalized(random_quaternion<double>(gen)), r2 = normalized(random_quaternion<double>(gen));
+        std::array<double, 3> t1 = {1, -2, 3}, t2 = {0.5, 4, -1}, p = {2, 0.25, -7};
+        DualQuaternion<double> d1 = rigid_transform(r1, t1), d2 = rigid_transform(r2, t2);
+        std::array<double, 3> t = d1.translation();
+        BOOST_CHECK(compare_double(t[0], t1[0]) && compare_double(t[1], t1[1]) && compare_double(t[2], t1[2]));
+        std::array<double, 3> expected = transform(d1, transform(d2, p));
+        std::array<double, 3> composed = transform(d1 * d2, p);
+        std::array<double, 3> back = transform(std::conj(d1), transform(d1, p));
+        Quaternion<double> pq(0, p[0], p[1], p[2]);
+        DualQuaternion<double> sandwich = d1 * DualQuaternion<double>(Quaternion<double>(1), pq) * combined_conj(d1);
+        for (int k = 0; k < 3; ++k) {
+            BOOST_CHECK_SMALL(composed[k] - expected[k], 1e-12);
+            BOOST_CHECK_SMALL(back[k] - p[k], 1e-12);
+        }
+        BOOST_CHECK_SMALL(sandwich.dual().b() - transform(d1, p)[0], 1e-12);
+        DualQuaternion<double> scaled = normalized(d1 * 3.0 + DualQuaternion<double>(r1 * 0.0, r1 * 0.1));
+        BOOST_CHECK_SMALL(std::abs(scaled.real() - r1), 1e-12);
+        BOOST_CHECK_SMALL(dot(scaled.real(), scaled.dual()), 1e-12);
+    }
+    DualQuaternion<double> id(Quaternion<double>(1));
+    BOOST_CHECK(id * dual_conj(id) == id);
+}
+
+BOOST_AUTO_TEST_CASE(dual_quaternion_skinning) {
+    std::mt19937 gen(43);
+    std::uniform_real_distribution<double> unit(0, 1);
+    std::vector<DualQuaternion<double>> bones;
+    for (int b = 0; b < 16; ++b) {
+        Quaternion<double> r = normalized(random_quaternion<double>(gen)) * (b % 2 ? -1.0 : 1.0);
+        bones.push_back(rigid_transform(r, {unit(gen), unit(gen), unit(gen)}));
+    }
+    const std::size_t size = 1003, influences = 4;
+    std::vector<std::uint32_t> joints(influences * size);
+    std::vector<double> weights(influences * size), xs(size), ys(size), zs(size), ox(size), oy(size), oz(size);
+    for (std::size_t v = 0; v < size; ++v) {
+        double total = 0;
+        for (std::size_t k = 0; k < influences; ++k) {
+            joints[k * size + v] = gen() % bones.size();
+            weights[k * size + v] = unit(gen) + 0.01;
+            total += weights[k * size + v];
+        }
+        for (std::size_t k = 0; k < influences; ++k) {
+            weights[k * size + v] /= total;
+        }
+        xs[v] = unit(gen);
+        ys[v] = unit(gen);
+        zs[v] = unit(gen);
+    }
+    skin(bones, joints.data(), weights.data(), influences, xs.data(), ys.data(), zs.data(), ox.data(), oy.data(), oz.data(), size);
+    for (std::size_t v = 0; v < size; ++v) {
+        DualQuaternion<double> dqs[influences];
+        double w[influences];
+        for (std::size_t k = 0; k < influences; ++k) {
+            dqs[k] = bones[joints[k * size + v]];
+            w[k] = weights[k * size + v];
+        }
+        std::array<double, 3> expected = transform(blend(dqs, w, influences), {xs[v], ys[v], zs[v]});
+        BOOST_CHECK_SMALL(ox[v] - expected[0], 1e-12);
+        BOOST_CHECK_SMALL(oy[v] - expected[1], 1e-12);
+        BOOST_CHECK_SMALL(oz[v] - expected[2], 1e-12);
+    }
+}
+
+/** FMA ARITHMETIC **/
+
+BOOST_AUTO_TEST_CASE(fma_policy) {
+    std::mt19937 gen(47);
+    for (int n = 0; n < 100; ++n) {
+        Quaternion<double> q1 = random_quaternion<double>(gen), q2 = random_quaternion<double>(gen);
+        Quaternion<long double> exact = Quaternion<long double>(q1) * Quaternion<long double>(q2);
+        BOOST_CHECK_SMALL(std::abs(Quaternion<long double>(quaternion_fma::multiply(q1, q2)) - exact), 1e-14L);
+        BOOST_CHECK_SMALL(std::abs(quaternion_fma::divide(q1, q2) - q1 / q2), 1e-14);
+        BOOST_CHECK(compare_double(quaternion_fma::norm(q1), std::norm(q1)));
+        BOOST_CHECK(compare_double(quaternion_fma::dot(q1, q2), dot(q1, q2)));
+    }
+    const double e = std::ldexp(1.0, -30);
+    Quaternion<double> x(1 + e, 1 + 2 * e, 0, 0), y(1 + e, 1, 0, 0);
+    BOOST_CHECK_EQUAL(quaternion_fma::multiply(x, y).a(), e * e);
+    BOOST_CHECK_EQUAL(quaternion_fma::norm(Quaternion<float>(3, 4, 0, 0)), 25.0f);
+}
+
+/** AVERAGING **/
+
+BOOST_AUTO_TEST_CASE(quaternion_average) {
+    std::mt19937 gen(53);
+    std::normal_distribution<double> noise(0, 0.02);
+    Quaternion<double> base = normalized(Quaternion<double>(0.3, -0.5, 0.7, 0.1));
+    const std::size_t size = 40009;
+    std::vector<Quaternion<double>> quats;
+    std::vector<double> weights;
+    for (std::size_t i = 0; i < size; ++i) {
+        Quaternion<double> q = normalized(base + Quaternion<double>(noise(gen), noise(gen), noise(gen), noise(gen)));
+        quats.push_back(i % 3 == 1 ? q * -1.0 : q);
+        weights.push_back(1 + static_cast<double>(i % 5));
+    }
+    Quaternion<double> mean = average(quats);
+    BOOST_CHECK_SMALL(std::abs(mean - base), 1e-3);
+    BOOST_CHECK_SMALL(std::abs(average(quats, nullptr, AverageMethod::SignAligned) - mean), 1e-6);
+    QuaternionArray<double> soa(quats);
+    BOOST_CHECK(identical(average(soa, weights.data()), average(quats, weights.data())));
+    Quaternion<double> rot = normalized(Quaternion<double>(1, 2, -1, 0.5));
+    std::vector<Quaternion<double>> rotated;
+    for (const Quaternion<double>& q : quats) {
+        rotated.push_back(rot * q);
+    }
+    BOOST_CHECK_SMALL(std::abs(average(rotated, weights.data()) - rot * average(quats, weights.data())), 1e-12);
+
+    Quaternion<double> q1 = normalized(Quaternion<double>(1, 0, 0, 0.2)), q2 = normalized(Quaternion<double>(0.2, 0.9, 0, 0));
+    std::vector<Quaternion<double>> pair = {q1, q2 * -1.0};
+    BOOST_CHECK_SMALL(std::abs(average(pair) - slerp(q1, q2, 0.5)), 1e-12);
+    std::vector<Quaternion<double>> same = {q1, q1 * -1.0, q1};
+    BOOST_CHECK_SMALL(std::abs(average(same) - q1), 1e-15);
+    BOOST_CHECK_THROW(average(std::vector<Quaternion<double>>()), std::invalid_argument);
+}
+
+/** NEAREST NEIGHBORS **/
+
+BOOST_AUTO_TEST_CASE(quaternion_index_queries) {
+    std::mt19937 gen(59);
+    std::vector<Quaternion<double>> refs, queries;
+    for (int i = 0; i < 3001; ++i) {
+        refs.push_back(normalized(random_quaternion<double>(gen)));
+    }
+    for (int i = 0; i < 100; ++i) {
+        queries.push_back(i % 10 == 0 ? refs[i * 7] * -1.0 : normalized(random_quaternion<double>(gen)));
+    }
+    QuaternionIndex<double> index(refs);
+    BOOST_CHECK_EQUAL(index.size(), refs.size());
+    std::vector<std::vector<QuaternionNeighbor<double>>> knn = index.nearest(queries, 5);
+    std::vector<std::vector<QuaternionNeighbor<double>>> ball = index.within(queries, 0.3);
+    for (std::size_t q = 0; q < queries.size(); ++q) {
+        std::vector<std::pair<double, std::size_t>> brute;
+        for (std::size_t r = 0; r < refs.size(); ++r) {
+            brute.emplace_back(geodesic_angle(queries[q], refs[r]), r);
+        }
+        std::sort(brute.begin(), brute.end());
+        BOOST_REQUIRE_EQUAL(knn[q].size(), 5);
+        for (std::size_t k = 0; k < 5; ++k) {
+            BOOST_CHECK_EQUAL(knn[q][k].index, brute[k].second);
+            BOOST_CHECK_SMALL(knn[q][k].angle - brute[k].first, 1e-12);
+        }
+        std::size_t inside = std::count_if(brute.begin(), brute.end(), [](const std::pair<double, std::size_t>& b) { return b.first <= 0.3; });
+        BOOST_CHECK_EQUAL(ball[q].size(), inside);
+        if (q % 10 == 0) {
+            BOOST_CHECK_EQUAL(knn[q][0].index, q * 7);
+            BOOST_CHECK_SMALL(knn[q][0].angle, 1e-7);
+        }
+    }
+    Quaternion<double> x(0, 1, 0, 0), z(std::cos(0.25), std::sin(0.25), 0, 0);
+    BOOST_CHECK(compare_double(geodesic_angle(Quaternion<double>(1), z), 0.5));
+    BOOST_CHECK(compare_double(geodesic_angle(Quaternion<double>(1), x), M_PI));
+    BOOST_CHECK(index.nearest(queries[0], 0).empty());
+    BOOST_CHECK(QuaternionIndex<double>().nearest(queries[0], 3).empty());
+    for (int i = 0; i < 70000; ++i) {
+        refs.push_back(random_quaternion<double>(gen));
+    }
+    QuaternionIndex<double> large(refs);
+    for (std::size_t q = 0; q < 10; ++q) {
+        double best = M_PI;
+        for (const Quaternion<double>& r : refs) {
+            best = std::min(best, geodesic_angle(queries[q], normalized(r)));
+        }
+        BOOST_CHECK_SMALL(large.nearest(queries[q], 1)[0].angle - best, 1e-12);
+    }
+}
+
+/** VALIDATION **/
+
+BOOST_AUTO_TEST_CASE(quaternion_validation) {
+    const double inf = std::numeric_limits<double>::infinity(), nan = std::numeric_limits<double>::quiet_NaN();
+    std::vector<Quaternion<double>> quats;
+    for (int i = 0; i < 203; ++i) {
+        quats.push_back(normalized(Quaternion<double>(1, 0.1 * i, -0.2, 0.3)));
+    }
+    quats[3] = Quaternion<double>(1, nan, 0, 0);
+    quats[64] = Quaternion<double>(inf, 0, 0, 0);
+    quats[65] = Quaternion<double>(0, -inf, nan, 0);
+    quats[130] = Quaternion<double>(2, 0, 0, 0);
+    quats[202] = Quaternion<double>(0, 0, 0, nan);
+    QuaternionArray<double> soa(quats);
+    for (const QuaternionCheck check : {QuaternionCheck::NaN, QuaternionCheck::Inf, QuaternionCheck::NonFinite, QuaternionCheck::NonUnit}) {
+        std::vector<std::uint64_t> aos_bits = invalid_mask(quats, check, 1e-12), soa_bits = invalid_mask(soa, check, 1e-12);
+        BOOST_CHECK(aos_bits == soa_bits);
+        std::size_t expected = 0;
+        for (std::size_t i = 0; i < quats.size(); ++i) {
+            bool bad = check == QuaternionCheck::NaN ? std::isnan(quats[i]) : check == QuaternionCheck::Inf ? std::isinf(quats[i]) :
+                       check == QuaternionCheck::NonFinite ? !std::isfinite(quats[i]) : !std::isfinite(quats[i]) || std::abs(std::norm(quats[i]) - 1) > 1e-12;
+            BOOST_CHECK_EQUAL(((aos_bits[i / 64] >> (i % 64)) & 1) != 0, bad);
+            expected += bad;
+        }
+        BOOST_CHECK_EQUAL(count_invalid(quats, check, 1e-12), expected);
+        BOOST_CHECK_EQUAL(count_invalid(soa, check, 1e-12), expected);
+    }
+    BOOST_CHECK_EQUAL(count_invalid(quats, QuaternionCheck::Inf), 2);
+    BOOST_CHECK_EQUAL(sanitize(quats, Quaternion<double>(1)), 4);
+    BOOST_CHECK_EQUAL(sanitize(soa, Quaternion<double>(1), QuaternionCheck::NonUnit, 1e-12), 5);
+    BOOST_CHECK(identical(quats[65], Quaternion<double>(1)) && identical(soa[130], Quaternion<double>(1)));
+    BOOST_CHECK(identical(quats[130], Quaternion<double>(2)));
+    BOOST_CHECK_EQUAL(count_invalid(quats), 0);
+    BOOST_CHECK_EQUAL(count_invalid(soa, QuaternionCheck::NonUnit, 1e-12), 0);
+}
+
+/** ORIENTATION FILTER **/
+
+namespace {
+
+    /**
+     * Static sensor readings for orientation q: gravity and a field with
+     * 53 degrees inclination seen in the sensor frame.
+     */
+    template<typename T>
+    struct static_imu {
+        std::vector<T> zero, ax, ay, az, mx, my, mz;
+
+        static_imu(const std::vector<Quaternion<T>>& truth, std::size_t samples) {
+            for (std::size_t s = 0; s < samples; ++s) {
+                for (const Quaternion<T>& q : truth) {
+                    std::array<T, 3> g = rotate(std::conj(q), std::array<T, 3>{0, 0, 1});
+                    std::array<T, 3> m = rotate(std::conj(q), std::array<T, 3>{static_cast<T>(0.6), 0, static_cast<T>(0.8)});
+                    zero.push_back(0);
+                    ax.push_back(g[0] * 9.81);
+                    ay.push_back(g[1] * 9.81);
+                    az.push_back(g[2] * 9.81);
+                    mx.push_back(m[0] * 50);
+                    my.push_back(m[1] * 50);
+                    mz.push_back(m[2] * 50);
+                }
+            }
+        }
+
+        ImuBlock<T> block(std::size_t samples, bool magnetic) const {
+            ImuBlock<T> in;
+            in.samples = samples;
+            in.gx = in.gy = in.gz = zero.data();
+            in.ax = ax.data();
+            in.ay = ay.data();
+            in.az = az.data();
+            if (magnetic) {
+                in.mx = mx.data();
+                in.my = my.data();
+                in.mz = mz.data();
+            }
+            return in;
+        }
+    };
+
+}
+
+BOOST_AUTO_TEST_CASE(orientation_filter_convergence) {
+    std::mt19937 gen(43);
+    std::vector<Quaternion<double>> truth;
+    for (std::size_t i = 0; i < 21; ++i) {
+        truth.push_back(normalized(random_quaternion<double>(gen)));
+    }
+    const std::size_t samples = 2000;
+    static_imu<double> imu(truth, samples);
+    for (FilterAlgorithm algorithm : {FilterAlgorithm::Madgwick, FilterAlgorithm::Mahony}) {
+        FilterSettings<double> settings;
+        settings.algorithm = algorithm;
+        settings.sample_period = 0.01;
+        settings.beta = 0.5;
+        settings.kp = 5;
+        // the fixed length Madgwick step ends in a cycle of amplitude about beta * dt
+        double tolerance = algorithm == FilterAlgorithm::Madgwick ? 4 * settings.beta * settings.sample_period : 1e-6;
+        OrientationFilter<double> filter(truth.size(), settings);
+        std::vector<Quaternion<double>> start;
+        for (const Quaternion<double>& q : truth) {
+            start.push_back(normalized(q + random_quaternion<double>(gen) * 0.2));
+        }
+        for (std::size_t i = 0; i < truth.size(); ++i) {
+            filter.set_orientation(i, start[i]);
+        }
+        filter.process(imu.block(samples, true));
+        double worst = 0;
+        for (std::size_t i = 0; i < truth.size(); ++i) {
+            worst = std::max(worst, geodesic_angle(filter.orientation(i), truth[i]));
+        }
+        BOOST_CHECK_SMALL(worst, tolerance);
+        // without magnetometer only the direction of gravity is observable
+        for (std::size_t i = 0; i < truth.size(); ++i) {
+            filter.set_orientation(i, start[i]);
+        }
+        filter.process(imu.block(samples, false));
+        worst = 0;
+        for (std::size_t i = 0; i < truth.size(); ++i) {
+            std::array<double, 3> g = rotate(std::conj(filter.orientation(i)), std::array<double, 3>{0, 0, 1});
+            worst = std::max(worst, std::abs(g[0] - imu.ax[i] / 9.81) + std::abs(g[1] - imu.ay[i] / 9.81) + std::abs(g[2] - imu.az[i] / 9.81));
+        }
+        BOOST_CHECK_SMALL(worst, tolerance);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(orientation_filter_channels) {
+    std::mt19937 gen(44);
+    std::uniform_real_distribution<float> noise(-1, 1);
+    const std::size_t channels = 19, samples = 64;
+    std::vector<float> data[9];
+    for (std::vector<float>& v : data) {
+        for (std::size_t i = 0; i < channels * samples; ++i) {
+            v.push_back(noise(gen));
+        }
+    }
+    for (std::size_t i = 0; i < channels; ++i) {
+        data[3][5 * channels + i] = data[4][5 * channels + i] = data[5][5 * channels + i] = 0;
+        data[6][9 * channels + i] = data[7][9 * channels + i] = data[8][9 * channels + i] = 0;
+    }
+    ImuBlock<float> in;
+    in.samples = samples;
+    in.gx = data[0].data(); in.gy = data[1].data(); in.gz = data[2].data();
+    in.ax = data[3].data(); in.ay = data[4].data(); in.az = data[5].data();
+    in.mx = data[6].data(); in.my = data[7].data(); in.mz = data[8].data();
+    for (FilterAlgorithm algorithm : {FilterAlgorithm::Madgwick, FilterAlgorithm::Mahony}) {
+        FilterSettings<float> settings;
+        settings.algorithm = algorithm;
+        settings.ki = 0.1f;
+        std::vector<float> a(channels * samples), b(channels * samples), c(channels * samples), d(channels * samples);
+        OrientationFilter<float> all(channels, settings);
+        all.process(in, OrientationStream<float>{a.data(), b.data(), c.data(), d.data()});
+        BOOST_CHECK_EQUAL(count_invalid(all.orientations(), QuaternionCheck::NonUnit, 1e-5f), 0);
+        // every channel alone, one sample at a time, through the scalar path
+        for (std::size_t i = 0; i < channels; ++i) {
+            OrientationFilter<float> one(1, settings);
+            for (std::size_t s = 0; s < samples; ++s) {
+                std::size_t o = s * channels + i;
+                ImuBlock<float> sample;
+                sample.samples = 1;
+                sample.gx = &data[0][o]; sample.gy = &data[1][o]; sample.gz = &data[2][o];
+                sample.ax = &data[3][o]; sample.ay = &data[4][o]; sample.az = &data[5][o];
+                sample.mx = &data[6][o]; sample.my = &data[7][o]; sample.mz = &data[8][o];
+                one.process(sample);
+                BOOST_CHECK_SMALL(std::abs(one.orientation(0) - Quaternion<float>(a[o], b[o], c[o], d[o])), 1e-5f);
+            }
+            BOOST_CHECK_SMALL(std::abs(one.orientation(0) - all.orientation(i)), 1e-5f);
+        }
+    }
+    in.my = nullptr;
+    BOOST_CHECK_THROW(OrientationFilter<float>(channels).process(in), std::invalid_argument);
+}
+
+/** HIERARCHY **/
+
+BOOST_AUTO_TEST_CASE(hierarchy_dirty_update) {
+    std::mt19937 gen(45);
+    const std::size_t size = 40000;
+    std::vector<std::size_t> parents(size);
+    std::vector<Quaternion<double>> locals(size);
+    for (std::size_t n = 0; n < size; ++n) {
+        // a few roots, long chains and bushy parts
+        parents[n] = n % 9000 == 0 ? QuaternionHierarchy<double>::root : (n % 3 == 0 ? n - 1 : n - 1 - gen() % (n % 9000));
+        locals[n] = normalized(random_quaternion<double>(gen));
+    }
+    auto naive = [&] {
+        std::vector<Quaternion<double>> worlds(size);
+        for (std::size_t n = 0; n < size; ++n) {
+            worlds[n] = parents[n] == QuaternionHierarchy<double>::root ? locals[n] : worlds[parents[n]] * locals[n];
+        }
+        return worlds;
+    };
+    quaternion_parallel::set_thread_count(4);
+    QuaternionHierarchy<double> tree(parents, locals);
+    std::vector<Quaternion<double>> expected = naive();
+    bool same = true;
+    for (std::size_t n = 0; n < size; ++n) {
+        same = same && identical(tree.world(n), expected[n]) && tree.parent(n) == parents[n];
+    }
+    BOOST_CHECK(same);
+    BOOST_CHECK_EQUAL(tree.subtree_size(0), 9000);
+    for (std::size_t frame = 0; frame < 3; ++frame) {
+        for (std::size_t k = 0; k < size / 100; ++k) {
+            std::size_t n = gen() % size;
+            locals[n] = normalized(random_quaternion<double>(gen));
+            tree.set_local(n, locals[n]);
+        }
+        tree.set_local(frame, locals[frame]);
+        tree.update();
+        BOOST_CHECK_EQUAL(tree.dirty_count(), 0);
+        expected = naive();
+        for (std::size_t n = 0; n < size; ++n) {
+            same = same && identical(tree.world(n), expected[n]) && identical(tree.local(n), locals[n]);
+        }
+        BOOST_CHECK(same);
+    }
+    quaternion_parallel::set_thread_count(0);
+    // storage order: every subtree is a contiguous run inside the run of its parent
+    std::vector<std::size_t> slot_of(size);
+    for (std::size_t slot = 0; slot < size; ++slot) {
+        slot_of[tree.order()[slot]] = slot;
+    }
+    bool ordered = true;
+    for (std::size_t n = 0; n < size; ++n) {
+        ordered = ordered && identical(tree.world_data()[slot_of[n]], tree.world(n));
+        if (parents[n] != QuaternionHierarchy<double>::root) {
+            std::size_t p = slot_of[parents[n]];
+            ordered = ordered && p < slot_of[n] && slot_of[n] + tree.subtree_size(n) <= p + tree.subtree_size(parents[n]);
+        }
+    }
+    BOOST_CHECK(ordered);
+    std::vector<std::size_t> bad = {QuaternionHierarchy<double>::root, 2, 1};
+    BOOST_CHECK_THROW(QuaternionHierarchy<double>(bad, std::vector<Quaternion<double>>(3)), std::invalid_argument);
+}
+
+/** QUATERNION FOURIER TRANSFORM **/
+
+namespace {
+
+    /**
+     * Direct O(N^2) definition of the 2D quaternion Fourier transform
+     */
+    std::vector<Quaternion<double>> naive_qft(const std::vector<Quaternion<double>>& f, std::size_t width, std::size_t height,
+                                              const Quaternion<double>& mu, QftSide side, bool inverse) {
+        const double pi = 3.14159265358979323846;
+        const double sign = inverse ? 1 : -1;
+        std::vector<Quaternion<double>> result(f.size());
+        for (std::size_t v = 0; v < height; ++v) {
+            for (std::size_t u = 0; u < width; ++u) {
+                Quaternion<double> sum;
+                for (std::size_t y = 0; y < height; ++y) {
+                    for (std::size_t x = 0; x < width; ++x) {
+                        double theta = 2 * pi * (static_cast<double>(u * x) / width + static_cast<double>(v * y) / height);
+                        Quaternion<double> e = Quaternion<double>(std::cos(theta)) + mu * (sign * std::sin(theta));
+                        sum = sum + (side == QftSide::Left ? e * f[y * width + x] : f[y * width + x] * e);
+                    }
+                }
+                result[v * width + u] = inverse ? sum / static_cast<double>(f.size()) : sum;
+            }
+        }
+        return result;
+    }
+
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_fourier_transform) {
+    std::mt19937 gen(46);
+    const Quaternion<double> gray = normalized(Quaternion<double>(0, 1, 1, 1));
+    const std::size_t shapes[][2] = {{16, 1}, {12, 1}, {7, 1}, {8, 6}, {5, 9}};
+    for (const auto& shape : shapes) {
+        std::vector<Quaternion<double>> f(shape[0] * shape[1]);
+        for (Quaternion<double>& q : f) {
+            q = random_quaternion<double>(gen);
+        }
+        for (const Quaternion<double>& mu : {Quaternion<double>(0, 1, 0, 0), gray, Quaternion<double>(0, -1, 0, 0)}) {
+            QftPlan<double> plan(shape[0], shape[1], mu * 3.0);
+            for (QftSide side : {QftSide::Left, QftSide::Right}) {
+                std::vector<Quaternion<double>> expected = naive_qft(f, shape[0], shape[1], mu, side, false);
+                std::vector<Quaternion<double>> result = plan.forward(f, side);
+                std::vector<Quaternion<double>> back = plan.inverse(result, side);
+                std::vector<Quaternion<double>> naive_back = naive_qft(expected, shape[0], shape[1], mu, side, true);
+                double error = 0, round_trip = 0;
+                for (std::size_t i = 0; i < f.size(); ++i) {
+                    error = std::max(error, std::abs(result[i] - expected[i]));
+                    round_trip = std::max(round_trip, std::abs(back[i] - f[i]) + std::abs(naive_back[i] - f[i]));
+                }
+                BOOST_CHECK_SMALL(error, 1e-12);
+                BOOST_CHECK_SMALL(round_trip, 1e-12);
+            }
+        }
+    }
+    // 1D plan, in place, threaded rows and columns
+    quaternion_parallel::set_thread_count(3);
+    std::vector<Quaternion<float>> signal(1000), copy;
+    for (std::size_t i = 0; i < signal.size(); ++i) {
+        signal[i] = Quaternion<float>(std::cos(0.1f * i), std::sin(0.3f * i), 0.5f, std::cos(0.7f * i));
+    }
+    copy = signal;
+    QftPlan<float> plan1d(signal.size());
+    plan1d.forward(signal.data(), signal.data(), QftSide::Right);
+    plan1d.inverse(signal.data(), signal.data(), QftSide::Right);
+    float worst = 0;
+    for (std::size_t i = 0; i < signal.size(); ++i) {
+        worst = std::max(worst, std::abs(signal[i] - copy[i]));
+    }
+    BOOST_CHECK_SMALL(worst, 1e-5f);
+    std::vector<Quaternion<double>> image(96 * 64, Quaternion<double>(0, 0.5, 0.25, 0.125));
+    QftPlan<double> plan2d(96, 64, gray);
+    image = plan2d.forward(image);
+    BOOST_CHECK_SMALL(std::abs(image[0] - Quaternion<double>(0, 0.5, 0.25, 0.125) * static_cast<double>(image.size())), 1e-9);
+    double leak = 0;
+    for (std::size_t i = 1; i < image.size(); ++i) {
+        leak = std::max(leak, std::abs(image[i]));
+    }
+    BOOST_CHECK_SMALL(leak, 1e-9);
+    quaternion_parallel::set_thread_count(0);
+    BOOST_CHECK_THROW(QftPlan<double>(8, Quaternion<double>(1, 1, 0, 0)), std::invalid_argument);
+}
+
+/** COMPLEX VIEWS **/
+
+BOOST_AUTO_TEST_CASE(complex_pair_views) {
+    std::mt19937 gen(47);
+    std::uniform_real_distribution<double> dist(-2, 2);
+    const std::size_t size = 37;
+    std::vector<std::complex<double>> interleaved(2 * size), first(size), second(size), factors(size);
+    for (std::complex<double>& z : interleaved) {
+        z = std::complex<double>(dist(gen), dist(gen));
+    }
+    for (std::size_t i = 0; i < size; ++i) {
+        first[i] = interleaved[2 * i];
+        second[i] = interleaved[2 * i + 1];
+        factors[i] = std::complex<double>(dist(gen), dist(gen));
+    }
+    // the same memory seen both ways
+    ComplexPairSpan<double> pairs(interleaved);
+    BOOST_REQUIRE_EQUAL(pairs.size(), size);
+    BOOST_CHECK(pairs.data() == reinterpret_cast<double*>(interleaved.data()));
+    for (std::size_t i = 0; i < size; ++i) {
+        BOOST_CHECK(identical(pairs[i], Quaternion<double>(interleaved[2 * i], interleaved[2 * i + 1])));
+        BOOST_CHECK(pairs.complex_b()[i] == interleaved[2 * i + 1]);
+    }
+    pairs.set(3, Quaternion<double>(1, 2, 3, 4));
+    BOOST_CHECK(interleaved[6] == std::complex<double>(1, 2) && interleaved[7] == std::complex<double>(3, 4));
+    pairs.complex_a().set(4, std::complex<double>(5, 6));
+    BOOST_CHECK(interleaved[8] == std::complex<double>(5, 6));
+    std::vector<Quaternion<double>> quats(size);
+    for (std::size_t i = 0; i < size; ++i) {
+        quats[i] = pairs[i];
+    }
+    const std::vector<Quaternion<double>>& frozen = quats;
+    ComplexPairSpan<const double> view(frozen);
+    BOOST_CHECK_EQUAL(view.complex_values().size(), 2 * size);
+    BOOST_CHECK(view.complex_values()[11] == quats[5].complex_b());
+    BOOST_CHECK(view.complex_a()[5] == quats[5].complex_a());
+    BOOST_CHECK_THROW(ComplexPairSpan<double>(interleaved.data(), 7), std::invalid_argument);
+    first[3] = std::complex<double>(1, 2);
+    second[3] = std::complex<double>(3, 4);
+    first[4] = std::complex<double>(5, 6);
+    SplitComplexSpan<double> split(first, second);
+    for (std::size_t i = 0; i < size; ++i) {
+        BOOST_CHECK(identical(split[i], quats[i]));
+    }
+    split.set(0, Quaternion<double>(5, 6, 7, 8));
+    BOOST_CHECK(first[0] == std::complex<double>(5, 6) && second[0] == std::complex<double>(7, 8));
+    split.set(0, quats[0]);
+    // batched products on every combination of views, and in place
+    std::vector<std::complex<double>> out_pairs(2 * size), out_a(size), out_b(size);
+    ComplexPairSpan<double> to_pairs(out_pairs);
+    SplitComplexSpan<double> to_split(out_a, out_b);
+    multiply(view, factors.data(), to_split);
+    multiply(factors.data(), SplitComplexSpan<const double>(split), to_pairs);
+    for (std::size_t i = 0; i < size; ++i) {
+        BOOST_CHECK_SMALL(std::abs(to_split[i] - quats[i] * factors[i]), 1e-14);
+        BOOST_CHECK_SMALL(std::abs(to_pairs[i] - factors[i] * quats[i]), 1e-14);
+    }
+    multiply(pairs, factors.data(), pairs);
+    multiply(factors.data(), split, split);
+    for (std::size_t i = 0; i < size; ++i) {
+        BOOST_CHECK_SMALL(std::abs(pairs[i] - quats[i] * factors[i]), 1e-14);
+        BOOST_CHECK_SMALL(std::abs(split[i] - factors[i] * quats[i]), 1e-14);
+    }
+    BOOST_CHECK_THROW(multiply(pairs.subspan(0, 5), factors.data(), to_split), std::length_error);
+}
+
+/** KEYFRAME TRACKS **/
+
+namespace {
+
+    /**
+     * Random keys at irregular increasing times
+     */
+    void random_keys(std::mt19937& gen, std::size_t size, std::vector<double>& times, std::vector<Quaternion<double>>& keys) {
+        std::uniform_real_distribution<double> step(0.1, 1.0);
+        times.assign(1, step(gen));
+        keys.assign(1, normalized(random_quaternion<double>(gen)));
+        for (std::size_t i = 1; i < size; ++i) {
+            times.push_back(times.back() + step(gen));
+            // small rotations between keys, sometimes on the opposite hemisphere
+            Quaternion<double> next = normalized(keys.back() + random_quaternion<double>(gen) * 0.2);
+            keys.push_back(i % 3 == 0 ? next * -1.0 : next);
+        }
+    }
+
+    /** slerp along the arc through both inputs as given, without the shortest-arc flip */
+    Quaternion<double> arc_slerp(const Quaternion<double>& from, const Quaternion<double>& to, double t) {
+        double theta = std::acos(std::max(-1.0, std::min(1.0, dot(from, to))));
+        return (from * std::sin((1 - t) * theta) + to * std::sin(t * theta)) / std::sin(theta);
+    }
+
+    /** Hemisphere-aligned keys q and squad inner controls s of a track */
+    void squad_controls(const std::vector<Quaternion<double>>& keys, std::vector<Quaternion<double>>& q, std::vector<Quaternion<double>>& s) {
+        q.resize(keys.size());
+        s.resize(keys.size());
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            q[i] = normalized(keys[i]);
+            if (i > 0 && dot(q[i - 1], q[i]) < 0) {
+                q[i] = q[i] * -1.0;
+            }
+        }
+        s.front() = q.front();
+        s.back() = q.back();
+        for (std::size_t i = 1; i + 1 < keys.size(); ++i) {
+            Quaternion<double> inv = std::conj(q[i]);
+            s[i] = normalized(q[i] * std::exp((std::log(inv * q[i + 1]) + std::log(inv * q[i - 1])) * -0.25));
+        }
+    }
+
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_track_interpolation) {
+    std::mt19937 gen(48);
+    std::vector<double> times;
+    std::vector<Quaternion<double>> keys;
+    random_keys(gen, 12, times, keys);
+    QuaternionTrack<double> squad(times, keys), cubic(times, keys, TrackInterpolation::Cubic);
+    BOOST_CHECK_EQUAL(squad.segments(), 11);
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        BOOST_CHECK_SMALL(1 - std::abs(dot(squad(times[i]), normalized(keys[i]))), 1e-12);
+        BOOST_CHECK_SMALL(1 - std::abs(dot(cubic(times[i]), normalized(keys[i]))), 1e-12);
+    }
+    BOOST_CHECK_SMALL(1 - std::abs(dot(squad(times.front() - 5), normalized(keys.front()))), 1e-12);
+    BOOST_CHECK_SMALL(1 - std::abs(dot(cubic(times.back() + 5), normalized(keys.back()))), 1e-12);
+    // squad against slerp(slerp(q0, q1, u), slerp(s0, s1, u), 2u(1 - u))
+    std::vector<Quaternion<double>> q, s;
+    squad_controls(keys, q, s);
+    for (std::size_t i = 0; i + 1 < keys.size(); ++i) {
+        for (double u : {0.1, 0.5, 0.85}) {
+            Quaternion<double> expected = arc_slerp(slerp(q[i], q[i + 1], u), arc_slerp(s[i], s[i + 1], u), 2 * u * (1 - u));
+            double t = times[i] + u * (times[i + 1] - times[i]);
+            BOOST_CHECK_SMALL(std::abs(squad(t) - expected), 1e-7);
+            // the cubic stays close to the geodesic between close keys
+            BOOST_CHECK_SMALL(std::abs(cubic(t) - slerp(q[i], q[i + 1], u)), 0.1);
+        }
+    }
+    // the cubic is C1 across keys
+    for (std::size_t i = 1; i + 1 < keys.size(); ++i) {
+        const double h = 1e-6;
+        Quaternion<double> left = (cubic(times[i]) - cubic(times[i] - h)) / h;
+        Quaternion<double> right = (cubic(times[i] + h) - cubic(times[i])) / h;
+        BOOST_CHECK_SMALL(std::abs(left - right), 1e-4);
+    }
+    QuaternionTrack<double> single({1.0}, {Quaternion<double>(0, 2, 0, 0)}, TrackInterpolation::Cubic);
+    BOOST_CHECK(identical(single(-3.0), Quaternion<double>(0, 1, 0, 0)));
+    BOOST_CHECK_THROW(QuaternionTrack<double>({1.0, 1.0}, {q[0], q[1]}), std::invalid_argument);
+    BOOST_CHECK_THROW(QuaternionTrack<double>({1.0, 2.0}, {q[0]}), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_track_wide_keys) {
+    // rotations of up to 165 degrees between keys: the inner and outer squad slerps see
+    // negative dot products and must still follow the arc as given
+    std::vector<double> times;
+    std::vector<Quaternion<double>> keys;
+    for (std::size_t i = 0; i < 8; ++i) {
+        times.push_back(static_cast<double>(i));
+        Quaternion<double> axis = normalized(Quaternion<double>(0, 1, 1.5 * std::sin(1.7 * i), 1.5 * std::cos(0.9 * i)));
+        keys.push_back(std::exp(axis * (1.2 * i)));
+    }
+    QuaternionTrack<double> squad(times, keys);
+    std::vector<Quaternion<double>> q, s;
+    squad_controls(keys, q, s);
+    std::size_t negative = 0;
+    for (std::size_t i = 0; i + 1 < keys.size(); ++i) {
+        negative += dot(s[i], s[i + 1]) < 0;
+        Quaternion<double> previous = q[i];
+        for (double u = 0.05; u < 1; u += 0.05) {
+            Quaternion<double> expected = arc_slerp(slerp(q[i], q[i + 1], u), arc_slerp(s[i], s[i + 1], u), 2 * u * (1 - u));
+            Quaternion<double> sample = squad(times[i] + u);
+            BOOST_CHECK_SMALL(std::abs(sample - expected), 1e-7);
+            // continuous inside the segment
+            BOOST_CHECK_SMALL(std::abs(sample - previous), 0.5);
+            previous = sample;
+        }
+        BOOST_CHECK_SMALL(std::abs(previous - q[i + 1]), 0.5);
+    }
+    BOOST_CHECK(negative > 0);
+}
+
+BOOST_AUTO_TEST_CASE(quaternion_track_cursor_and_batch) {
+    std::mt19937 gen(49);
+    std::vector<double> times;
+    std::vector<Quaternion<double>> keys;
+    random_keys(gen, 40, times, keys);
+    QuaternionTrack<double> track(times, keys);
+    TrackCursor cursor;
+    for (double t = times.front() - 1; t < times.back() + 1; t += 0.05) {
+        BOOST_CHECK(identical(track(t, cursor), track(t)));
+        BOOST_CHECK(track.time(cursor.segment) <= t || cursor.segment == 0);
+    }
+    BOOST_CHECK_EQUAL(cursor.segment, track.segments() - 1);
+    BOOST_CHECK_EQUAL(track.locate(times[2] + 1e-3, cursor), 2);
+    BOOST_CHECK_EQUAL(track.locate(times[30], cursor), 30);
+    // many tracks of both kinds, some with a single key, threaded
+    quaternion_parallel::set_thread_count(3);
+    std::vector<QuaternionTrack<double>> tracks;
+    for (std::size_t i = 0; i < 3001; ++i) {
+        random_keys(gen, 1 + i % 9, times, keys);
+        tracks.emplace_back(times, keys, i % 2 ? TrackInterpolation::Cubic : TrackInterpolation::Squad);
+    }
+    std::vector<TrackCursor> cursors;
+    std::vector<Quaternion<double>> out(tracks.size());
+    std::vector<double> offsets(tracks.size());
+    for (double& offset : offsets) {
+        offset = std::uniform_real_distribution<double>(0, 2)(gen);
+    }
+    for (double t = 0; t < 8; t += 0.3) {
+        evaluate_tracks(tracks, cursors, t, out.data());
+        double error = 0;
+        for (std::size_t i = 0; i < tracks.size(); ++i) {
+            error = std::max(error, std::abs(out[i] - tracks[i](t)));
+        }
+        BOOST_CHECK_SMALL(error, 1e-12);
+        std::vector<double> shifted(offsets);
+        for (double& time : shifted) {
+            time += t;
+        }
+        evaluate_tracks(tracks, cursors, shifted.data(), out.data());
+        error = 0;
+        for (std::size_t i = 0; i < tracks.size(); ++i) {
+            error = std::max(error, std::abs(out[i] - tracks[i](shifted[i])));
+        }
+        BOOST_CHECK_SMALL(error, 1e-12);
+    }
+    BOOST_CHECK_EQUAL(cursors.size(), tracks.size());
+    quaternion_parallel::set_thread_count(0);
+}
+
+/** INSTRUMENTATION **/
+
+#if QUATERNION_INSTRUMENTATION
+
+BOOST_AUTO_TEST_CASE(instrumentation_counters) {
+    using quaternion_instrumentation::Operation;
+    quaternion_instrumentation::reset();
+    Quaternion<double> p(1,2,3,4), q(0.5,-1,2,0.25);
+    Quaternion<float> pf(1,2,3,4);
+    volatile double zero = 0;
+    Quaternion<double> r = p * q * q;
+    r = r / p;
+    r = 2.0 / r;
+    r = normalized(r) + inverse(q) + fast_normalized(q);
+    Quaternion<float> rf = pf * pf / pf;
+    QuaternionArray<double> arr(10, p);
+    arr = arr * arr;
+    r = std::complex<double>(1, 2) * (r * std::complex<double>(0.5, -1));
+    quaternion_instrumentation::Report report = quaternion_instrumentation::snapshot();
+    BOOST_CHECK_EQUAL(report.count(Operation::Multiply), 15);
+    BOOST_CHECK_EQUAL(report.count(Operation::Divide), 3);
+    BOOST_CHECK_EQUAL(report.count(Operation::Normalize), 2);
+    BOOST_CHECK_EQUAL(report.count(Operation::Inverse), 1);
+    BOOST_CHECK_EQUAL(report.zero_divisions, 0);
+    BOOST_CHECK_EQUAL(report.non_finite, 0);
+    BOOST_CHECK(!report.first_non_finite.recorded);
+    BOOST_CHECK_EQUAL(report.kernels.at("array mul").calls, 1);
+    BOOST_CHECK_EQUAL(report.kernels.at("array mul").elements, 10);
+    r = p / Quaternion<double>(zero);
+    BOOST_CHECK_EQUAL(quaternion_instrumentation::snapshot().zero_divisions, 1);
+    BOOST_CHECK(std::isfinite(rf));
+}
+
+BOOST_AUTO_TEST_CASE(instrumentation_first_non_finite) {
+    using quaternion_instrumentation::Operation;
+    quaternion_instrumentation::reset();
+    Quaternion<double> p(1,2,3,4);
+    Quaternion<double> zero;
+    p = p * p;
+    {
+        quaternion_instrumentation::Scope scope("solver");
+        p = normalized(zero);
+        p = p * Quaternion<double>(1);
+    }
+    quaternion_instrumentation::Report report = quaternion_instrumentation::snapshot();
+    BOOST_CHECK_EQUAL(report.zero_divisions, 1);
+    BOOST_CHECK_EQUAL(report.non_finite, 2);
+    BOOST_CHECK(report.first_non_finite.recorded);
+    BOOST_CHECK(report.first_non_finite.operation == Operation::Normalize);
+    BOOST_CHECK_EQUAL(std::string(report.first_non_finite.scope), "solver");
+    BOOST_CHECK_EQUAL(report.first_non_finite.sequence, 2);
+    std::ostringstream dump;
+    dump << report;
+    BOOST_CHECK(dump.str().find("first non-finite: normalize in solver") != std::string::npos);
+}
+
+namespace {
+    std::atomic<std::size_t> hooked_elements{0};
+    void count_elements(const char*, std::size_t elements, std::chrono::nanoseconds) {
+        hooked_elements += elements;
+    }
+}
+
+BOOST_AUTO_TEST_CASE(instrumentation_kernel_timing) {
+    quaternion_instrumentation::reset();
+    quaternion_instrumentation::set_timing_hook(count_elements);
+    std::mt19937 gen(41);
+    QuaternionArray<double> quats;
+    std::vector<double> w(1 << 15, 0.1);
+    for (std::size_t i = 0; i < w.size(); ++i) {
+        quats.push_back(normalized(random_quaternion<double>(gen)));
+    }
+    integrate_angular_velocity(quats, w.data(), w.data(), w.data(), 0.01);
+    renormalize_inplace(quats, 1e-12);
+    quaternion_instrumentation::set_timing_hook(nullptr);
+    quaternion_instrumentation::Report report = quaternion_instrumentation::snapshot();
+    BOOST_CHECK_EQUAL(report.kernels.at("integrate_angular_velocity").elements, w.size());
+    BOOST_CHECK_EQUAL(report.kernels.at("renormalize_inplace").calls, 1);
+    BOOST_CHECK_EQUAL(hooked_elements.load(), 2 * w.size());
+}
+
+#else
+
+BOOST_AUTO_TEST_CASE(instrumentation_disabled) {
+    // the hooks discard their arguments unevaluated: these name nothing
+    // that exists and still compile, so no code can be left behind
+    QUATERNION_RECORD(NoSuchOperation, no_such_result);
+    QUATERNION_RECORD_DIVISOR(no_such_norm);
+    QUATERNION_COUNT_BATCH(NoSuchOperation, no_such_size);
+    QUATERNION_TIMED_KERNEL(no_such_kernel, no_such_size);
+    // and the hooked operators still fold
+    constexpr Quaternion<double> p(1, 2, 3, 4), q(0.5, -1, 2, 0.25);
+    constexpr Quaternion<double> product = p * q, quotient = p / q, complex_product = p * std::complex<double>(1, 2);
+    static_assert(product.a() == -4.5 && quotient.a() == 5.5 / 5.3125 && complex_product.a() == -3, "hooked operators fold");
+    BOOST_CHECK(identical(product, operator*<double, double>(p, q)));
+}
+
+#endif